@@ -23,8 +23,15 @@
 
 #include "common.h"
 #include "math.h"
+#include "bvh.h"
+#include "camera.h"
+#include "bray.h"
+#include "wave.h"
+#include "denoise.h"
 
 #define EPSILON (0.0001f)
+#define ALBEDO (0.7f) // the default material
+#define SLAB_ROBUST (1.00000036f) // 1 + 2 gamma(3), keeps box exits conservative (Ize 2013)
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
@@ -35,48 +42,131 @@
 #define HEIGHT     (768)
 #define COMPONENTS (3)
 
-struct model_t { // to read models in the wavefront format
-	vecf3_t *v;
-	vecf3_t *t;
-	vecf3_t *n;
-	veci3_t *indv;
-	veci3_t *indt;
-	veci3_t *indn;
-	size_t len_v;
-	size_t len_t;
-	size_t len_n;
-	size_t len_indv;
-	size_t len_indt;
-	size_t len_indn;
-	size_t cap_v;
-	size_t cap_t;
-	size_t cap_n;
-	size_t cap_indv;
-	size_t cap_indt;
-	size_t cap_indn;
+// BVH_WIDTH lanes worth of floats, for testing all children of a wide node
+#if BVH_WIDTH == 8
+typedef f32x8_t widef_t;
+#define WideSet1(x)        F8_Set1(x)
+#define WideLoad(p)        F8_Load(p)
+#define WideStore(p,a)     F8_StoreU(p,a)
+#define WideAdd(a,b)       F8_Add(a,b)
+#define WideSub(a,b)       F8_Sub(a,b)
+#define WideMul(a,b)       F8_Mul(a,b)
+#define WideMin(a,b)       F8_Min(a,b)
+#define WideMax(a,b)       F8_Max(a,b)
+#define WideMaskLE(a,b)    F8_Mask(F8_CmpLE(a,b))
+#else
+typedef f32x4_t widef_t;
+#define WideSet1(x)        F4_Set1(x)
+#define WideLoad(p)        F4_Load(p)
+#define WideStore(p,a)     F4_StoreU(p,a)
+#define WideAdd(a,b)       F4_Add(a,b)
+#define WideSub(a,b)       F4_Sub(a,b)
+#define WideMul(a,b)       F4_Mul(a,b)
+#define WideMin(a,b)       F4_Min(a,b)
+#define WideMax(a,b)       F4_Max(a,b)
+#define WideMaskLE(a,b)    F4_Mask(F4_CmpLE(a,b))
+#endif
+
+char *layouts[] = { "binary", "wide", "quant" };
+char *builders[] = { "sah", "lbvh", "sbvh" };
+char *heatmaps[] = { "none", "nodes", "tris" };
+char *isects[] = { "mt", "watertight", "watertight-simd", "baldwin" };
+char *cameras[] = { "pinhole", "ortho" };
+char *lightmodes[] = { "uniform", "power", "tree" };
+char *samplers[] = { "random", "sobol", "owen", "lattice" };
+
+struct widestack_t { // a deferred child of a wide node
+	u32 child;
+	u32 count;
+	f32 t;
 };
 
-struct triangle_t {
-	vecf3_t a, b, c;
-	vecf3_t n;
-};
+/* R_Main : rendering main function, filling in the AOVs too if not NULL */
+int R_Main(struct world_t *world, vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h);
 
-struct world_t {
-	struct triangle_t *t;
-	size_t t_cnt, t_len;
-};
+/* R_Rows : casts one primary ray per pixel, a row at a time, filling in the AOVs too if not NULL */
+int R_Rows(struct world_t *world, vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h);
+
+/* R_WriteAOV : writes every AOV plane into its own image, named after the output */
+int R_WriteAOV(char *name, struct aov_t *aov, s32 w, s32 h);
+
+/* R_Bench : renders with every BVH layout, and reports their speed and size */
+void R_Bench(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h);
+
+/* R_BenchTime : renders a few times, returns the best time in seconds */
+f64 R_BenchTime(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h);
+
+/* R_BenchAnimate : ripples the vertices over the frames, timing each update and render */
+void R_BenchAnimate(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h, s32 frames);
+
+/* R_Ripple : moves the point by a wave running along the next axis over */
+void R_Ripple(vecf3_t out, vecf3_t in, f32 amp, f32 k, f32 phase);
+
+/* R_Heatmap : prints the traversal statistics, and turns the counts into colors */
+void R_Heatmap(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h);
+
+/* R_HeatmapStats : prints a histogram and percentiles of one counter */
+void R_HeatmapStats(char *name, u32 *counts, s32 len);
 
-/* R_Main : rendering main function */
-int R_Main(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h);
+/* R_HeatmapColor : maps 0 to 1 onto a blue, cyan, green, yellow, red ramp */
+void R_HeatmapColor(vecf3_t out, f32 x);
 
-/* R_RayCast : cast a ray into the world, returning the color vector */
-int R_RayCast(struct world_t *world, vecf3_t out, vecf3_t origin, vecf3_t dir);
+/* R_RayCast : cast a ray into the world, filling in the hit record, returns the triangle */
+u32 R_RayCast(struct world_t *world, struct hit_t *hit, vecf3_t origin, vecf3_t dir);
+
+/* R_IntersectWide : slab tests every child of the node, returns the hit mask */
+u32 R_IntersectWide(struct ray_t *ray, struct bvhwide_t *node, f32 tmax, f32 *dist);
+
+/* R_IntersectQuant : slab tests every child of the quantized node, returns the hit mask */
+u32 R_IntersectQuant(struct ray_t *ray, struct bvhquant_t *node, f32 tmax, f32 *dist);
+
+/* R_IntersectAABB : slab test, returns the entry distance or FLT_MAX on a miss */
+f32 R_IntersectAABB(struct ray_t *ray, vecf3_t min, vecf3_t max, f32 tmax);
 
 /* R_IntersectTriangle : determines if a ray intersects with a triangle */
-int R_IntersectTriangle(vecf3_t out, struct triangle_t *t, vecf3_t origin, vecf3_t dir);
+static inline int R_IntersectTriangle(vecf3_t out, struct triangle_t *t, vecf3_t origin, vecf3_t dir, s32 cull);
+
+/* R_IntersectWatertight : watertight ray-triangle test, using the ray's shear */
+static inline int R_IntersectWatertight(vecf3_t tuv, struct triangle_t *tri, struct ray_t *ray, s32 cull);
+
+/* R_IntersectWatertight4 : watertight test of up to four triangles, returns the hit mask */
+static inline u32 R_IntersectWatertight4(struct world_t *world, struct ray_t *ray, u32 *prims, s32 len, f32 *t, f32 *u, f32 *v, s32 cull);
+
+/* R_IntersectBaldwin : ray-triangle test through the triangle's precomputed transform */
+static inline int R_IntersectBaldwin(vecf3_t tuv, struct trixform_t *xf, struct ray_t *ray, s32 cull);
+
+/* A_WorldLoad : loads the entire world from the given model files, and their textures if not NULL, through a tile cache of texcache bytes if not 0 */
+void A_WorldLoad(struct world_t **world, char **names, u32 *flags, f32 *emission, char **textures, size_t texcache, s32 names_len);
+
+/* A_WorldBuild : builds the acceleration structures over the loaded world */
+int A_WorldBuild(struct world_t *world);
+
+/* A_WorldUpdate : updates the normals, lights and acceleration structures after the triangles moved from prev */
+int A_WorldUpdate(struct world_t *world, struct triangle_t *prev);
+
+/* A_WorldTransforms : precomputes every triangle's transform, for ISECT_BALDWIN */
+int A_WorldTransforms(struct world_t *world);
 
-/* A_WorldLoad : loads the entire world */
-void A_WorldLoad(struct world_t **world);
+/* A_TriangleTransform : computes the transform into the triangle's barycentric space */
+void A_TriangleTransform(struct trixform_t *xf, struct triangle_t *tri);
+
+/* A_TriangleNormals : recomputes the face normal, and carries the vertex normals along from prev if not NULL */
+void A_TriangleNormals(struct triangle_t *tri, struct vnormal_t *vn, struct triangle_t *prev);
+
+/* A_TriangleFrame : an orthonormal frame along the triangle's first edge and normal */
+void A_TriangleFrame(vecf3_t frame[3], struct triangle_t *tri);
+
+/* A_WorldAddModel : appends the model's faces to the world's triangles */
+void A_WorldAddModel(struct world_t *world, struct model_t *model, u32 flags, u16 material);
+
+/* A_WorldAddMaterial : appends a material, returns its index */
+u16 A_WorldAddMaterial(struct world_t *world, vecf3_t albedo, vecf3_t emission, struct texture_t *tex);
+
+/* A_WorldModelMaterial : appends one of a model's .mtl materials, returns its index */
+u16 A_WorldModelMaterial(struct world_t *world, struct mtl_t *mtl);
+
+/* A_WorldAddTexture : the world's texture for the image, which starts loading on the pool the first time it's seen */
+struct texture_t *A_WorldAddTexture(struct world_t *world, char *name);
 
 /* A_WorldFree : frees the world */
 void A_WorldFree(struct world_t *world);
@@ -87,11 +177,44 @@ struct model_t *A_LoadModel(char *name);
 /* A_FreeModel : all resources related to the model */
 void A_FreeModel(struct model_t *model);
 
+/* A_ParseFace : appends a face's triangles, fanned out from its first corner, each corner v, v/vt, v//vn or v/vt/vn */
+void A_ParseFace(struct model_t *model, char *s, s32 mtl);
+
+/* A_ParseIndex : reads a 1 based, or negative from the end of the len so far, index at *s, 0 based, -1 if there's none */
+s32 A_ParseIndex(char **s, size_t len);
+
+/* A_AddTriangle : appends a triangle's vertex, texture coordinate and normal indices, and its material */
+void A_AddTriangle(struct model_t *model, veci3_t a, veci3_t b, veci3_t c, s32 mtl);
+
+/* A_LoadMaterials : reads a .mtl library into the model's materials */
+void A_LoadMaterials(struct model_t *model, char *name);
+
+/* A_ModelMaterial : the index of the model's material called name, added with the defaults if it's new */
+s32 A_ModelMaterial(struct model_t *model, char *name);
+
+/* A_Path : name, relative to the directory of the file base, into out */
+void A_Path(char *out, size_t len, char *base, char *name);
+
 int main(int argc, char **argv)
 {
 	struct world_t *world;
 	u8 *img;
 	vecf3_t *framebuffer;
+	struct aov_t aov;
+	char **models;
+	u32 *flags, next_flags;
+	f32 *emission, next_emission;
+	char **textures, *next_texture;
+	f32 rr[DEPTH_MAX];
+	char *end;
+	s32 models_len;
+	s32 layout, bench, frames, heatmap, isect;
+	s32 builder, treelets, presplit;
+	s32 camera, spp, bounces, stats, lightmode, sampler, denoise, aovs;
+	f32 budget, fov, ortho_w;
+	size_t texcache;
+	u64 hits, misses, bytes;
+	f64 start;
 	s32 w, h, c;
 	s32 i, j;
 	s32 idx;
@@ -101,130 +224,1339 @@ int main(int argc, char **argv)
 	h = HEIGHT;
 	c = COMPONENTS;
 
+	models = calloc(argc, sizeof(*models));
+	flags = calloc(argc, sizeof(*flags));
+	emission = calloc(argc, sizeof(*emission));
+	textures = calloc(argc, sizeof(*textures));
+	models_len = 0;
+	next_flags = 0;
+	next_emission = 10;
+	next_texture = NULL;
+	texcache = 0;
+	layout = LAYOUT_WIDE;
+	builder = BVH_BUILD_SAH;
+	treelets = 0;
+	presplit = 0;
+	budget = 0.3f;
+	bench = 0;
+	frames = 0;
+	heatmap = HEATMAP_NONE;
+	isect = ISECT_WATERTIGHT_SIMD;
+	lightmode = LIGHTS_TREE;
+	sampler = SAMPLER_OWEN;
+	camera = CAM_PINHOLE;
+	fov = 0;
+	ortho_w = 0;
+	spp = 1;
+	bounces = 8;
+	stats = 0;
+	denoise = 0;
+	aovs = 0;
+
+	// no roulette for the first couple of bounces, then up to 95% survival
+	for (i = 0; i < DEPTH_MAX; i++) {
+		rr[i] = i < 2 ? 1 : 0.95f;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-bench") == 0) {
+			bench = 1;
+		} else if (strcmp(argv[i], "-animate") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-layout") == 0 && i + 1 < argc) {
+			for (layout = 0; layout < LAYOUT_TOTAL; layout++) {
+				if (strcmp(argv[i + 1], layouts[layout]) == 0) {
+					break;
+				}
+			}
+			if (layout == LAYOUT_TOTAL) {
+				fprintf(stderr, "Error, unknown layout '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-builder") == 0 && i + 1 < argc) {
+			for (builder = 0; builder < BVH_BUILD_TOTAL; builder++) {
+				if (strcmp(argv[i + 1], builders[builder]) == 0) {
+					break;
+				}
+			}
+			if (builder == BVH_BUILD_TOTAL) {
+				fprintf(stderr, "Error, unknown builder '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-heatmap") == 0 && i + 1 < argc) {
+			for (heatmap = 0; heatmap < HEATMAP_TOTAL; heatmap++) {
+				if (strcmp(argv[i + 1], heatmaps[heatmap]) == 0) {
+					break;
+				}
+			}
+			if (heatmap == HEATMAP_TOTAL) {
+				fprintf(stderr, "Error, unknown heatmap '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-isect") == 0 && i + 1 < argc) {
+			for (isect = 0; isect < ISECT_TOTAL; isect++) {
+				if (strcmp(argv[i + 1], isects[isect]) == 0) {
+					break;
+				}
+			}
+			if (isect == ISECT_TOTAL) {
+				fprintf(stderr, "Error, unknown intersection test '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-camera") == 0 && i + 1 < argc) {
+			for (camera = 0; camera < CAM_TOTAL; camera++) {
+				if (strcmp(argv[i + 1], cameras[camera]) == 0) {
+					break;
+				}
+			}
+			if (camera == CAM_TOTAL) {
+				fprintf(stderr, "Error, unknown camera '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-fov") == 0 && i + 1 < argc) {
+			fov = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-ortho") == 0 && i + 1 < argc) {
+			ortho_w = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-spp") == 0 && i + 1 < argc) {
+			spp = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-bounces") == 0 && i + 1 < argc) {
+			bounces = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-rr") == 0 && i + 1 < argc) {
+			// a comma separated cap per bounce, the last one carries on
+			end = argv[++i];
+			for (j = 0; j < DEPTH_MAX; j++) {
+				rr[j] = strtof(end, &end);
+				if (*end++ != ',') {
+					break;
+				}
+			}
+			for (j++; j < DEPTH_MAX; j++) {
+				rr[j] = rr[j - 1];
+			}
+		} else if (strcmp(argv[i], "-stats") == 0) {
+			stats = 1;
+		} else if (strcmp(argv[i], "-denoise") == 0) {
+			denoise = 1;
+		} else if (strcmp(argv[i], "-aov") == 0) {
+			aovs = 1;
+		} else if (strcmp(argv[i], "-light") == 0 && i + 1 < argc) {
+			// lights only glow, the texture would otherwise land on the next model
+			if (next_texture) {
+				fprintf(stderr, "Error, light '%s' can't take the texture '%s'\n", argv[i + 1], next_texture);
+				exit(1);
+			}
+			emission[models_len] = next_emission;
+			flags[models_len] = next_flags;
+			models[models_len++] = argv[++i];
+			next_flags = 0;
+		} else if (strcmp(argv[i], "-lights") == 0 && i + 1 < argc) {
+			for (lightmode = 0; lightmode < LIGHTS_TOTAL; lightmode++) {
+				if (strcmp(argv[i + 1], lightmodes[lightmode]) == 0) {
+					break;
+				}
+			}
+			if (lightmode == LIGHTS_TOTAL) {
+				fprintf(stderr, "Error, unknown light selection '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-sampler") == 0 && i + 1 < argc) {
+			for (sampler = 0; sampler < SAMPLER_TOTAL; sampler++) {
+				if (strcmp(argv[i + 1], samplers[sampler]) == 0) {
+					break;
+				}
+			}
+			if (sampler == SAMPLER_TOTAL) {
+				fprintf(stderr, "Error, unknown sampler '%s'\n", argv[i + 1]);
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-emission") == 0 && i + 1 < argc) {
+			next_emission = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-twosided") == 0) {
+			next_flags |= MESH_TWOSIDED;
+		} else if (strcmp(argv[i], "-tex") == 0 && i + 1 < argc) {
+			next_texture = argv[++i];
+		} else if (strcmp(argv[i], "-texcache") == 0 && i + 1 < argc) {
+			texcache = atof(argv[++i]) * (1 << 20);
+		} else if (strcmp(argv[i], "-treelets") == 0 && i + 1 < argc) {
+			treelets = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-presplit") == 0) {
+			presplit = 1;
+		} else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+			budget = atof(argv[++i]);
+		} else {
+			flags[models_len] = next_flags;
+			textures[models_len] = next_texture;
+			models[models_len++] = argv[i];
+			next_flags = 0;
+			next_texture = NULL;
+		}
+	}
+
 	img = calloc(w * h * c, sizeof(*img));
 	framebuffer = calloc(w * h, sizeof(*framebuffer));
 
-	A_WorldLoad(&world);
+	// written out with -aov, and the denoiser's guides, the heatmap's counts have no use for them
+	denoise = denoise && heatmap == HEATMAP_NONE;
+	memset(&aov, 0, sizeof(aov));
+	if (aovs || denoise) {
+		aov.normal = calloc(w * h, sizeof(*aov.normal));
+		aov.shading = calloc(w * h, sizeof(*aov.shading));
+		aov.albedo = calloc(w * h, sizeof(*aov.albedo));
+		aov.depth = calloc(w * h, sizeof(*aov.depth));
+		aov.prim = calloc(w * h, sizeof(*aov.prim));
+		aov.bary = calloc(w * h, sizeof(*aov.bary));
+		aov.variance = calloc(w * h, sizeof(*aov.variance));
+	}
+
+	A_WorldLoad(&world, models, flags, emission, textures, texcache, models_len);
+	world->layout = layout;
+	world->isect = isect;
+	world->lights.mode = lightmode;
+	world->sampler.type = sampler;
+	world->spp = spp;
+	world->bounces = MIN(bounces, DEPTH_MAX - 1);
+	world->stats = stats || bench;
+	memcpy(world->rr, rr, sizeof(rr));
+	world->camera.type = camera;
+	if (fov > 0) {
+		world->camera.fov = fov;
+	}
+	if (ortho_w > 0) {
+		world->camera.ortho_w = ortho_w;
+	}
+	world->bvh.builder = builder;
+	world->bvh.treelets = treelets;
+	world->bvh.presplit = presplit;
+	world->bvh.budget = budget;
+
+	start = C_Time();
+
+	if (A_WorldBuild(world) < 0) {
+		fprintf(stderr, "Error, couldn't build the BVH\n");
+		exit(1);
+	}
+
+	if (bench) {
+		printf("bench: %s build, %.1f ms, SAH cost %.2f, %zu references to %zu triangles\n",
+			builders[builder], (C_Time() - start) * 1000, world->bvh.cost,
+			world->bvh.prims_len, world->t_len);
+		R_Bench(world, framebuffer, w, h);
+	}
+
+	// the render below is of the last frame's deformed world
+	if (frames > 0) {
+		R_BenchAnimate(world, framebuffer, w, h, frames);
+	}
+
+	// render the entire scene
+	world->heatmap = heatmap;
+	rc = R_Main(world, framebuffer, aov.normal ? &aov : NULL, w, h);
+
+	if (world->heatmap != HEATMAP_NONE) {
+		R_Heatmap(world, framebuffer, w, h);
+	}
+
+	if (world->stats && world->texcache.budget) {
+		T_CacheCounters(&world->texcache, &hits, &misses, &bytes);
+		printf("stats: texture cache %.2f%% hits, %llu misses, %.2f MB read, %.2f MB budget\n",
+			100.0 * hits / MAX(hits + misses, 1), misses, bytes / (f64)(1 << 20),
+			world->texcache.budget / (f64)(1 << 20));
+	}
+
+	if (denoise && rc == 0) {
+		start = C_Time();
+		rc = D_Denoise(framebuffer, &aov, w, h);
+		if (world->stats) {
+			printf("stats: denoise %.2f ms\n", (C_Time() - start) * 1000);
+		}
+	}
+
+	// convert from floating point into our vec3ub
+	for (i = 0; i < w; i++) {
+		for (j = 0; j < h; j++) {
+			idx = IDX2D(i, j, w);
+			img[idx * c + 0] = CLAMP(framebuffer[idx][0], 0, 1) * 255.0;
+			img[idx * c + 1] = CLAMP(framebuffer[idx][1], 0, 1) * 255.0;
+			img[idx * c + 2] = CLAMP(framebuffer[idx][2], 0, 1) * 255.0;
+		}
+	}
+
+	rc = stbi_write_png("output.png", w, h, 3, img, 0);
+	if (!rc) {
+		fprintf(stderr, "Error, stbi_write_png failed\n");
+		exit(1);
+	}
+
+	if (aovs && R_WriteAOV("output", &aov, w, h) < 0) {
+		fprintf(stderr, "Error, couldn't write the AOVs\n");
+		exit(1);
+	}
+
+	free(img);
+	free(framebuffer);
+	free(aov.normal);
+	free(aov.shading);
+	free(aov.albedo);
+	free(aov.depth);
+	free(aov.prim);
+	free(aov.bary);
+	free(aov.variance);
+
+	A_WorldFree(world);
+	free(models);
+	free(flags);
+	free(emission);
+	free(textures);
+
+	return 0;
+}
+
+/* R_Main : rendering main function, filling in the AOVs too if not NULL */
+int R_Main(struct world_t *world, vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h)
+{
+	// the heatmap counts the primary rays, everything else is path traced
+	if (world->heatmap != HEATMAP_NONE) {
+		return R_Rows(world, framebuffer, aov, w, h);
+	}
+
+	return W_Render(world, framebuffer, aov, w, h);
+}
+
+/* R_Rows : casts one primary ray per pixel, a row at a time, filling in the AOVs too if not NULL */
+int R_Rows(struct world_t *world, vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h)
+{
+	struct camrow_t row;
+	struct hit_t hit;
+	struct raydiff_t rd;
+	struct footprint_t fp;
+	vecf3_t origin, dir;
+	s32 i, j, k, rc;
+
+	CAM_Setup(&world->camera, w, h);
+
+	rc = 0;
+
+#pragma omp parallel private(row, hit, rd, fp, origin, dir, i, j, k) reduction(|:rc)
+	{
+		rc = CAM_RowInit(&row, w);
+
+		// rows near the horizon cost more than the sky, so hand them out one by one
+#pragma omp for schedule(dynamic, 1)
+		for (j = 0; j < h; j++) {
+			if (rc < 0) {
+				continue;
+			}
+
+			CAM_Row(&world->camera, j, &row);
+
+			for (i = 0; i < w; i++) {
+				Vec3(origin, row.o[0][i], row.o[1][i], row.o[2][i]);
+				Vec3(dir, row.d[0][i], row.d[1][i], row.d[2][i]);
+
+				R_RayCast(world, &hit, origin, dir);
+
+				k = i + j * w;
+
+				if (world->heatmap != HEATMAP_NONE) {
+					Vec3(framebuffer[k], hit.nodes, hit.tris, 0);
+				} else if (hit.prim != BVH_NONE) {
+					Vec3(framebuffer[k], 1, 1, 1);
+				} else {
+					Vec3(framebuffer[k], 0, 0, 0);
+				}
+
+				if (!aov) {
+					continue;
+				}
+
+				Vec3Copy(aov->normal[k], hit.ng);
+				Vec3Copy(aov->shading[k], hit.ns);
+				aov->depth[k] = hit.t;
+				aov->prim[k] = hit.prim;
+				aov->bary[k][0] = hit.u;
+				aov->bary[k][1] = hit.v;
+				aov->variance[k] = -1;
+
+				if (hit.prim != BVH_NONE) {
+					CAM_Differentials(&world->camera, dir, 1, &rd);
+					R_Differentials(world, hit.prim, hit.t, dir, &rd, &fp);
+					R_Albedo(world, hit.prim, hit.u, hit.v, &fp, aov->albedo[k]);
+				} else {
+					Vec3(aov->albedo[k], 0, 0, 0);
+				}
+			}
+		}
+
+		CAM_RowFree(&row);
+	}
+
+	return rc;
+}
+
+/* R_WriteAOV : writes every AOV plane into its own image, named after the output */
+int R_WriteAOV(char *name, struct aov_t *aov, s32 w, s32 h)
+{
+	char path[BUFSMALL];
+	f32 *plane;
+	u8 *id;
+	s32 i, k, rc;
+
+	plane = calloc(w * h * 3, sizeof(*plane));
+	id = calloc(w * h * 4, sizeof(*id));
+
+	if (!plane || !id) {
+		free(plane);
+		free(id);
+		return -1;
+	}
+
+	rc = 1;
+
+	// float planes go out as Radiance HDR, which can't hold a negative, so the normals are halved and biased
+	for (i = 0; i < w * h; i++) {
+		plane[i] = aov->depth[i];
+	}
+	snprintf(path, sizeof path, "%s_depth.hdr", name);
+	rc &= stbi_write_hdr(path, w, h, 1, plane);
+
+	for (i = 0; i < w * h; i++) {
+		for (k = 0; k < 3; k++) {
+			plane[i * 3 + k] = aov->normal[i][k] * 0.5f + 0.5f;
+		}
+	}
+	snprintf(path, sizeof path, "%s_normal.hdr", name);
+	rc &= stbi_write_hdr(path, w, h, 3, plane);
+
+	for (i = 0; i < w * h; i++) {
+		for (k = 0; k < 3; k++) {
+			plane[i * 3 + k] = aov->shading[i][k] * 0.5f + 0.5f;
+		}
+	}
+	snprintf(path, sizeof path, "%s_shading.hdr", name);
+	rc &= stbi_write_hdr(path, w, h, 3, plane);
+
+	for (i = 0; i < w * h; i++) {
+		for (k = 0; k < 3; k++) {
+			plane[i * 3 + k] = aov->albedo[i][k];
+		}
+	}
+	snprintf(path, sizeof path, "%s_albedo.hdr", name);
+	rc &= stbi_write_hdr(path, w, h, 3, plane);
+
+	// the weight of a as well, so the three add up to 1 on a hit
+	for (i = 0; i < w * h; i++) {
+		plane[i * 3 + 0] = aov->prim[i] != BVH_NONE ? 1 - aov->bary[i][0] - aov->bary[i][1] : 0;
+		plane[i * 3 + 1] = aov->bary[i][0];
+		plane[i * 3 + 2] = aov->bary[i][1];
+	}
+	snprintf(path, sizeof path, "%s_bary.hdr", name);
+	rc &= stbi_write_hdr(path, w, h, 3, plane);
+
+	// ids have to come through exactly, so they're the four bytes of a PNG's RGBA, little endian
+	for (i = 0; i < w * h; i++) {
+		for (k = 0; k < 4; k++) {
+			id[i * 4 + k] = (aov->prim[i] >> (k * 8)) & 0xff;
+		}
+	}
+	snprintf(path, sizeof path, "%s_prim.png", name);
+	rc &= stbi_write_png(path, w, h, 4, id, 0);
+
+	free(plane);
+	free(id);
+
+	return rc ? 0 : -1;
+}
+
+/* R_RayCast : cast a ray into the world, filling in the hit record, returns the triangle */
+u32 R_RayCast(struct world_t *world, struct hit_t *hit, vecf3_t origin, vecf3_t dir)
+{
+	struct ray_t ray;
+	vecf3_t tuv; // literally the t, u, and v values from the intersection
+
+	memset(hit, 0, sizeof(*hit));
+
+	R_RayInit(&ray, origin, dir);
+
+	hit->prim = R_Traverse(world, &ray, tuv, FLT_MAX);
+	hit->nodes = ray.nodes;
+	hit->tris = ray.tris;
+
+	if (hit->prim == BVH_NONE) {
+		return BVH_NONE;
+	}
+
+	hit->t = tuv[0];
+	hit->u = tuv[1];
+	hit->v = tuv[2];
+
+	Vec3Scale(hit->pos, dir, hit->t);
+	Vec3Add(hit->pos, hit->pos, origin);
+
+	Vec3Copy(hit->ng, world->t[hit->prim].n);
+	R_ShadingNormal(world, hit->prim, hit->u, hit->v, hit->ns);
+
+	if (Vec3Dot(hit->ng, dir) > 0) {
+		Vec3Scale(hit->ng, hit->ng, -1);
+		Vec3Scale(hit->ns, hit->ns, -1);
+	}
+
+	return hit->prim;
+}
+
+/* R_Heatmap : prints the traversal statistics, and turns the counts into colors */
+void R_Heatmap(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h)
+{
+	u32 *nodes, *tris, *shown;
+	u32 top;
+	s32 i, len;
+
+	len = w * h;
+	nodes = calloc(len, sizeof(*nodes));
+	tris = calloc(len, sizeof(*tris));
+
+	for (i = 0; i < len; i++) {
+		nodes[i] = framebuffer[i][0];
+		tris[i] = framebuffer[i][1];
+	}
+
+	printf("heatmap: %s layout, %s builder, %dx%d rays\n",
+		layouts[world->layout], builders[world->bvh.builder], w, h);
+	R_HeatmapStats("nodes", nodes, len);
+	R_HeatmapStats("tris", tris, len);
+
+	// R_HeatmapStats sorted the counts, so scale to the 99th percentile, and
+	// let the few worst pixels saturate rather than wash out everything else
+	shown = world->heatmap == HEATMAP_TRIS ? tris : nodes;
+	top = MAX(shown[(s64)(len - 1) * 99 / 100], 1);
+
+	for (i = 0; i < len; i++) {
+		R_HeatmapColor(framebuffer[i],
+			framebuffer[i][world->heatmap == HEATMAP_TRIS ? 1 : 0] / top);
+	}
+
+	printf("heatmap: output.png shows %s, red at %u and above\n",
+		heatmaps[world->heatmap], top);
+
+	free(nodes);
+	free(tris);
+}
+
+/* R_HeatmapStats : prints a histogram and percentiles of one counter */
+void R_HeatmapStats(char *name, u32 *counts, s32 len)
+{
+	size_t *hist;
+	size_t bins[16];
+	u32 max, bin, bins_len;
+	f64 sum;
+	s32 i, j;
+
+	if (len == 0) {
+		return;
+	}
+
+	for (i = 0, max = 0, sum = 0; i < len; i++) {
+		max = MAX(max, counts[i]);
+		sum += counts[i];
+	}
+
+	// counting sort, then the percentiles fall straight out of the array
+	hist = calloc(max + 2, sizeof(*hist));
+	for (i = 0; i < len; i++) {
+		hist[counts[i] + 1]++;
+	}
+	for (i = 1; i <= (s32)max + 1; i++) {
+		hist[i] += hist[i - 1];
+	}
+	for (i = 0; i <= (s32)max; i++) {
+		for (j = hist[i]; j < (s32)hist[i + 1]; j++) {
+			counts[j] = i;
+		}
+	}
+	free(hist);
+
+	printf("heatmap: %-5s mean %.1f, p50 %u, p90 %u, p99 %u, max %u\n",
+		name, sum / len, counts[(s64)(len - 1) * 50 / 100],
+		counts[(s64)(len - 1) * 90 / 100], counts[(s64)(len - 1) * 99 / 100], max);
+
+	bins_len = MIN(ARRSIZE(bins), max + 1);
+
+	memset(bins, 0, sizeof(bins));
+	for (i = 0; i < len; i++) {
+		bins[(u64)counts[i] * bins_len / (max + 1)]++;
+	}
+
+	for (i = 0; i < (s32)bins_len; i++) {
+		// the smallest count that lands in the bin, rounding down would name
+		// one that belongs to the bin before
+		bin = ((u64)i * (max + 1) + bins_len - 1) / bins_len;
+		printf("heatmap: %-5s %6u+ %8zu ", name, bin, bins[i]);
+		for (j = 0; j < (s32)(bins[i] * 50 / len); j++) {
+			putchar('#');
+		}
+		putchar('\n');
+	}
+}
+
+/* R_HeatmapColor : maps 0 to 1 onto a blue, cyan, green, yellow, red ramp */
+void R_HeatmapColor(vecf3_t out, f32 x)
+{
+	static f32 ramp[][3] = {
+		{ 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 }
+	};
+	f32 f;
+	s32 i;
+
+	x = CLAMP(x, 0, 1) * (ARRSIZE(ramp) - 1);
+	i = MIN((s32)x, (s32)ARRSIZE(ramp) - 2);
+	f = x - i;
+
+	Vec3Lerp(out, ramp[i], ramp[i + 1], f);
+}
+
+/* R_Bench : renders with every BVH layout, and reports their speed and size */
+void R_Bench(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h)
+{
+	struct bvh_t *bvh;
+	size_t bytes[LAYOUT_TOTAL], tri_bytes;
+	f64 best, fastest;
+	s32 layout, isect, saved, winner;
+
+	bvh = &world->bvh;
+
+	bytes[LAYOUT_BINARY] = bvh->nodes_len * sizeof(*bvh->nodes);
+	bytes[LAYOUT_WIDE] = bvh->wide_len * sizeof(*bvh->wide);
+	bytes[LAYOUT_QUANT] = bvh->quant_len * sizeof(*bvh->quant);
+
+	printf("bench: %zu triangles, %dx%d primary rays\n", world->t_len, w, h);
+
+	saved = world->layout;
+	winner = saved;
+	fastest = 0;
+
+	for (layout = 0; layout < LAYOUT_TOTAL; layout++) {
+		if (bytes[layout] == 0 && world->t_len) {
+			continue;
+		}
+
+		world->layout = layout;
+		best = R_BenchTime(world, framebuffer, w, h);
+
+		printf("bench: %-6s %10zu node bytes %7.2f bytes/tri %8.3f Mrays/s\n",
+			layouts[layout], bytes[layout],
+			world->t_len ? (f64)bytes[layout] / world->t_len : 0.0,
+			best > 0 ? (w * h) / best / 1e6 : 0.0);
+
+		if (fastest == 0 || best < fastest) {
+			fastest = best;
+			winner = layout;
+		}
+	}
+
+	printf("bench: fastest layout is %s\n", layouts[winner]);
+
+	// then every triangle test, through the layout that was asked for
+	world->layout = saved;
+	saved = world->isect;
+	winner = saved;
+	fastest = 0;
+
+	if (!world->xf && A_WorldTransforms(world) < 0) {
+		fprintf(stderr, "Error, couldn't allocate the triangle transforms\n");
+		return;
+	}
+
+	for (isect = 0; isect < ISECT_TOTAL; isect++) {
+		world->isect = isect;
+		best = R_BenchTime(world, framebuffer, w, h);
+
+		tri_bytes = sizeof(*world->t);
+		if (isect == ISECT_BALDWIN) {
+			tri_bytes += sizeof(*world->xf);
+		}
+
+		printf("bench: %-16s %4zu bytes/tri %8.3f Mrays/s\n",
+			isects[isect], tri_bytes, best > 0 ? (w * h) / best / 1e6 : 0.0);
+
+		if (fastest == 0 || best < fastest) {
+			fastest = best;
+			winner = isect;
+		}
+	}
+
+	printf("bench: fastest triangle test is %s\n", isects[winner]);
+
+	world->isect = saved;
+	if (world->isect != ISECT_BALDWIN) {
+		free(world->xf);
+		world->xf = NULL;
+	}
+}
+
+/* R_BenchTime : renders a few times, returns the best time in seconds */
+f64 R_BenchTime(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h)
+{
+	f64 start, best;
+	s32 i;
+
+	for (i = 0, best = 0; i < 3; i++) {
+		start = C_Time();
+		R_Rows(world, framebuffer, NULL, w, h);
+		start = C_Time() - start;
+		best = i == 0 ? start : MIN(best, start);
+	}
+
+	return best;
+}
+
+/* R_BenchAnimate : ripples the vertices over the frames, timing each update and render */
+void R_BenchAnimate(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h, s32 frames)
+{
+	struct triangle_t *rest, *prev;
+	struct bvhnode_t *root;
+	vecf3_t size;
+	f64 update, render;
+	f32 cost, amp, k, phase;
+	s32 frame;
+	s64 i;
+
+	if (world->bvh.nodes_len == 0) {
+		return;
+	}
+
+	rest = malloc(world->t_len * sizeof(*rest));
+	prev = malloc(world->t_len * sizeof(*prev));
+
+	if (!rest || !prev) {
+		fprintf(stderr, "Error, couldn't allocate the animation's triangles\n");
+		free(rest);
+		free(prev);
+		return;
+	}
+
+	memcpy(rest, world->t, world->t_len * sizeof(*rest));
+
+	// sixteen waves across the scene, growing until they fold it over onto
+	// itself by the last frame, so the refit tree gets worse until it's rebuilt
+	root = world->bvh.nodes;
+	Vec3Sub(size, root->max, root->min);
+	k = 32 * M_PI / MAX(sqrtf(Vec3Dot(size, size)), 1e-6f);
+
+	for (frame = 1; frame <= frames; frame++) {
+		memcpy(prev, world->t, world->t_len * sizeof(*prev));
+
+		amp = 2 / k * frame / frames;
+		phase = 0.5f * frame;
+
+#pragma omp parallel for schedule(static)
+		for (i = 0; i < (s64)world->t_len; i++) {
+			R_Ripple(world->t[i].a, rest[i].a, amp, k, phase);
+			R_Ripple(world->t[i].b, rest[i].b, amp, k, phase);
+			R_Ripple(world->t[i].c, rest[i].c, amp, k, phase);
+		}
+
+		// a rebuild measures from its own cost, a refit leaves it alone
+		cost = world->bvh.cost;
+
+		update = C_Time();
+		if (A_WorldUpdate(world, prev) < 0) {
+			fprintf(stderr, "Error, couldn't update the world\n");
+			break;
+		}
+		update = C_Time() - update;
+
+		render = C_Time();
+		R_Rows(world, framebuffer, NULL, w, h);
+		render = C_Time() - render;
+
+		printf("bench: frame %3d %-7s %8.2f ms, SAH cost %.2f, %8.3f Mrays/s\n",
+			frame, world->bvh.cost != cost ? "rebuild" : "refit", update * 1000,
+			BVH_Cost(&world->bvh), render > 0 ? (w * h) / render / 1e6 : 0.0);
+	}
+
+	free(rest);
+	free(prev);
+}
+
+/* R_Ripple : moves the point by a wave running along the next axis over */
+void R_Ripple(vecf3_t out, vecf3_t in, f32 amp, f32 k, f32 phase)
+{
+	out[0] = in[0] + amp * sinf(k * in[1] + phase);
+	out[1] = in[1] + amp * sinf(k * in[2] + phase);
+	out[2] = in[2] + amp * sinf(k * in[0] + phase);
+}
+
+/* R_RayInit : sets up the ray, and everything precomputed from it */
+void R_RayInit(struct ray_t *ray, vecf3_t origin, vecf3_t dir)
+{
+	s32 i;
+
+	Vec3Copy(ray->origin, origin);
+	Vec3Copy(ray->dir, dir);
+	Vec3(ray->inv_dir, 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]);
+
+	// go by inv_dir, so a -0 component picks the planes its -inf slab needs
+	for (i = 0; i < 3; i++) {
+		ray->near[i] = ray->inv_dir[i] < 0 ? i + 3 : i;
+		ray->far[i] = ray->inv_dir[i] < 0 ? i : i + 3;
+	}
+
+	// the watertight test's permutation, swapping x and y when the ray runs
+	// down kz keeps the triangles' winding
+	ray->kz = fabsf(dir[0]) > fabsf(dir[1]) ?
+		(fabsf(dir[0]) > fabsf(dir[2]) ? 0 : 2) :
+		(fabsf(dir[1]) > fabsf(dir[2]) ? 1 : 2);
+	ray->kx = (ray->kz + 1) % 3;
+	ray->ky = (ray->kx + 1) % 3;
+	if (dir[ray->kz] < 0) {
+		SWAP(ray->kx, ray->ky);
+	}
+
+	ray->sz = 1.0f / dir[ray->kz];
+	ray->sx = dir[ray->kx] * ray->sz;
+	ray->sy = dir[ray->ky] * ray->sz;
+
+	ray->nodes = 0;
+	ray->tris = 0;
+}
+
+// the traversal kernels, one copy per culling, hit and triangle test mode, see kernel.h
+#define KERNEL(name)  name##CullMt
+#define KERNEL_CULL   1
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_MT
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullWatertight
+#define KERNEL_CULL   1
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_WATERTIGHT
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullWatertightSimd
+#define KERNEL_CULL   1
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_WATERTIGHT_SIMD
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullBaldwin
+#define KERNEL_CULL   1
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_BALDWIN
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullAnyMt
+#define KERNEL_CULL   1
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_MT
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullAnyWatertight
+#define KERNEL_CULL   1
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_WATERTIGHT
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullAnyWatertightSimd
+#define KERNEL_CULL   1
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_WATERTIGHT_SIMD
+#include "kernel.h"
+
+#define KERNEL(name)  name##CullAnyBaldwin
+#define KERNEL_CULL   1
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_BALDWIN
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedMt
+#define KERNEL_CULL   0
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_MT
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedWatertight
+#define KERNEL_CULL   0
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_WATERTIGHT
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedWatertightSimd
+#define KERNEL_CULL   0
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_WATERTIGHT_SIMD
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedBaldwin
+#define KERNEL_CULL   0
+#define KERNEL_ANY    0
+#define KERNEL_ISECT  ISECT_BALDWIN
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedAnyMt
+#define KERNEL_CULL   0
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_MT
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedAnyWatertight
+#define KERNEL_CULL   0
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_WATERTIGHT
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedAnyWatertightSimd
+#define KERNEL_CULL   0
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_WATERTIGHT_SIMD
+#include "kernel.h"
+
+#define KERNEL(name)  name##TwoSidedAnyBaldwin
+#define KERNEL_CULL   0
+#define KERNEL_ANY    1
+#define KERNEL_ISECT  ISECT_BALDWIN
+#include "kernel.h"
+
+// every traversal, by double-sided, any hit, then ISECT_* and LAYOUT_*
+#define TRAVERSALS(s) { R_TraverseBVH##s, R_TraverseWide##s, R_TraverseQuant##s }
+#define TRAVERSALS_ISECT(s) { TRAVERSALS(s##Mt), TRAVERSALS(s##Watertight), TRAVERSALS(s##WatertightSimd), TRAVERSALS(s##Baldwin) }
+
+static u32 (*traversals[2][2][ISECT_TOTAL][LAYOUT_TOTAL])(struct world_t *world, struct ray_t *ray, vecf3_t tuv, f32 tmax) = {
+	{ TRAVERSALS_ISECT(Cull), TRAVERSALS_ISECT(CullAny) },
+	{ TRAVERSALS_ISECT(TwoSided), TRAVERSALS_ISECT(TwoSidedAny) }
+};
+
+#undef TRAVERSALS
+#undef TRAVERSALS_ISECT
+
+/* R_Traverse : finds the closest triangle nearer than tmax, returns its index */
+u32 R_Traverse(struct world_t *world, struct ray_t *ray, vecf3_t tuv, f32 tmax)
+{
+	// a single double-sided mesh means every triangle is tested double-sided
+	return traversals[!!(world->flags & MESH_TWOSIDED)][0][world->isect][world->layout](world, ray, tuv, tmax);
+}
+
+/* R_Occluded : checks for any triangle nearer than tmax, for shadow rays */
+int R_Occluded(struct world_t *world, struct ray_t *ray, f32 tmax)
+{
+	vecf3_t tuv;
+
+	return traversals[!!(world->flags & MESH_TWOSIDED)][1][world->isect][world->layout](world, ray, tuv, tmax) != BVH_NONE;
+}
+
+/* R_ShadingNormal : the vertex normals interpolated at u, v, on the same side as the face normal */
+void R_ShadingNormal(struct world_t *world, u32 prim, f32 u, f32 v, vecf3_t out)
+{
+	struct vnormal_t *vn;
+	vecf3_t na, nb, nc;
+	f32 len;
+	s32 k;
+
+	vn = world->vn + prim;
+
+	Vec3OctDecode(na, vn->a);
+	Vec3OctDecode(nb, vn->b);
+	Vec3OctDecode(nc, vn->c);
+
+	for (k = 0; k < 3; k++) {
+		out[k] = (1 - u - v) * na[k] + u * nb[k] + v * nc[k];
+	}
+
+	// opposite normals can cancel out, and a model's winding can disagree with them
+	len = Vec3Dot(out, out);
+	if (len <= 0) {
+		Vec3Copy(out, world->t[prim].n);
+		return;
+	}
+
+	Vec3Scale(out, out, (1.0f / sqrtf(len)));
+
+	if (Vec3Dot(out, world->t[prim].n) < 0) {
+		Vec3Scale(out, out, -1);
+	}
+}
+
+/* R_Differentials : carries the ray differentials t along dir to the triangle, and finds the hit's footprint */
+void R_Differentials(struct world_t *world, u32 prim, f32 t, vecf3_t dir, struct raydiff_t *rd, struct footprint_t *fp)
+{
+	struct triangle_t *tri;
+	vecf3_t e1, e2, dpdx, dpdy;
+	f32 dn, dtdx, dtdy, a11, a12, a22, det;
+	s32 k;
+
+	tri = world->t + prim;
+	memset(fp, 0, sizeof(*fp));
+
+	// a grazing hit has no sensible footprint, it gets the finest level
+	dn = Vec3Dot(dir, tri->n);
+	if (fabsf(dn) < 1e-8f) {
+		return;
+	}
+
+	// the neighboring pixels' rays, moved along to the plane of the triangle
+	for (k = 0; k < 3; k++) {
+		dpdx[k] = rd->dodx[k] + t * rd->dddx[k];
+		dpdy[k] = rd->dody[k] + t * rd->dddy[k];
+	}
+
+	dtdx = -Vec3Dot(dpdx, tri->n) / dn;
+	dtdy = -Vec3Dot(dpdy, tri->n) / dn;
+
+	for (k = 0; k < 3; k++) {
+		dpdx[k] += dtdx * dir[k];
+		dpdy[k] += dtdy * dir[k];
+	}
+
+	Vec3Copy(rd->dodx, dpdx);
+	Vec3Copy(rd->dody, dpdy);
+
+	// and dp = du e1 + dv e2, by least squares, as dp lies in the plane anyway
+	Vec3Sub(e1, tri->b, tri->a);
+	Vec3Sub(e2, tri->c, tri->a);
+
+	a11 = Vec3Dot(e1, e1);
+	a12 = Vec3Dot(e1, e2);
+	a22 = Vec3Dot(e2, e2);
+	det = a11 * a22 - a12 * a12;
+	if (det <= 0) {
+		return;
+	}
+	det = 1 / det;
+
+	fp->dudx = (a22 * Vec3Dot(e1, dpdx) - a12 * Vec3Dot(e2, dpdx)) * det;
+	fp->dvdx = (a11 * Vec3Dot(e2, dpdx) - a12 * Vec3Dot(e1, dpdx)) * det;
+	fp->dudy = (a22 * Vec3Dot(e1, dpdy) - a12 * Vec3Dot(e2, dpdy)) * det;
+	fp->dvdy = (a11 * Vec3Dot(e2, dpdy) - a12 * Vec3Dot(e1, dpdy)) * det;
+}
+
+/* R_Albedo : the material's albedo at u, v, times its texture filtered over the footprint, or the finest level if NULL */
+void R_Albedo(struct world_t *world, u32 prim, f32 u, f32 v, struct footprint_t *fp, vecf3_t out)
+{
+	struct material_t *m;
+	struct texcoord_t *uv;
+	struct texture_t *tex;
+	vecf4_t c;
+	f32 s, t, ds[2], dt[2], lod;
+
+	m = world->materials + world->mat[prim];
+
+	tex = m->tex;
+	if (!tex) {
+		Vec3Copy(out, m->albedo);
+		return;
+	}
+
+	uv = world->uv + prim;
+	s = (1 - u - v) * uv->a[0] + u * uv->b[0] + v * uv->c[0];
+	t = (1 - u - v) * uv->a[1] + u * uv->b[1] + v * uv->c[1];
+
+	// the footprint in barycentrics, into texture coordinates
+	lod = 0;
+	if (fp) {
+		ds[0] = fp->dudx * (uv->b[0] - uv->a[0]) + fp->dvdx * (uv->c[0] - uv->a[0]);
+		dt[0] = fp->dudx * (uv->b[1] - uv->a[1]) + fp->dvdx * (uv->c[1] - uv->a[1]);
+		ds[1] = fp->dudy * (uv->b[0] - uv->a[0]) + fp->dvdy * (uv->c[0] - uv->a[0]);
+		dt[1] = fp->dudy * (uv->b[1] - uv->a[1]) + fp->dvdy * (uv->c[1] - uv->a[1]);
+		lod = T_Lod(tex, ds[0], dt[0], ds[1], dt[1]);
+	}
+
+	T_Sample(tex, s, t, lod, c);
+
+	out[0] = m->albedo[0] * c[0];
+	out[1] = m->albedo[1] * c[1];
+	out[2] = m->albedo[2] * c[2];
+}
+
+/* R_IntersectWide : slab tests every child of the node, returns the hit mask */
+u32 R_IntersectWide(struct ray_t *ray, struct bvhwide_t *node, f32 tmax, f32 *dist)
+{
+	widef_t ox, oy, oz, ix, iy, iz;
+	widef_t tnear, tfar;
+
+	ox = WideSet1(ray->origin[0]);
+	oy = WideSet1(ray->origin[1]);
+	oz = WideSet1(ray->origin[2]);
+	ix = WideSet1(ray->inv_dir[0]);
+	iy = WideSet1(ray->inv_dir[1]);
+	iz = WideSet1(ray->inv_dir[2]);
+
+	// the near and far planes were picked by the ray's direction signs
+	tnear = WideMul(WideSub(WideLoad(node->bounds[ray->near[0]]), ox), ix);
+	tnear = WideMax(tnear, WideMul(WideSub(WideLoad(node->bounds[ray->near[1]]), oy), iy));
+	tnear = WideMax(tnear, WideMul(WideSub(WideLoad(node->bounds[ray->near[2]]), oz), iz));
+	tnear = WideMax(tnear, WideSet1(0));
+
+	tfar = WideMul(WideSub(WideLoad(node->bounds[ray->far[0]]), ox), ix);
+	tfar = WideMin(tfar, WideMul(WideSub(WideLoad(node->bounds[ray->far[1]]), oy), iy));
+	tfar = WideMin(tfar, WideMul(WideSub(WideLoad(node->bounds[ray->far[2]]), oz), iz));
+	tfar = WideMin(WideMul(tfar, WideSet1(SLAB_ROBUST)), WideSet1(tmax));
+
+	WideStore(dist, tnear);
+
+	return WideMaskLE(tnear, tfar);
+}
+
+/* R_WideFromU8 : widens BVH_WIDTH bytes into floats */
+static inline widef_t R_WideFromU8(u8 *p)
+{
+#if BVH_WIDTH == 8 && defined(__AVX2__)
+	return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)p)));
+#elif BVH_WIDTH == 4 && defined(__SSE4_1__)
+	u32 bits;
+	memcpy(&bits, p, sizeof(bits));
+	return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bits)));
+#else
+	f32 f[BVH_WIDTH] __attribute__((aligned(32)));
+	s32 i;
+
+	for (i = 0; i < BVH_WIDTH; i++) {
+		f[i] = p[i];
+	}
+	return WideLoad(f);
+#endif
+}
+
+/* R_IntersectQuant : slab tests every child of the quantized node, returns the hit mask */
+u32 R_IntersectQuant(struct ray_t *ray, struct bvhquant_t *node, f32 tmax, f32 *dist)
+{
+	widef_t tnear, tfar, plane;
+	union { u32 u; f32 f; } step[3];
+	s32 j;
+
+	for (j = 0; j < 3; j++) { // exact powers of two, built straight from the bits
+		step[j].u = (u32)(node->exp[j] + 127) << 23;
+	}
+
+	// dequantize each plane exactly as the builder checked it: origin + q * step
+#define QUANT_PLANE(row, axis) \
+	(plane = WideAdd(WideSet1(node->origin[axis]), \
+		WideMul(R_WideFromU8(node->q[row]), WideSet1(step[axis].f))), \
+	 WideMul(WideSub(plane, WideSet1(ray->origin[axis])), WideSet1(ray->inv_dir[axis])))
+
+	tnear = QUANT_PLANE(ray->near[0], 0);
+	tnear = WideMax(tnear, QUANT_PLANE(ray->near[1], 1));
+	tnear = WideMax(tnear, QUANT_PLANE(ray->near[2], 2));
+	tnear = WideMax(tnear, WideSet1(0));
+
+	tfar = QUANT_PLANE(ray->far[0], 0);
+	tfar = WideMin(tfar, QUANT_PLANE(ray->far[1], 1));
+	tfar = WideMin(tfar, QUANT_PLANE(ray->far[2], 2));
+	tfar = WideMin(WideMul(tfar, WideSet1(SLAB_ROBUST)), WideSet1(tmax));
+
+#undef QUANT_PLANE
+
+	WideStore(dist, tnear);
+
+	return WideMaskLE(tnear, tfar);
+}
+
+/* R_IntersectAABB : slab test, returns the entry distance or FLT_MAX on a miss */
+f32 R_IntersectAABB(struct ray_t *ray, vecf3_t min, vecf3_t max, f32 tmax)
+{
+	f32 t0, t1, tmin;
+	s32 i;
+
+	tmin = 0;
 
-	// render the entire scene
-	rc = R_Main(world, framebuffer, w, h);
+	for (i = 0; i < 3; i++) {
+		t0 = (min[i] - ray->origin[i]) * ray->inv_dir[i];
+		t1 = (max[i] - ray->origin[i]) * ray->inv_dir[i];
 
-	// convert from floating point into our vec3ub
-	for (i = 0; i < w; i++) {
-		for (j = 0; j < h; j++) {
-			idx = IDX3D(i, j, 0, w, h);
-			img[idx + 0] = framebuffer[idx][0] * 255.0;
-			img[idx + 1] = framebuffer[idx][1] * 255.0;
-			img[idx + 2] = framebuffer[idx][2] * 255.0;
+		if (t0 > t1) {
+			SWAP(t0, t1);
 		}
-	}
 
-	rc = stbi_write_png("output.png", w, h, 3, img, 0);
-	if (!rc) {
-		fprintf(stderr, "Error, stbi_write_png failed\n");
-		exit(1);
+		tmin = MAX(tmin, t0);
+		tmax = MIN(tmax, t1 * SLAB_ROBUST);
 	}
 
-	free(img);
-	free(framebuffer);
-
-	return 0;
+	return tmin <= tmax ? tmin : FLT_MAX;
 }
 
-/* R_Main : rendering main function */
-int R_Main(struct world_t *world, vecf3_t *framebuffer, s32 w, s32 h)
+/* R_IntersectWatertight : watertight ray-triangle test, using the ray's shear */
+static inline int R_IntersectWatertight(vecf3_t tuv, struct triangle_t *tri, struct ray_t *ray, s32 cull)
 {
-	s32 i, j;
+	vecf3_t a, b, c;
+	f32 ax, ay, bx, by, cx, cy;
+	f32 u, v, w, det, t, inv_det;
+	u32 kx, ky, kz;
+
+	kx = ray->kx;
+	ky = ray->ky;
+	kz = ray->kz;
+
+	// move the triangle into the ray's space, where the ray is the +kz axis
+	Vec3Sub(a, tri->a, ray->origin);
+	Vec3Sub(b, tri->b, ray->origin);
+	Vec3Sub(c, tri->c, ray->origin);
+
+	ax = a[kx] - ray->sx * a[kz];
+	ay = a[ky] - ray->sy * a[kz];
+	bx = b[kx] - ray->sx * b[kz];
+	by = b[ky] - ray->sy * b[kz];
+	cx = c[kx] - ray->sx * c[kz];
+	cy = c[ky] - ray->sy * c[kz];
+
+	// scaled barycentrics, the edge functions of the sheared triangle
+	u = cx * by - cy * bx;
+	v = ax * cy - ay * cx;
+	w = bx * ay - by * ax;
+
+	// exactly on an edge, so redo it in double to get the sign right
+	if (u == 0 || v == 0 || w == 0) {
+		u = (f64)cx * by - (f64)cy * bx;
+		v = (f64)ax * cy - (f64)ay * cx;
+		w = (f64)bx * ay - (f64)by * ax;
+	}
 
-	vecf3_t camera_p, camera_x, camera_y, camera_z;
+	// inside a front face they're all positive, inside a back face all negative
+	if ((u < 0 || v < 0 || w < 0) && (cull || u > 0 || v > 0 || w > 0)) {
+		return 0;
+	}
+
+	det = u + v + w;
+	if (det == 0) {
+		return 0;
+	}
 
-	vecf3_t film_p, film_c;
-	f32 film_x, film_y, film_d;
-	f32 film_w, film_h;
-	f32 halffilm_w, halffilm_h;
+	inv_det = 1.0f / det;
 
-	vecf3_t color;
+	t = ray->sz * (u * a[kz] + v * b[kz] + w * c[kz]) * inv_det;
+	if (t < 0) {
+		return 0;
+	}
 
-	vecf3_t origin, dir;
-	vecf3_t tmp;
+	// u weighs vertex a, so b and c's weights are what R_IntersectTriangle calls u, v
+	tuv[0] = t;
+	tuv[1] = v * inv_det;
+	tuv[2] = w * inv_det;
 
-	// setup our camera position and coordinate system
-	Vec3(camera_p, 0, -10, 1);
+	return 1;
+}
 
-	Vec3Norm(camera_z, camera_p);
-	Vec3(tmp, 0, 0, 1);
-	Vec3Cross(camera_x, tmp, camera_z);
-	Vec3Norm(camera_x, camera_x);
-	Vec3Cross(camera_y, camera_x, camera_z);
-	Vec3Norm(camera_y, camera_y);
+/* R_IntersectWatertight4 : watertight test of up to four triangles, returns the hit mask */
+static inline u32 R_IntersectWatertight4(struct world_t *world, struct ray_t *ray, u32 *prims, s32 len, f32 *t, f32 *u, f32 *v, s32 cull)
+{
+	struct triangle_t *tri;
+	f32 p[9][4] __attribute__((aligned(16))); // a, b, c, each kx, ky, kz, per lane
+	f32x4_t sx, sy, zero;
+	f32x4_t ax, ay, bx, by, cx, cy;
+	f32x4_t eu, ev, ew, det, tt, inv_det, front, back;
+	vecf3_t cur;
+	u32 mask, edge;
+	s32 i, j;
 
-	film_d = 1.0f;
-	film_w = 1.0f;
-	film_h = 1.0f;
+	memset(p, 0, sizeof(p));
 
-	// alter film_w and film_h
-	if (w > h) {
-		film_h = film_w * ((f32)h / (f32)w);
-	} else if (h > w) {
-		film_w = film_h * ((f32)w / (f32)h);
+	for (i = 0; i < len; i++) {
+		tri = world->t + prims[i];
+		for (j = 0; j < 3; j++) {
+			p[j * 3 + 0][i] = (&tri->a)[j][ray->kx] - ray->origin[ray->kx];
+			p[j * 3 + 1][i] = (&tri->a)[j][ray->ky] - ray->origin[ray->ky];
+			p[j * 3 + 2][i] = (&tri->a)[j][ray->kz] - ray->origin[ray->kz];
+		}
 	}
 
-	halffilm_w = film_w / 2.0;
-	halffilm_h = film_h / 2.0;
-	Vec3Scale(tmp, camera_z, film_d);
-	Vec3Sub(film_c, camera_p, tmp);
+	sx = F4_Set1(ray->sx);
+	sy = F4_Set1(ray->sy);
+	zero = F4_Zero();
+
+	ax = F4_Sub(F4_Load(p[0]), F4_Mul(sx, F4_Load(p[2])));
+	ay = F4_Sub(F4_Load(p[1]), F4_Mul(sy, F4_Load(p[2])));
+	bx = F4_Sub(F4_Load(p[3]), F4_Mul(sx, F4_Load(p[5])));
+	by = F4_Sub(F4_Load(p[4]), F4_Mul(sy, F4_Load(p[5])));
+	cx = F4_Sub(F4_Load(p[6]), F4_Mul(sx, F4_Load(p[8])));
+	cy = F4_Sub(F4_Load(p[7]), F4_Mul(sy, F4_Load(p[8])));
+
+	eu = F4_Sub(F4_Mul(cx, by), F4_Mul(cy, bx));
+	ev = F4_Sub(F4_Mul(ax, cy), F4_Mul(ay, cx));
+	ew = F4_Sub(F4_Mul(bx, ay), F4_Mul(by, ax));
 
-	// copy the origin once because it's always the same
-	Vec3Copy(origin, camera_p);
+	det = F4_Add(F4_Add(eu, ev), ew);
+	tt = F4_Mul(F4_Set1(ray->sz), F4_Add(F4_Add(
+		F4_Mul(eu, F4_Load(p[2])),
+		F4_Mul(ev, F4_Load(p[5]))),
+		F4_Mul(ew, F4_Load(p[8]))));
 
-	for (j = 0; j < h; j++) {
-		film_y = -1.0f + 2.0f * ((f32)j / (f32)h);
+	front = F4_And(F4_And(F4_CmpGE(eu, zero), F4_CmpGE(ev, zero)), F4_CmpGE(ew, zero));
+	back = F4_And(F4_And(F4_CmpLE(eu, zero), F4_CmpLE(ev, zero)), F4_CmpLE(ew, zero));
 
-		for (i = 0; i < w; i++) {
+	inv_det = F4_Div(F4_Set1(1), det);
+	tt = F4_Mul(tt, inv_det);
 
-			film_x = -1.0f + 2.0f * ((f32)i / (f32)w);
+	mask = F4_Mask(cull ? front : F4_Or(front, back));
+	mask &= F4_Mask(F4_And(F4_CmpNE(det, zero), F4_CmpGE(tt, zero)));
 
-			Vec3Copy(film_p, film_c);
-			Vec3Scale(tmp, camera_x, (film_x * halffilm_w));
-			Vec3Add(film_p, film_p, tmp);
-			Vec3Scale(tmp, camera_y, (film_y * halffilm_h));
+	edge = F4_Mask(F4_Or(F4_Or(F4_CmpEQ(eu, zero), F4_CmpEQ(ev, zero)), F4_CmpEQ(ew, zero)));
 
-			Vec3Sub(dir, film_p, camera_p);
-			Vec3Norm(dir, dir);
+	F4_StoreU(t, tt);
+	F4_StoreU(u, F4_Mul(ev, inv_det));
+	F4_StoreU(v, F4_Mul(ew, inv_det));
 
-			R_RayCast(world, color, origin, dir);
+	mask &= (1 << len) - 1;
+	edge &= (1 << len) - 1;
 
-			framebuffer[i + j * w][0] = color[0];
-			framebuffer[i + j * w][1] = color[1];
-			framebuffer[i + j * w][2] = color[2];
+	// lanes sitting exactly on an edge go through the scalar test and its
+	// double precision fallback
+	for (; edge; edge &= edge - 1) {
+		i = __builtin_ctz(edge);
+		mask &= ~(1 << i);
+
+		if (R_IntersectWatertight(cur, world->t + prims[i], ray, cull)) {
+			t[i] = cur[0];
+			u[i] = cur[1];
+			v[i] = cur[2];
+			mask |= 1 << i;
 		}
 	}
 
-	return 0;
+	return mask;
 }
 
-/* R_RayCast : cast a ray into the world, returning the color vector */
-int R_RayCast(struct world_t *world, vecf3_t out, vecf3_t origin, vecf3_t dir)
+/* R_IntersectBaldwin : ray-triangle test through the triangle's precomputed transform */
+static inline int R_IntersectBaldwin(vecf3_t tuv, struct trixform_t *xf, struct ray_t *ray, s32 cull)
 {
-	size_t i;
-	struct triangle_t *t;
-	vecf3_t tuv; // literally the t, u, and v values from the intersection
+	vecf3_t p;
+	f32 dz, t, u, v;
+
+	// in the triangle's space the plane is z = 0, so only the z rows matter
+	// until we know where the ray crosses it
+	dz = Vec3Dot(xf->n, ray->dir);
+	if (cull ? dz >= 0 : dz == 0) { // back facing, parallel or degenerate
+		return 0;
+	}
 
-	Vec3(out, 0, 0, 0);
+	t = -(Vec3Dot(xf->n, ray->origin) + xf->n[3]) / dz;
+	if (t < 0) {
+		return 0;
+	}
 
-	for (i = 0; i < world->t_len; i++) {
-		t = world->t + i;
+	Vec3Scale(p, ray->dir, t);
+	Vec3Add(p, p, ray->origin);
 
-		if (R_IntersectTriangle(tuv, t, origin, dir)) {
-			Vec3(out, 1, 1, 1);
-		}
+	u = Vec3Dot(xf->u, p) + xf->u[3];
+	if (u < 0 || u > 1) {
+		return 0;
 	}
 
-	return 0;
+	v = Vec3Dot(xf->v, p) + xf->v[3];
+	if (v < 0 || u + v > 1) {
+		return 0;
+	}
+
+	Vec3(tuv, t, u, v);
+
+	return 1;
 }
 
 /* R_IntersectTriangle : determines if a ray intersects with a triangle */
-int R_IntersectTriangle(vecf3_t tuv, struct triangle_t *tri, vecf3_t origin, vecf3_t dir)
+static inline int R_IntersectTriangle(vecf3_t tuv, struct triangle_t *tri, vecf3_t origin, vecf3_t dir, s32 cull)
 {
 	vecf3_t edge1, edge2, tvec, pvec, qvec;
 	f32 det, inv_det, t, u, v;
@@ -241,13 +1573,19 @@ int R_IntersectTriangle(vecf3_t tuv, struct triangle_t *tri, vecf3_t origin, vec
 	// if determinant is near zero, ray lies in the plane of the triangle
 	det = Vec3Dot(edge1, pvec);
 
-	if (det < EPSILON) {
+	// back faces have a negative determinant, which culling throws out
+	if (cull ? det < EPSILON : fabsf(det) < EPSILON) {
 		return 0;
 	}
 
-	// NOTE (brian) I only have the triangle culling path
-	// calculate the distance from a to ray origin
-	Vec3Sub(tvec, origin, tri->a);
+	// calculate the distance from a to ray origin, for a back face flipped
+	// along with the determinant, so the bounds tests below work for both
+	if (det > 0) {
+		Vec3Sub(tvec, origin, tri->a);
+	} else {
+		Vec3Sub(tvec, tri->a, origin);
+		det = -det;
+	}
 
 	// calculate 'u' parameter and test bounds
 	u = Vec3Dot(tvec, pvec);
@@ -279,23 +1617,454 @@ int R_IntersectTriangle(vecf3_t tuv, struct triangle_t *tri, vecf3_t origin, vec
 	return 1;
 }
 
-/* A_WorldLoad : loads the entire world */
-void A_WorldLoad(struct world_t **world)
+/* A_WorldLoad : loads the entire world from the given model files, and their textures if not NULL, through a tile cache of texcache bytes if not 0 */
+void A_WorldLoad(struct world_t **world, char **names, u32 *flags, f32 *emission, char **textures, size_t texcache, s32 names_len)
 {
 	struct world_t *w;
+	struct model_t *model;
+	struct material_t *m;
+	vecf3_t albedo, glow;
+	u16 material;
+	size_t j;
+	s32 i;
 
 	if (world) {
 		w = calloc(1, sizeof(*w));
+		CAM_Default(&w->camera);
+
+		// without the memory for a cache every texture just stays in memory
+		if (texcache && T_CacheInit(&w->texcache, texcache) < 0) {
+			fprintf(stderr, "Error, couldn't allocate the texture cache\n");
+		}
+
+		Vec3(albedo, ALBEDO, ALBEDO, ALBEDO);
+		Vec3(glow, 0, 0, 0);
+		A_WorldAddMaterial(w, albedo, glow, NULL);
+
+		// one thread reads the models while the rest of the pool decodes the
+		// textures, the ones named on the command line starting right away
+#pragma omp parallel private(i, model, albedo, glow, material)
+#pragma omp single
+		{
+			for (i = 0; textures && i < names_len; i++) {
+				if (textures[i] && !(emission && emission[i] > 0)) {
+					A_WorldAddTexture(w, textures[i]);
+				}
+			}
+
+			for (i = 0; i < names_len; i++) {
+				// lights are pure emitters, they don't reflect anything
+				material = 0;
+				if (emission && emission[i] > 0) {
+					Vec3(albedo, 0, 0, 0);
+					Vec3(glow, emission[i], emission[i], emission[i]);
+					material = A_WorldAddMaterial(w, albedo, glow, NULL);
+				} else if (textures && textures[i]) {
+					Vec3(albedo, 1, 1, 1);
+					Vec3(glow, 0, 0, 0);
+					material = A_WorldAddMaterial(w, albedo, glow, A_WorldAddTexture(w, textures[i]));
+				}
+
+				model = A_LoadModel(names[i]);
+				A_WorldAddModel(w, model, flags ? flags[i] : 0, material);
+				A_FreeModel(model);
+			}
+		}
+
+		// which images couldn't be read is only known once they've all finished
+		for (j = 0; j < w->textures_len; j++) {
+			if (w->textures[j]->levels == 0) {
+				fprintf(stderr, "Error, couldn't load texture '%s', using the default material\n", w->texnames[j]);
+			}
+		}
+
+		for (j = 0; j < w->materials_len; j++) {
+			m = w->materials + j;
+			if (m->tex && m->tex->levels == 0) {
+				Vec3(m->albedo, ALBEDO, ALBEDO, ALBEDO);
+				m->tex = NULL;
+			}
+		}
 
 		*world = w;
 	}
 }
 
+/* A_WorldBuild : builds the acceleration structures over the loaded world */
+int A_WorldBuild(struct world_t *world)
+{
+	if (L_Build(&world->lights, world->t, world->mat, world->materials, world->t_len) < 0) {
+		return -1;
+	}
+
+	if (world->isect == ISECT_BALDWIN && A_WorldTransforms(world) < 0) {
+		return -1;
+	}
+
+	return BVH_Build(&world->bvh, world->t, world->t_len);
+}
+
+/* A_WorldUpdate : updates the normals, lights and acceleration structures after the triangles moved from prev */
+int A_WorldUpdate(struct world_t *world, struct triangle_t *prev)
+{
+	s64 i;
+
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < (s64)world->t_len; i++) {
+		A_TriangleNormals(world->t + i, world->vn + i, prev ? prev + i : NULL);
+	}
+
+	if (world->xf && A_WorldTransforms(world) < 0) {
+		return -1;
+	}
+
+	// the tree's boxes and cones, and each light's power, are built around
+	// where the lights were and the way they faced
+	if (L_Build(&world->lights, world->t, world->mat, world->materials, world->t_len) < 0) {
+		return -1;
+	}
+
+	return BVH_Update(&world->bvh, world->t, world->t_len);
+}
+
+/* A_WorldTransforms : precomputes every triangle's transform, for ISECT_BALDWIN */
+int A_WorldTransforms(struct world_t *world)
+{
+	s64 i;
+
+	free(world->xf);
+	world->xf = malloc(world->t_len * sizeof(*world->xf));
+
+	if (!world->xf && world->t_len) {
+		return -1;
+	}
+
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < (s64)world->t_len; i++) {
+		A_TriangleTransform(world->xf + i, world->t + i);
+	}
+
+	return 0;
+}
+
+/* A_TriangleTransform : computes the transform into the triangle's barycentric space */
+void A_TriangleTransform(struct trixform_t *xf, struct triangle_t *tri)
+{
+	vecf3_t e1, e2, n, ca, ba;
+	f32 inv, s;
+	s32 k, k1, k2;
+
+	Vec3Sub(e1, tri->b, tri->a);
+	Vec3Sub(e2, tri->c, tri->a);
+	Vec3Cross(n, e1, e2);
+	Vec3Cross(ca, tri->c, tri->a);
+	Vec3Cross(ba, tri->b, tri->a);
+
+	memset(xf, 0, sizeof(*xf));
+
+	// divide through by the normal's largest component, the axis we project
+	// along, and the other two axes' rows fall out of the edges
+	k = fabsf(n[0]) > fabsf(n[1]) ?
+		(fabsf(n[0]) > fabsf(n[2]) ? 0 : 2) :
+		(fabsf(n[1]) > fabsf(n[2]) ? 1 : 2);
+	k1 = (k + 1) % 3;
+	k2 = (k + 2) % 3;
+
+	if (n[k] == 0) { // degenerate, leave it so nothing ever hits it
+		return;
+	}
+
+	inv = 1.0f / n[k];
+
+	xf->u[k1] = e2[k2] * inv;
+	xf->u[k2] = -e2[k1] * inv;
+	xf->u[3] = ca[k] * inv;
+
+	xf->v[k1] = -e1[k2] * inv;
+	xf->v[k2] = e1[k1] * inv;
+	xf->v[3] = -ba[k] * inv;
+
+	// the plane row keeps the normal's sign, so front faces see it falling
+	s = fabsf(inv);
+	Vec3Scale(xf->n, n, s);
+	xf->n[3] = -Vec3Dot(n, tri->a) * s;
+}
+
+/* A_TriangleNormals : recomputes the face normal, and carries the vertex normals along from prev if not NULL */
+void A_TriangleNormals(struct triangle_t *tri, struct vnormal_t *vn, struct triangle_t *prev)
+{
+	vecf3_t from[3], to[3], e1, e2, n;
+	u32 *normals[3];
+	f32 x, y, z;
+	s32 j;
+
+	Vec3Sub(e1, tri->b, tri->a);
+	Vec3Sub(e2, tri->c, tri->a);
+	Vec3Cross(tri->n, e1, e2);
+	Vec3Norm(tri->n, tri->n);
+
+	if (!prev) {
+		return;
+	}
+
+	// the model's normals are gone by now, so each one keeps the angles it
+	// made with the face, exact as long as the triangle only turned
+	A_TriangleFrame(from, prev);
+	A_TriangleFrame(to, tri);
+
+	normals[0] = &vn->a;
+	normals[1] = &vn->b;
+	normals[2] = &vn->c;
+
+	for (j = 0; j < 3; j++) {
+		Vec3OctDecode(n, *normals[j]);
+
+		x = Vec3Dot(n, from[0]);
+		y = Vec3Dot(n, from[1]);
+		z = Vec3Dot(n, from[2]);
+
+		n[0] = x * to[0][0] + y * to[1][0] + z * to[2][0];
+		n[1] = x * to[0][1] + y * to[1][1] + z * to[2][1];
+		n[2] = x * to[0][2] + y * to[1][2] + z * to[2][2];
+
+		// a degenerate triangle on either end has no frame to carry it through
+		if (!(Vec3Dot(n, n) > 1e-6f)) {
+			Vec3Copy(n, tri->n);
+		}
+
+		Vec3Norm(n, n);
+		*normals[j] = Vec3OctEncode(n);
+	}
+}
+
+/* A_TriangleFrame : an orthonormal frame along the triangle's first edge and normal */
+void A_TriangleFrame(vecf3_t frame[3], struct triangle_t *tri)
+{
+	Vec3Sub(frame[0], tri->b, tri->a);
+	Vec3Norm(frame[0], frame[0]);
+	Vec3Copy(frame[2], tri->n);
+	Vec3Cross(frame[1], frame[2], frame[0]);
+}
+
+/* A_WorldAddModel : appends the model's faces to the world's triangles */
+void A_WorldAddModel(struct world_t *world, struct model_t *model, u32 flags, u16 material)
+{
+	struct mesh_t *mesh;
+	struct triangle_t *t;
+	struct vnormal_t *vn;
+	struct texcoord_t *uv;
+	vecf3_t e1, e2, n;
+	vecf2_t tc[3];
+	u32 normals[3];
+	s32 *remap;
+	size_t i;
+	s32 j, k;
+
+	if (!model) {
+		return;
+	}
+
+	// the model's own materials, unless it was given one, each added the first time a face uses it
+	remap = NULL;
+	if (material == 0 && model->len_mtls) {
+		remap = malloc(model->len_mtls * sizeof(*remap));
+		for (i = 0; i < model->len_mtls; i++) {
+			remap[i] = -1;
+		}
+	}
+
+	C_ArrayRealloc(&world->meshes, &world->meshes_cnt, &world->meshes_len, sizeof(*world->meshes));
+
+	mesh = world->meshes + world->meshes_len++;
+	mesh->first = world->t_len;
+	mesh->flags = flags;
+	mesh->material = material;
+	world->flags |= flags;
+
+	for (i = 0; i < model->len_indv; i++) {
+		for (j = 0; j < 3; j++) {
+			if (model->indv[i][j] < 0 || model->len_v <= model->indv[i][j]) {
+				break;
+			}
+		}
+
+		if (j < 3) { // skip faces that reference vertices we don't have
+			continue;
+		}
+
+		C_ArrayRealloc(&world->t, &world->t_cnt, &world->t_len, sizeof(*world->t));
+		C_ArrayRealloc(&world->mat, &world->mat_cnt, &world->mat_len, sizeof(*world->mat));
+		C_ArrayRealloc(&world->mesh, &world->mesh_cnt, &world->mesh_len, sizeof(*world->mesh));
+		world->mesh[world->mesh_len++] = mesh - world->meshes;
+
+		C_ArrayRealloc(&world->vn, &world->vn_cnt, &world->vn_len, sizeof(*world->vn));
+		C_ArrayRealloc(&world->uv, &world->uv_cnt, &world->uv_len, sizeof(*world->uv));
+
+		k = i < model->len_indm ? model->indm[i] : -1;
+		if (remap && 0 <= k && k < model->len_mtls) {
+			if (remap[k] < 0) {
+				remap[k] = A_WorldModelMaterial(world, model->mtls + k);
+			}
+			world->mat[world->mat_len++] = remap[k];
+		} else {
+			world->mat[world->mat_len++] = material;
+		}
+
+		t = world->t + world->t_len++;
+
+		Vec3Copy(t->a, model->v[model->indv[i][0]]);
+		Vec3Copy(t->b, model->v[model->indv[i][1]]);
+		Vec3Copy(t->c, model->v[model->indv[i][2]]);
+
+		Vec3Sub(e1, t->b, t->a);
+		Vec3Sub(e2, t->c, t->a);
+		Vec3Cross(t->n, e1, e2);
+		Vec3Norm(t->n, t->n);
+
+		// the face's own normal at any vertex the model didn't give a usable one,
+		// and one lying in the face's plane is just as useless
+		for (j = 0; j < 3; j++) {
+			k = i < model->len_indn ? model->indn[i][j] : -1;
+			Vec3Copy(n, t->n);
+
+			if (0 <= k && k < model->len_n && Vec3Dot(model->n[k], model->n[k]) > 0) {
+				Vec3Norm(e1, model->n[k]);
+				if (fabsf(Vec3Dot(e1, t->n)) >= 0.01f) {
+					Vec3Copy(n, e1);
+				}
+			}
+
+			normals[j] = Vec3OctEncode(n);
+		}
+
+		vn = world->vn + world->vn_len++;
+		vn->a = normals[0];
+		vn->b = normals[1];
+		vn->c = normals[2];
+
+		for (j = 0; j < 3; j++) {
+			k = i < model->len_indt ? model->indt[i][j] : -1;
+			tc[j][0] = 0 <= k && k < model->len_t ? model->t[k][0] : 0;
+			tc[j][1] = 0 <= k && k < model->len_t ? model->t[k][1] : 0;
+		}
+
+		uv = world->uv + world->uv_len++;
+		memcpy(uv->a, tc[0], sizeof(uv->a));
+		memcpy(uv->b, tc[1], sizeof(uv->b));
+		memcpy(uv->c, tc[2], sizeof(uv->c));
+	}
+
+	mesh->len = world->t_len - mesh->first;
+
+	free(remap);
+}
+
+/* A_WorldAddMaterial : appends a material, returns its index */
+u16 A_WorldAddMaterial(struct world_t *world, vecf3_t albedo, vecf3_t emission, struct texture_t *tex)
+{
+	struct material_t *m;
+
+	// u16 per triangle, so any more just share the default
+	if (world->materials_len > USHRT_MAX) {
+		return 0;
+	}
+
+	// every hit reads one, so they're kept aligned to cache lines
+	if (world->materials_len == world->materials_cnt) {
+		world->materials_cnt = world->materials_cnt ? world->materials_cnt * 2 : BUFSMALL;
+		m = C_AlignedAlloc(64, world->materials_cnt * sizeof(*m));
+		if (world->materials) {
+			memcpy(m, world->materials, world->materials_len * sizeof(*m));
+		}
+		C_AlignedFree(world->materials);
+		world->materials = m;
+	}
+
+	m = world->materials + world->materials_len;
+	Vec3Copy(m->albedo, albedo);
+	Vec3Copy(m->emission, emission);
+	m->tex = tex;
+
+	return world->materials_len++;
+}
+
+/* A_WorldModelMaterial : appends one of a model's .mtl materials, returns its index */
+u16 A_WorldModelMaterial(struct world_t *world, struct mtl_t *mtl)
+{
+	struct texture_t *tex;
+
+	tex = mtl->map_kd[0] ? A_WorldAddTexture(world, mtl->map_kd) : NULL;
+
+	return A_WorldAddMaterial(world, mtl->kd, mtl->ke, tex);
+}
+
+/* A_WorldAddTexture : the world's texture for the image, which starts loading on the pool the first time it's seen */
+struct texture_t *A_WorldAddTexture(struct world_t *world, char *name)
+{
+	struct texture_t *tex;
+	char *path;
+	size_t i;
+	u32 id;
+
+	for (i = 0; i < world->texnames_len; i++) {
+		if (strcmp(world->texnames[i], name) == 0) {
+			return world->textures[i];
+		}
+	}
+
+	C_ArrayRealloc(&world->textures, &world->textures_cnt, &world->textures_len, sizeof(*world->textures));
+	C_ArrayRealloc(&world->texnames, &world->texnames_cnt, &world->texnames_len, sizeof(*world->texnames));
+
+	tex = calloc(1, sizeof(*tex));
+	path = malloc(strlen(name) + 1);
+	strcpy(path, name);
+
+	id = world->textures_len;
+	world->textures[world->textures_len++] = tex;
+	world->texnames[world->texnames_len++] = path;
+
+	// a texture that couldn't be read is left with no levels
+#pragma omp task firstprivate(tex, path, id)
+	{
+		if (world->texcache.budget) {
+			if (T_Open(tex, path, &world->texcache, id) < 0) {
+				T_Free(tex);
+			}
+		} else {
+			if (T_Load(tex, path) < 0) {
+				T_Free(tex);
+			}
+		}
+	}
+
+	return tex;
+}
+
 /* A_WorldFree : frees the world */
 void A_WorldFree(struct world_t *world)
 {
+	size_t i;
+
 	if (world) {
+		BVH_Free(&world->bvh);
 		free(world->t);
+		free(world->xf);
+		free(world->meshes);
+		C_AlignedFree(world->materials);
+		free(world->mat);
+		free(world->mesh);
+		free(world->vn);
+		free(world->uv);
+		for (i = 0; i < world->textures_len; i++) {
+			T_Free(world->textures[i]);
+			free(world->textures[i]);
+			free(world->texnames[i]);
+		}
+		free(world->textures);
+		free(world->texnames);
+		T_CacheFree(&world->texcache);
+		L_Free(&world->lights);
+		S_Free(&world->sampler);
 		free(world);
 	}
 }
@@ -304,86 +2073,244 @@ void A_WorldFree(struct world_t *world)
 struct model_t *A_LoadModel(char *name)
 {
 	struct model_t *m;
-	char *words[16];
 	char *s;
 	FILE *fp;
-	char *cmd;
-	char buf[BUFSMALL];
-	s32 i;
+	char buf[BUFLARGE];
+	char path[BUFLARGE];
+	s32 mtl;
 
 	m = calloc(1, sizeof(struct model_t));
 	fp = fopen(name, "r");
 
 	if (m && fp) {
 		// init arrays and such
-		C_ArrayRealloc(m->v, &m->cap_v, &m->len_v, sizeof(*m->v));
-		C_ArrayRealloc(m->t, &m->cap_t, &m->len_t, sizeof(*m->t));
-		C_ArrayRealloc(m->n, &m->cap_n, &m->len_n, sizeof(*m->n));
-		C_ArrayRealloc(m->indv, &m->cap_indv, &m->len_indv, sizeof(*m->indv));
-		C_ArrayRealloc(m->indt, &m->cap_indn, &m->len_indn, sizeof(*m->indt));
-		C_ArrayRealloc(m->indn, &m->cap_indt, &m->len_indt, sizeof(*m->indn));
+		C_ArrayRealloc(&m->v, &m->cap_v, &m->len_v, sizeof(*m->v));
+		C_ArrayRealloc(&m->t, &m->cap_t, &m->len_t, sizeof(*m->t));
+		C_ArrayRealloc(&m->n, &m->cap_n, &m->len_n, sizeof(*m->n));
+		C_ArrayRealloc(&m->indv, &m->cap_indv, &m->len_indv, sizeof(*m->indv));
+		C_ArrayRealloc(&m->indt, &m->cap_indt, &m->len_indt, sizeof(*m->indt));
+		C_ArrayRealloc(&m->indn, &m->cap_indn, &m->len_indn, sizeof(*m->indn));
+		C_ArrayRealloc(&m->indm, &m->cap_indm, &m->len_indm, sizeof(*m->indm));
 
-		while (buf == fgets(buf, sizeof(buf), fp)) {
-			buf[strlen(buf) - 1] = 0;
+		mtl = -1;
 
-			if (strlen(buf) == 0 || buf[0] == '#') {
-				continue;
+		while (buf == fgets(buf, sizeof(buf), fp)) {
+			buf[strcspn(buf, "\r\n")] = 0;
+			s = buf + strspn(buf, " \t");
+
+			// every line's read in place, what it is is in its first two characters
+			if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+				m->v[m->len_v][0] = strtof(s + 1, &s);
+				m->v[m->len_v][1] = strtof(s, &s);
+				m->v[m->len_v][2] = strtof(s, &s);
+				m->len_v++;
+			} else if (s[0] == 'v' && s[1] == 't') {
+				m->t[m->len_t][0] = strtof(s + 2, &s);
+				m->t[m->len_t][1] = strtof(s, &s);
+				m->t[m->len_t][2] = strtof(s, &s); // w is optional, 0 without it
+				m->len_t++;
+			} else if (s[0] == 'v' && s[1] == 'n') {
+				m->n[m->len_n][0] = strtof(s + 2, &s);
+				m->n[m->len_n][1] = strtof(s, &s);
+				m->n[m->len_n][2] = strtof(s, &s);
+				m->len_n++;
+			} else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+				A_ParseFace(m, s + 1, mtl);
+			} else if (strncmp(s, "mtllib", 6) == 0 && (s[6] == ' ' || s[6] == '\t')) {
+				for (s = strtok(s + 6, " \t"); s; s = strtok(NULL, " \t")) {
+					A_Path(path, sizeof path, name, s);
+					A_LoadMaterials(m, path);
+				}
+			} else if (strncmp(s, "usemtl", 6) == 0 && (s[6] == ' ' || s[6] == '\t')) {
+				mtl = A_ModelMaterial(m, s + 6 + strspn(s + 6, " \t"));
 			}
 
-			// parse the line into space delimited words, up to # of words
-			for (i = 0, s = strtok(buf, " /"); s && i < ARRSIZE(words); i++, s = strtok(NULL, " /")) {
-				words[i] = s;
+			// realloc where needed
+			C_ArrayRealloc(&m->v, &m->cap_v, &m->len_v, sizeof(*m->v));
+			C_ArrayRealloc(&m->t, &m->cap_t, &m->len_t, sizeof(*m->t));
+			C_ArrayRealloc(&m->n, &m->cap_n, &m->len_n, sizeof(*m->n));
+		}
+
+		fclose(fp);
+	}
+
+	return m;
+}
+
+/* A_ParseFace : appends a face's triangles, fanned out from its first corner, each corner v, v/vt, v//vn or v/vt/vn */
+void A_ParseFace(struct model_t *model, char *s, s32 mtl)
+{
+	veci3_t first, prev, cur;
+	s32 corners;
+
+	for (corners = 0;; corners++) {
+		// the end of the line, or a comment
+		s += strspn(s, " \t");
+		if (!(('0' <= *s && *s <= '9') || *s == '-')) {
+			break;
+		}
+
+		// an index that isn't there stays -1, which A_WorldAddModel knows to skip
+		cur[0] = A_ParseIndex(&s, model->len_v);
+		cur[1] = -1;
+		cur[2] = -1;
+		if (*s == '/') {
+			s++;
+			cur[1] = A_ParseIndex(&s, model->len_t);
+			if (*s == '/') {
+				s++;
+				cur[2] = A_ParseIndex(&s, model->len_n);
 			}
+		}
 
-			cmd = words[0];
+		// anything else stuck to the corner isn't an index, skip past it
+		s += strcspn(s, " \t");
 
-			if (cmd[0] == 'v' && cmd[1] == '\0') {
-				m->v[m->len_v][0] = atof(words[1]);
-				m->v[m->len_v][1] = atof(words[2]);
-				m->v[m->len_v][2] = atof(words[3]);
-				m->len_v++;
-			} else if (cmd[0] == 'v' && cmd[1] == 't') {
-				m->t[m->len_t][0] = atof(words[1]);
-				m->t[m->len_t][1] = atof(words[2]);
-				m->t[m->len_t][2] = atof(words[3]);
-				m->len_t++;
-			} else if (cmd[0] == 'v' && cmd[1] == 'n') {
-				m->n[m->len_n][0] = atof(words[1]);
-				m->n[m->len_n][1] = atof(words[2]);
-				m->n[m->len_n][2] = atof(words[3]);
-				m->len_n++;
-			} else if (cmd[0] == 'f' && cmd[1] == '\0') {
-				// NOTE this case is special (nnn/nnn/nnn nnn/nnn/nnn nnn/nnn/nnn)
-				m->indv[m->len_indv][0] = atoi(words[1]) - 1;
-				m->indv[m->len_indv][1] = atoi(words[4]) - 1;
-				m->indv[m->len_indv][2] = atoi(words[7]) - 1;
+		if (corners == 0) {
+			memcpy(first, cur, sizeof(first));
+		} else if (corners >= 2) {
+			A_AddTriangle(model, first, prev, cur, mtl);
+		}
+
+		memcpy(prev, cur, sizeof(prev));
+	}
+}
+
+/* A_ParseIndex : reads a 1 based, or negative from the end of the len so far, index at *s, 0 based, -1 if there's none */
+s32 A_ParseIndex(char **s, size_t len)
+{
+	char *p;
+	s32 i, neg;
+
+	p = *s;
+	neg = *p == '-';
+	p += neg;
+
+	for (i = 0; '0' <= *p && *p <= '9'; p++) {
+		i = i * 10 + (*p - '0');
+	}
+
+	*s = p;
+
+	if (i == 0) {
+		return -1;
+	}
+
+	return neg ? (s32)len - i : i - 1;
+}
+
+/* A_AddTriangle : appends a triangle's vertex, texture coordinate and normal indices, and its material */
+void A_AddTriangle(struct model_t *model, veci3_t a, veci3_t b, veci3_t c, s32 mtl)
+{
+	model->indv[model->len_indv][0] = a[0];
+	model->indv[model->len_indv][1] = b[0];
+	model->indv[model->len_indv][2] = c[0];
+
+	model->indt[model->len_indt][0] = a[1];
+	model->indt[model->len_indt][1] = b[1];
+	model->indt[model->len_indt][2] = c[1];
+
+	model->indn[model->len_indn][0] = a[2];
+	model->indn[model->len_indn][1] = b[2];
+	model->indn[model->len_indn][2] = c[2];
+
+	model->indm[model->len_indm] = mtl;
+
+	model->len_indv++; // update the indicies
+	model->len_indt++;
+	model->len_indn++;
+	model->len_indm++;
+
+	C_ArrayRealloc(&model->indv, &model->cap_indv, &model->len_indv, sizeof(*model->indv));
+	C_ArrayRealloc(&model->indt, &model->cap_indt, &model->len_indt, sizeof(*model->indt));
+	C_ArrayRealloc(&model->indn, &model->cap_indn, &model->len_indn, sizeof(*model->indn));
+	C_ArrayRealloc(&model->indm, &model->cap_indm, &model->len_indm, sizeof(*model->indm));
+}
 
-				m->indt[m->len_indt][0] = atoi(words[2]) - 1;
-				m->indt[m->len_indt][1] = atoi(words[5]) - 1;
-				m->indt[m->len_indt][2] = atoi(words[8]) - 1;
+/* A_LoadMaterials : reads a .mtl library into the model's materials */
+void A_LoadMaterials(struct model_t *model, char *name)
+{
+	struct mtl_t *mtl;
+	FILE *fp;
+	char buf[BUFLARGE];
+	char *s, *last;
 
-				m->indn[m->len_indn][0] = atoi(words[3]) - 1;
-				m->indn[m->len_indn][1] = atoi(words[6]) - 1;
-				m->indn[m->len_indn][2] = atoi(words[9]) - 1;
+	fp = fopen(name, "r");
+	if (!fp) {
+		fprintf(stderr, "Error, couldn't open material library '%s'\n", name);
+		return;
+	}
 
-				m->len_indv++; // update the indicies
-				m->len_indt++;
-				m->len_indn++;
+	mtl = NULL;
+
+	while (buf == fgets(buf, sizeof(buf), fp)) {
+		buf[strcspn(buf, "\r\n")] = 0;
+		s = buf + strspn(buf, " \t");
+
+		if (strncmp(s, "newmtl ", 7) == 0) {
+			mtl = model->mtls + A_ModelMaterial(model, s + 7 + strspn(s + 7, " \t"));
+		} else if (!mtl) {
+			continue;
+		} else if (strncmp(s, "Kd ", 3) == 0) {
+			sscanf(s + 3, "%f %f %f", &mtl->kd[0], &mtl->kd[1], &mtl->kd[2]);
+		} else if (strncmp(s, "Ke ", 3) == 0) {
+			sscanf(s + 3, "%f %f %f", &mtl->ke[0], &mtl->ke[1], &mtl->ke[2]);
+		} else if (strncmp(s, "map_Kd ", 7) == 0) {
+			// options like -s or -o come first, the file's always last
+			last = NULL;
+			for (s = strtok(s + 7, " \t"); s; s = strtok(NULL, " \t")) {
+				last = s;
+			}
+			if (last) {
+				A_Path(mtl->map_kd, sizeof(mtl->map_kd), name, last);
 			}
+		}
+	}
 
-			// realloc where needed
-			C_ArrayRealloc(m->v, &m->cap_v, &m->len_v, sizeof(*m->v));
-			C_ArrayRealloc(m->t, &m->cap_t, &m->len_t, sizeof(*m->t));
-			C_ArrayRealloc(m->n, &m->cap_n, &m->len_n, sizeof(*m->n));
-			C_ArrayRealloc(m->indv, &m->cap_indv, &m->len_indv, sizeof(*m->indv));
-			C_ArrayRealloc(m->indt, &m->cap_indn, &m->len_indn, sizeof(*m->indt));
-			C_ArrayRealloc(m->indn, &m->cap_indt, &m->len_indt, sizeof(*m->indn));
+	fclose(fp);
+}
+
+/* A_ModelMaterial : the index of the model's material called name, added with the defaults if it's new */
+s32 A_ModelMaterial(struct model_t *model, char *name)
+{
+	struct mtl_t *mtl;
+	size_t i;
+
+	// usemtl can come before the library that defines it
+	for (i = 0; i < model->len_mtls; i++) {
+		if (strcmp(model->mtls[i].name, name) == 0) {
+			return i;
 		}
+	}
 
-		fclose(fp);
+	C_ArrayRealloc(&model->mtls, &model->cap_mtls, &model->len_mtls, sizeof(*model->mtls));
+
+	mtl = model->mtls + model->len_mtls;
+	memset(mtl, 0, sizeof(*mtl));
+	snprintf(mtl->name, sizeof(mtl->name), "%s", name);
+	Vec3(mtl->kd, ALBEDO, ALBEDO, ALBEDO);
+
+	return model->len_mtls++;
+}
+
+/* A_Path : name, relative to the directory of the file base, into out */
+void A_Path(char *out, size_t len, char *base, char *name)
+{
+	char *slash;
+	int dir;
+
+	slash = strrchr(base, '/');
+	if (strrchr(base, '\\') > slash) {
+		slash = strrchr(base, '\\');
 	}
 
-	return m;
+	// absolute paths, and files beside the working directory, stay as they are
+	if (!slash || name[0] == '/' || name[0] == '\\' || (name[0] && name[1] == ':')) {
+		snprintf(out, len, "%s", name);
+	} else {
+		dir = slash - base + 1;
+		snprintf(out, len, "%.*s%s", dir, base, name);
+	}
 }
 
 /* A_FreeModel : all resources related to the model */
@@ -396,6 +2323,8 @@ void A_FreeModel(struct model_t *model)
 		free(model->indv);
 		free(model->indt);
 		free(model->indn);
+		free(model->indm);
+		free(model->mtls);
 		free(model);
 	}
 }
@@ -0,0 +1,202 @@
+#ifndef BRAY_H
+#define BRAY_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Brian's Raytracer - types shared between the renderer and its modules
+ */
+
+#include "common.h"
+#include "math.h"
+#include "bvh.h"
+#include "camera.h"
+#include "light.h"
+#include "sampler.h"
+#include "texture.h"
+
+struct mtl_t { // a material from the model's .mtl libraries
+	char name[BUFSMALL];
+	vecf3_t kd;             // diffuse
+	vecf3_t ke;             // emitted
+	char map_kd[BUFLARGE];  // the diffuse texture, empty for none
+};
+
+struct model_t { // to read models in the wavefront format
+	vecf3_t *v;
+	vecf3_t *t;
+	vecf3_t *n;
+	veci3_t *indv;
+	veci3_t *indt;
+	veci3_t *indn;
+	size_t len_v;
+	size_t len_t;
+	size_t len_n;
+	size_t len_indv;
+	size_t len_indt;
+	size_t len_indn;
+	size_t cap_v;
+	size_t cap_t;
+	size_t cap_n;
+	size_t cap_indv;
+	size_t cap_indt;
+	size_t cap_indn;
+	s32 *indm;              // per face, into mtls, -1 before any usemtl
+	size_t len_indm;
+	size_t cap_indm;
+	struct mtl_t *mtls;
+	size_t len_mtls;
+	size_t cap_mtls;
+};
+
+struct triangle_t {
+	vecf3_t a, b, c;
+	vecf3_t n;
+};
+
+struct vnormal_t { // a triangle's vertex normals, each packed by Vec3OctEncode
+	u32 a, b, c;
+};
+
+struct texcoord_t { // a triangle's texture coordinates
+	vecf2_t a, b, c;
+};
+
+struct trixform_t { // maps world space onto the triangle's barycentric space
+	vecf4_t u;       // dot with (p, 1) gives the weight of b
+	vecf4_t v;       // the weight of c
+	vecf4_t n;       // the distance off the plane, scaled, negative in front
+};
+
+#define DEPTH_MAX (32) // the longest path, in bounces
+
+struct material_t { // 32 bytes, two to a cache line
+	vecf3_t albedo;   // diffuse reflectance
+	vecf3_t emission; // radiance leaving the front of the surface, or both sides on a -twosided mesh
+	struct texture_t *tex; // multiplies the albedo, NULL for none
+};
+
+enum { // per mesh flags
+	MESH_TWOSIDED = 1 << 0 // no back face culling, for leaves, cloth and such
+};
+
+struct mesh_t { // the world's triangles that came from one model
+	size_t first, len;
+	u32 flags; // MESH_*
+	u16 material;
+};
+
+enum { // which copy of the BVH rays traverse
+	LAYOUT_BINARY,
+	LAYOUT_WIDE,
+	LAYOUT_QUANT,
+	LAYOUT_TOTAL
+};
+
+enum { // what R_Main writes into the framebuffer
+	HEATMAP_NONE,  // color
+	HEATMAP_NODES, // nodes visited, triangles tested, as raw counts
+	HEATMAP_TRIS,  // the same, but the PNG shows the triangle tests
+	HEATMAP_TOTAL
+};
+
+enum { // ray-triangle test used by the traversal
+	ISECT_MT,             // Moeller-Trumbore
+	ISECT_WATERTIGHT,     // Woop, Benthin and Wald 2013, no cracks on shared edges
+	ISECT_WATERTIGHT_SIMD, // the same, four triangles of a leaf at a time
+	ISECT_BALDWIN,        // Baldwin and Weber 2016, a precomputed transform per triangle
+	ISECT_TOTAL
+};
+
+struct hit_t { // everything a ray found, for shading and the AOVs
+	f32 t, u, v;      // distance, and the barycentric weights of b and c
+	u32 prim;         // BVH_NONE on a miss
+	vecf3_t pos;
+	vecf3_t ng;       // geometric normal, facing back along the ray
+	vecf3_t ns;       // shading normal, the geometric one without vertex normals
+	u32 nodes, tris;  // traversal counters, for the heatmap
+};
+
+struct footprint_t { // how far the barycentric weights of b and c move per pixel, from the ray differentials
+	f32 dudx, dvdx;
+	f32 dudy, dvdy;
+};
+
+struct aov_t { // per pixel, what the first hits looked like, for the denoiser and compositing
+	vecf3_t *normal;  // geometric, facing the camera, averaged and renormalized, 0 for a miss
+	vecf3_t *shading; // the shading normal, the same way
+	vecf3_t *albedo;  // averaged
+	f32 *depth;       // the nearest hit's distance, 0 for a miss
+	u32 *prim;        // the first sample's triangle, BVH_NONE for a miss
+	vecf2_t *bary;    // the first sample's barycentric weights of b and c
+	f32 *variance;    // of the pixel's mean luminance, -1 with only one sample
+};
+
+struct world_t {
+	struct triangle_t *t;
+	size_t t_cnt, t_len;
+	struct trixform_t *xf; // per triangle, for ISECT_BALDWIN, else NULL
+	struct mesh_t *meshes;
+	size_t meshes_cnt, meshes_len;
+	struct material_t *materials; // 0 is the default, plain diffuse, 64 byte aligned
+	size_t materials_cnt, materials_len;
+	u16 *mat;                     // per triangle, into materials
+	size_t mat_cnt, mat_len;
+	u16 *mesh;                    // per triangle, into meshes
+	size_t mesh_cnt, mesh_len;
+	struct vnormal_t *vn;         // per triangle, the face normal where the model had none
+	size_t vn_cnt, vn_len;
+	struct texcoord_t *uv;        // per triangle, 0 where the model had none
+	size_t uv_cnt, uv_len;
+	struct texture_t **textures;  // each on its own, so materials can point at them while they load
+	size_t textures_cnt, textures_len;
+	char **texnames;              // the image each texture came from
+	size_t texnames_cnt, texnames_len;
+	struct texcache_t texcache;   // pages the textures' tiles in, if it has a budget
+	struct lights_t lights;       // the emissive triangles, for next event estimation
+	u32 flags; // every mesh's flags or'd together, picks the traversal kernels
+	struct camera_t camera;
+	struct bvh_t bvh;
+	s32 layout;
+	s32 heatmap;
+	s32 isect;
+	struct sampler_t sampler;
+	s32 spp;     // samples per pixel
+	s32 bounces; // diffuse bounces after the first hit
+	f32 rr[DEPTH_MAX]; // per bounce cap on russian roulette's survival odds, 1 is off
+	s32 stats;   // print per bounce ray counts and times
+};
+
+struct ray_t {
+	vecf3_t origin;
+	vecf3_t dir;
+	vecf3_t inv_dir; // 1 / dir, for the slab tests
+	u32 near[3];     // rows of bvhwide_t::bounds facing the ray, per axis
+	u32 far[3];
+	u32 kx, ky, kz;  // watertight test: axes permuted so dir[kz] is largest,
+	f32 sx, sy, sz;  // and the shear that lines the ray up with kz
+	u32 nodes;       // traversal counters, for the heatmap
+	u32 tris;
+};
+
+/* R_RayInit : sets up the ray, and everything precomputed from it */
+void R_RayInit(struct ray_t *ray, vecf3_t origin, vecf3_t dir);
+
+/* R_Traverse : finds the closest triangle nearer than tmax, returns its index */
+u32 R_Traverse(struct world_t *world, struct ray_t *ray, vecf3_t tuv, f32 tmax);
+
+/* R_Occluded : checks for any triangle nearer than tmax, for shadow rays */
+int R_Occluded(struct world_t *world, struct ray_t *ray, f32 tmax);
+
+/* R_ShadingNormal : the vertex normals interpolated at u, v, on the same side as the face normal */
+void R_ShadingNormal(struct world_t *world, u32 prim, f32 u, f32 v, vecf3_t out);
+
+/* R_Differentials : carries the ray differentials t along dir to the triangle, and finds the hit's footprint */
+void R_Differentials(struct world_t *world, u32 prim, f32 t, vecf3_t dir, struct raydiff_t *rd, struct footprint_t *fp);
+
+/* R_Albedo : the material's albedo at u, v, times its texture filtered over the footprint, or the finest level if NULL */
+void R_Albedo(struct world_t *world, u32 prim, f32 u, f32 v, struct footprint_t *fp, vecf3_t out);
+
+#endif // BRAY_H
+
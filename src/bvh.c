@@ -0,0 +1,1705 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Bounding Volume Hierarchy
+ *
+ * The main builder is a top-down binned SAH builder. With BVH_BUILD_SBVH it
+ * also considers spatial splits (Stich et al. 2009) wherever the best object
+ * split's children overlap, clipping the straddling triangle references into
+ * both children. Those duplicates, and the ones from the optional pre-split
+ * pass over the worst fitting triangles, come out of a shared budget of
+ * bvh_t::budget extra references per triangle. Leaves still point at the
+ * untouched triangles, only their boxes get tighter.
+ *
+ * The refit walks from
+ * every leaf up towards the root in parallel; each interior node keeps an
+ * arrival counter, and only the second child to arrive carries on upwards,
+ * so every node is merged exactly once, after both of its children are done.
+ *
+ * The collapse into the wide tree is greedy: starting from a node's two
+ * children, keep opening the interior child with the largest surface area
+ * until the wide node is full, then recurse into whatever interior children
+ * are left.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "common.h"
+#include "math.h"
+#include "bray.h"
+#include "bvh.h"
+
+struct bvhref_t { // a reference to a triangle, used while building
+	struct aabb_t box;
+	vecf3_t c;
+	u32 prim;
+};
+
+struct bvhbin_t {
+	struct aabb_t box;
+	u32 count;
+};
+
+struct bvhsplit_t { // the best split found for a node
+	f32 cost;           // left area * count + right area * count
+	s32 axis;           // -1 if there isn't one
+	s32 bin;            // the first bin on the right side
+	u32 lcount, rcount;
+	struct aabb_t lbox, rbox;
+};
+
+struct sbvh_t { // state shared by the whole spatial split build
+	struct bvh_t *bvh;
+	struct triangle_t *tris;
+	f32 root_area;
+	size_t refs_len;    // references in the tree so far, duplicates included
+	size_t refs_cap;    // the memory budget, in references
+};
+
+struct lbvh_t { // the Karras tree, before it gets flattened
+	u32 n;              // leaves, internal nodes are 0..n-2, leaves n-1..2n-2
+	u32 *left, *right;  // per internal node
+	u32 *parent;        // per node
+	u32 *visits;        // per internal node
+	u32 *count;         // triangles under each node
+	f32 *cost;          // SAH cost of each subtree
+	struct aabb_t *box; // per node
+	u64 *keys;          // sorted Morton codes
+	u32 *vals;          // the triangle each code belongs to
+};
+
+/* BVH_TriangleBox : computes the bounding box of a triangle */
+static void BVH_TriangleBox(struct aabb_t *box, struct triangle_t *t);
+
+/* BVH_Subdivide : recursively splits the references of a node */
+static void BVH_Subdivide(struct bvh_t *bvh, struct bvhref_t *refs, u32 node, u32 first, u32 count, s32 depth);
+
+/* BVH_SubdivideSpatial : like BVH_Subdivide, but may split references in two */
+static void BVH_SubdivideSpatial(struct sbvh_t *sb, struct bvhref_t *refs, u32 node, u32 count, s32 depth);
+
+/* BVH_MakeLeaf : turns the node into a leaf over the given references */
+static void BVH_MakeLeaf(struct bvh_t *bvh, u32 node, u32 first, u32 count);
+
+/* BVH_SpatialLeaf : turns the node into a leaf, appending its prims */
+static void BVH_SpatialLeaf(struct bvh_t *bvh, struct bvhref_t *refs, u32 node, u32 count);
+
+/* BVH_SplitCost : the SAH cost of the split, relative to its parent's box */
+static f32 BVH_SplitCost(struct bvhsplit_t *split, struct aabb_t *box);
+
+/* BVH_ObjectSplit : bins the centroids along each axis, for the cheapest split */
+static void BVH_ObjectSplit(struct bvhref_t *refs, u32 count, struct aabb_t *cbox, struct bvhsplit_t *split);
+
+/* BVH_ObjectPartition : partitions in place by the split, returns the left count */
+static u32 BVH_ObjectPartition(struct bvhref_t *refs, u32 count, struct aabb_t *cbox, struct bvhsplit_t *split);
+
+/* BVH_SpatialBin : which of the node's spatial bins the coordinate falls in */
+static s32 BVH_SpatialBin(f32 x, struct aabb_t *box, s32 axis, f32 scale);
+
+/* BVH_SpatialSplit : bins clipped references along each axis, for the cheapest split */
+static void BVH_SpatialSplit(struct triangle_t *tris, struct bvhref_t *refs, u32 count, struct aabb_t *box, struct bvhsplit_t *split);
+
+/* BVH_SplitRef : clips the reference's triangle against the plane, into two */
+static void BVH_SplitRef(struct triangle_t *tris, struct bvhref_t *ref, s32 axis, f32 plane, struct bvhref_t *l, struct bvhref_t *r);
+
+/* BVH_PreSplit : splits the triangles that fill their boxes worst, up front */
+static struct bvhref_t *BVH_PreSplit(struct triangle_t *tris, size_t len, size_t extra, size_t *refs_len);
+
+/* BVH_PreSplitRef : cuts the reference into pieces along its longest axis */
+static void BVH_PreSplitRef(struct triangle_t *tris, struct bvhref_t *ref, u32 pieces, struct bvhref_t *out);
+
+/* BVH_Alloc : (re)allocates the arrays for a tree over len references */
+static int BVH_Alloc(struct bvh_t *bvh, size_t len);
+
+/* BVH_BuildSAH : top-down binned SAH build, with or without spatial splits */
+static int BVH_BuildSAH(struct bvh_t *bvh, struct triangle_t *tris, size_t len);
+
+/* BVH_BuildLBVH : Morton code sorted, parallel build */
+static int BVH_BuildLBVH(struct bvh_t *bvh, struct triangle_t *tris, size_t len);
+
+/* BVH_RadixSort : sorts the 64-bit keys (and their values) in parallel */
+static void BVH_RadixSort(u64 *keys, u32 *vals, u64 *tkeys, u32 *tvals, s64 len, s32 bits);
+
+/* BVH_Morton : interleaves the bits of the 3 coordinates in [0, 1) */
+static u64 BVH_Morton(vecf3_t p, s32 bits);
+
+/* BVH_Delta : length of the common prefix of keys i and j, -1 if j is out of range */
+static s32 BVH_Delta(struct lbvh_t *k, s64 i, s64 j);
+
+/* BVH_KarrasNode : finds the range and the children of internal node i */
+static void BVH_KarrasNode(struct lbvh_t *k, s64 i);
+
+/* BVH_KarrasClimb : bottom-up pass from every leaf, optionally restructuring */
+static void BVH_KarrasClimb(struct lbvh_t *k, s32 restructure);
+
+/* BVH_KarrasMerge : recomputes an internal node from its children */
+static void BVH_KarrasMerge(struct lbvh_t *k, u32 node);
+
+/* BVH_Treelet : finds the optimal topology for the treelet at the root */
+static void BVH_Treelet(struct lbvh_t *k, u32 root);
+
+/* BVH_TreeletEmit : rebuilds the treelet's links from the partitions found */
+static void BVH_TreeletEmit(struct lbvh_t *k, u32 node, u32 mask, u32 *leaves, u32 *inner, s32 *inner_len, u8 *part);
+
+/* BVH_Build : builds the hierarchy over the triangles from scratch */
+int BVH_Build(struct bvh_t *bvh, struct triangle_t *tris, size_t len)
+{
+	int rc;
+
+	bvh->nodes_len = 0;
+	bvh->prims_len = 0;
+	bvh->leaves_len = 0;
+	bvh->tris_len = len;
+	bvh->cost = 0;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	if (BVH_Alloc(bvh, len) < 0) {
+		return -1;
+	}
+
+	switch (bvh->builder) {
+	case BVH_BUILD_LBVH:
+		rc = BVH_BuildLBVH(bvh, tris, len);
+		break;
+	default: // the spatial split builder is the SAH one, with a budget
+		rc = BVH_BuildSAH(bvh, tris, len);
+		break;
+	}
+
+	if (rc < 0) {
+		return -1;
+	}
+
+	bvh->cost = BVH_Cost(bvh);
+
+	if (BVH_Collapse(bvh) < 0) {
+		return -1;
+	}
+
+	return BVH_Quantize(bvh);
+}
+
+/* BVH_BuildSAH : top-down binned SAH build, with or without spatial splits */
+static int BVH_BuildSAH(struct bvh_t *bvh, struct triangle_t *tris, size_t len)
+{
+	struct sbvh_t sb;
+	struct bvhref_t *refs;
+	struct aabb_t box;
+	size_t refs_len, extra;
+	s64 i;
+
+	// the pre-split pass gets half of the budget when spatial splits want some
+	extra = (size_t)(len * MAX(bvh->budget, 0));
+
+	if (bvh->presplit && extra) {
+		refs = BVH_PreSplit(tris, len, bvh->builder == BVH_BUILD_SBVH ? extra / 2 : extra, &refs_len);
+	} else {
+		refs_len = len;
+		refs = malloc(len * sizeof(*refs));
+
+		if (refs) {
+#pragma omp parallel for schedule(static)
+			for (i = 0; i < (s64)len; i++) {
+				BVH_TriangleBox(&refs[i].box, tris + i);
+				Vec3Add(refs[i].c, refs[i].box.min, refs[i].box.max);
+				Vec3Scale(refs[i].c, refs[i].c, 0.5f);
+				refs[i].prim = i;
+			}
+		}
+	}
+
+	if (!refs) {
+		return -1;
+	}
+
+	bvh->nodes_len = 1;
+	bvh->parent[0] = BVH_NONE;
+
+	if (bvh->builder == BVH_BUILD_SBVH) {
+		sb.bvh = bvh;
+		sb.tris = tris;
+		sb.refs_len = refs_len;
+		sb.refs_cap = MAX(refs_len, len + extra);
+
+		if (BVH_Alloc(bvh, sb.refs_cap) < 0) {
+			free(refs);
+			return -1;
+		}
+
+		AABB_Empty(&box);
+		for (i = 0; i < (s64)refs_len; i++) {
+			AABB_Union(&box, &refs[i].box);
+		}
+		sb.root_area = AABB_Area(&box);
+
+		bvh->prims_len = 0;
+		BVH_SubdivideSpatial(&sb, refs, 0, refs_len, 0); // takes refs over
+
+		return 0;
+	}
+
+	if (BVH_Alloc(bvh, refs_len) < 0) {
+		free(refs);
+		return -1;
+	}
+
+	BVH_Subdivide(bvh, refs, 0, 0, refs_len, 0);
+
+	for (i = 0; i < (s64)refs_len; i++) {
+		bvh->prims[i] = refs[i].prim;
+	}
+	bvh->prims_len = refs_len;
+
+	free(refs);
+
+	return 0;
+}
+
+/* BVH_BuildLBVH : Morton code sorted, parallel build */
+static int BVH_BuildLBVH(struct bvh_t *bvh, struct triangle_t *tris, size_t len)
+{
+	struct lbvh_t k;
+	struct aabb_t cbox;
+	struct bvhnode_t *f;
+	vecf3_t c, scale;
+	u64 *tkeys;
+	u32 *tvals, *stack;
+	u32 sub[2 * BVH_MAXLEAF];
+	size_t stack_len, sub_len;
+	s32 bits, j;
+	u32 node, flat;
+	s64 i;
+	int rc;
+
+	memset(&k, 0, sizeof(k));
+	k.n = len;
+
+	k.keys = malloc(len * sizeof(*k.keys));
+	k.vals = malloc(len * sizeof(*k.vals));
+	tkeys = malloc(len * sizeof(*tkeys));
+	tvals = malloc(len * sizeof(*tvals));
+	k.left = malloc(len * sizeof(*k.left));
+	k.right = malloc(len * sizeof(*k.right));
+	k.visits = malloc(len * sizeof(*k.visits));
+	k.parent = malloc(2 * len * sizeof(*k.parent));
+	k.count = malloc(2 * len * sizeof(*k.count));
+	k.cost = malloc(2 * len * sizeof(*k.cost));
+	k.box = malloc(2 * len * sizeof(*k.box));
+	stack = malloc(2 * len * sizeof(*stack));
+
+	if (!k.keys || !k.vals || !tkeys || !tvals || !k.left || !k.right || !k.visits ||
+		!k.parent || !k.count || !k.cost || !k.box || !stack) {
+		rc = -1;
+		goto cleanup;
+	}
+
+	// leaf boxes go where the sorted leaves will be, once we know the order,
+	// so park them at the front of the array for now
+	AABB_Empty(&cbox);
+
+#pragma omp parallel private(c)
+	{
+		struct aabb_t local;
+
+		AABB_Empty(&local);
+
+#pragma omp for schedule(static)
+		for (i = 0; i < (s64)len; i++) {
+			BVH_TriangleBox(k.box + i, tris + i);
+			Vec3Add(c, k.box[i].min, k.box[i].max);
+			Vec3Scale(c, c, 0.5f);
+			AABB_Grow(&local, c);
+		}
+
+#pragma omp critical
+		AABB_Union(&cbox, &local);
+	}
+
+	for (j = 0; j < 3; j++) {
+		scale[j] = cbox.max[j] - cbox.min[j];
+		scale[j] = scale[j] > 0 ? 1.0f / scale[j] : 0;
+	}
+
+	bits = len <= BVH_MORTON30 ? 30 : 63;
+
+#pragma omp parallel for schedule(static) private(c, j)
+	for (i = 0; i < (s64)len; i++) {
+		Vec3Add(c, k.box[i].min, k.box[i].max);
+		for (j = 0; j < 3; j++) {
+			c[j] = (c[j] * 0.5f - cbox.min[j]) * scale[j];
+		}
+		k.keys[i] = BVH_Morton(c, bits);
+		k.vals[i] = i;
+	}
+
+	BVH_RadixSort(k.keys, k.vals, tkeys, tvals, len, bits);
+
+	// move the leaf boxes into their sorted slots, past the internal nodes
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < (s64)len; i++) {
+		BVH_TriangleBox(k.box + len - 1 + i, tris + k.vals[i]);
+		k.count[len - 1 + i] = 1;
+	}
+
+	// emit every internal node independently, then fit the boxes bottom-up
+	k.parent[0] = BVH_NONE;
+
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < (s64)len - 1; i++) {
+		BVH_KarrasNode(&k, i);
+	}
+
+	BVH_KarrasClimb(&k, 0);
+	for (j = 0; j < bvh->treelets; j++) {
+		BVH_KarrasClimb(&k, 1);
+	}
+
+	// flatten into our own layout, with the children next to each other
+	bvh->parent[0] = BVH_NONE;
+	bvh->nodes_len = 1;
+	bvh->prims_len = 0;
+
+	// (with a single triangle, node 0 is the leaf at n - 1 instead)
+	stack_len = 0;
+	stack[stack_len++] = 0; // karras node
+	stack[stack_len++] = 0; // flat node
+
+	while (stack_len) {
+		flat = stack[--stack_len];
+		node = stack[--stack_len];
+
+		f = bvh->nodes + flat;
+		Vec3Copy(f->min, k.box[node].min);
+		Vec3Copy(f->max, k.box[node].max);
+
+		if (node >= k.n - 1) {
+			f->left = bvh->prims_len;
+			f->count = 1;
+			bvh->prims[bvh->prims_len++] = k.vals[node - (k.n - 1)];
+			bvh->leaves[bvh->leaves_len++] = flat;
+			continue;
+		}
+
+		// small subtrees that are cheaper as a single leaf get collapsed
+		if (k.count[node] <= BVH_MAXLEAF &&
+			BVH_COST_ISECT * AABB_Area(k.box + node) * k.count[node] <= k.cost[node]) {
+			f->left = bvh->prims_len;
+			f->count = k.count[node];
+
+			sub_len = 0;
+			sub[sub_len++] = node;
+			while (sub_len) {
+				node = sub[--sub_len];
+				if (node >= k.n - 1) {
+					bvh->prims[bvh->prims_len++] = k.vals[node - (k.n - 1)];
+				} else {
+					sub[sub_len++] = k.left[node];
+					sub[sub_len++] = k.right[node];
+				}
+			}
+
+			bvh->leaves[bvh->leaves_len++] = flat;
+			continue;
+		}
+
+		f->left = bvh->nodes_len;
+		f->count = 0;
+		bvh->nodes_len += 2;
+
+		bvh->parent[f->left + 0] = flat;
+		bvh->parent[f->left + 1] = flat;
+
+		stack[stack_len++] = k.left[node];
+		stack[stack_len++] = f->left + 0;
+		stack[stack_len++] = k.right[node];
+		stack[stack_len++] = f->left + 1;
+	}
+
+	rc = 0;
+
+cleanup:
+	free(k.keys);
+	free(k.vals);
+	free(tkeys);
+	free(tvals);
+	free(k.left);
+	free(k.right);
+	free(k.visits);
+	free(k.parent);
+	free(k.count);
+	free(k.cost);
+	free(k.box);
+	free(stack);
+
+	return rc;
+}
+
+/* BVH_RadixSort : sorts the 64-bit keys (and their values) in parallel */
+static void BVH_RadixSort(u64 *keys, u32 *vals, u64 *tkeys, u32 *tvals, s64 len, s32 bits)
+{
+	size_t *hist;
+	s32 threads, shift;
+
+	threads = omp_get_max_threads();
+	hist = malloc(threads * 256 * sizeof(*hist));
+
+	// 8 bits a pass, each thread scatters its own chunk stably
+	for (shift = 0; shift < bits; shift += 8) {
+#pragma omp parallel
+		{
+			size_t *h, off, sum;
+			s64 i, lo, hi;
+			s32 t, nt, d;
+
+			t = omp_get_thread_num();
+			nt = omp_get_num_threads();
+			lo = len * t / nt;
+			hi = len * (t + 1) / nt;
+
+			h = hist + t * 256;
+			memset(h, 0, 256 * sizeof(*h));
+
+			for (i = lo; i < hi; i++) {
+				h[(keys[i] >> shift) & 0xff]++;
+			}
+
+#pragma omp barrier
+#pragma omp single
+			{
+				for (d = 0, off = 0; d < 256; d++) {
+					for (t = 0; t < nt; t++) {
+						sum = hist[t * 256 + d];
+						hist[t * 256 + d] = off;
+						off += sum;
+					}
+				}
+			}
+
+			for (i = lo; i < hi; i++) {
+				d = (keys[i] >> shift) & 0xff;
+				tkeys[h[d]] = keys[i];
+				tvals[h[d]] = vals[i];
+				h[d]++;
+			}
+		}
+
+		SWAP(keys, tkeys);
+		SWAP(vals, tvals);
+	}
+
+	// an odd number of passes leaves the result in the scratch arrays
+	if (((bits + 7) / 8) & 1) {
+		memcpy(tkeys, keys, len * sizeof(*keys));
+		memcpy(tvals, vals, len * sizeof(*vals));
+	}
+
+	free(hist);
+}
+
+/* BVH_Morton : interleaves the bits of the 3 coordinates in [0, 1) */
+static u64 BVH_Morton(vecf3_t p, s32 bits)
+{
+	u64 x[3];
+	f32 cells;
+	s32 i;
+
+	cells = bits == 30 ? 1024.0f : 2097152.0f;
+
+	for (i = 0; i < 3; i++) {
+		x[i] = (u64)MIN(MAX(p[i] * cells, 0.0f), cells - 1);
+
+		x[i] = (x[i] | x[i] << 32) & 0x1f00000000ffffULL;
+		x[i] = (x[i] | x[i] << 16) & 0x1f0000ff0000ffULL;
+		x[i] = (x[i] | x[i] << 8)  & 0x100f00f00f00f00fULL;
+		x[i] = (x[i] | x[i] << 4)  & 0x10c30c30c30c30c3ULL;
+		x[i] = (x[i] | x[i] << 2)  & 0x1249249249249249ULL;
+	}
+
+	return x[0] << 2 | x[1] << 1 | x[2];
+}
+
+/* BVH_Delta : length of the common prefix of keys i and j, -1 if j is out of range */
+static s32 BVH_Delta(struct lbvh_t *k, s64 i, s64 j)
+{
+	if (j < 0 || j >= k->n) {
+		return -1;
+	}
+
+	// duplicate codes fall back on the indicies, so every key is unique
+	if (k->keys[i] == k->keys[j]) {
+		return 64 + __builtin_clz((u32)(i ^ j));
+	}
+
+	return __builtin_clzll(k->keys[i] ^ k->keys[j]);
+}
+
+/* BVH_KarrasNode : finds the range and the children of internal node i */
+static void BVH_KarrasNode(struct lbvh_t *k, s64 i)
+{
+	s64 d, l, lmax, t, s, j, gamma, div;
+	s32 dmin, dnode;
+
+	// which way the range goes, and how far
+	d = BVH_Delta(k, i, i + 1) - BVH_Delta(k, i, i - 1) >= 0 ? 1 : -1;
+	dmin = BVH_Delta(k, i, i - d);
+
+	for (lmax = 2; BVH_Delta(k, i, i + lmax * d) > dmin; lmax *= 2)
+		;
+
+	for (l = 0, t = lmax / 2; t >= 1; t /= 2) {
+		if (BVH_Delta(k, i, i + (l + t) * d) > dmin) {
+			l += t;
+		}
+	}
+
+	j = i + l * d;
+	dnode = BVH_Delta(k, i, j);
+
+	// binary search for where the highest differing bit flips
+	for (s = 0, div = 2;; div *= 2) {
+		t = (l + div - 1) / div;
+		if (BVH_Delta(k, i, i + (s + t) * d) > dnode) {
+			s += t;
+		}
+		if (t <= 1) {
+			break;
+		}
+	}
+
+	gamma = i + s * d + MIN(d, 0);
+
+	k->left[i] = MIN(i, j) == gamma ? k->n - 1 + gamma : gamma;
+	k->right[i] = MAX(i, j) == gamma + 1 ? k->n - 1 + gamma + 1 : gamma + 1;
+
+	k->parent[k->left[i]] = i;
+	k->parent[k->right[i]] = i;
+}
+
+/* BVH_KarrasClimb : bottom-up pass from every leaf, optionally restructuring */
+static void BVH_KarrasClimb(struct lbvh_t *k, s32 restructure)
+{
+	u32 node, p;
+	s64 i;
+
+	if (k->n < 2) {
+		return;
+	}
+
+	memset(k->visits, 0, (k->n - 1) * sizeof(*k->visits));
+
+#pragma omp parallel for schedule(static) private(node, p)
+	for (i = 0; i < k->n; i++) {
+		node = k->n - 1 + i;
+		k->cost[node] = BVH_COST_ISECT * AABB_Area(k->box + node);
+
+		// only the second child to arrive goes on, with its whole subtree done
+		while ((p = k->parent[node]) != BVH_NONE) {
+			if (__atomic_fetch_add(k->visits + p, 1, __ATOMIC_ACQ_REL) == 0) {
+				break;
+			}
+
+			// the children may have been restructured, so refresh the cost first
+			BVH_KarrasMerge(k, p);
+			if (restructure && k->count[p] >= BVH_TREELET) {
+				BVH_Treelet(k, p);
+			}
+
+			node = p;
+		}
+	}
+}
+
+/* BVH_KarrasMerge : recomputes an internal node from its children */
+static void BVH_KarrasMerge(struct lbvh_t *k, u32 node)
+{
+	u32 l, r;
+
+	l = k->left[node];
+	r = k->right[node];
+
+	k->box[node] = k->box[l];
+	AABB_Union(k->box + node, k->box + r);
+	k->count[node] = k->count[l] + k->count[r];
+	k->cost[node] = BVH_COST_TRAV * AABB_Area(k->box + node) + k->cost[l] + k->cost[r];
+}
+
+/* BVH_Treelet : finds the optimal topology for the treelet at the root */
+static void BVH_Treelet(struct lbvh_t *k, u32 root)
+{
+	u32 leaves[BVH_TREELET], inner[BVH_TREELET - 1];
+	f32 area[1 << BVH_TREELET], copt[1 << BVH_TREELET];
+	u8 part[1 << BVH_TREELET];
+	struct aabb_t box;
+	f32 a, best_area, best_cost, c;
+	s32 leaves_len, inner_len, i, best;
+	u32 mask, full, sub, l;
+
+	leaves[0] = k->left[root];
+	leaves[1] = k->right[root];
+	leaves_len = 2;
+	inner[0] = root;
+	inner_len = 1;
+
+	// grow the treelet by opening up its biggest internal leaf
+	while (leaves_len < BVH_TREELET) {
+		best = -1;
+		best_area = -1;
+
+		for (i = 0; i < leaves_len; i++) {
+			if (leaves[i] >= k->n - 1) {
+				continue;
+			}
+
+			a = AABB_Area(k->box + leaves[i]);
+			if (a > best_area) {
+				best_area = a;
+				best = i;
+			}
+		}
+
+		if (best < 0) {
+			break;
+		}
+
+		l = leaves[best];
+		inner[inner_len++] = l;
+		leaves[best] = k->left[l];
+		leaves[leaves_len++] = k->right[l];
+	}
+
+	if (leaves_len < 3) {
+		return;
+	}
+
+	full = (1 << leaves_len) - 1;
+
+	// cheapest way to split every subset of the treelet's leaves, smallest first
+	for (mask = 1; mask <= full; mask++) {
+		i = __builtin_ctz(mask);
+
+		if ((mask & (mask - 1)) == 0) {
+			area[mask] = AABB_Area(k->box + leaves[i]);
+			copt[mask] = k->cost[leaves[i]];
+			continue;
+		}
+
+		box = k->box[leaves[i]];
+		for (sub = mask & (mask - 1); sub; sub &= sub - 1) {
+			AABB_Union(&box, k->box + leaves[__builtin_ctz(sub)]);
+		}
+		area[mask] = AABB_Area(&box);
+
+		// every split shows up twice, so keep the lowest leaf on one side
+		best_cost = FLT_MAX;
+		for (sub = (mask - 1) & mask; sub; sub = (sub - 1) & mask) {
+			if (!(sub & (1 << i))) {
+				continue;
+			}
+
+			c = copt[sub] + copt[mask ^ sub];
+			if (c < best_cost) {
+				best_cost = c;
+				part[mask] = sub;
+			}
+		}
+
+		copt[mask] = BVH_COST_TRAV * area[mask] + best_cost;
+	}
+
+	if (copt[full] >= k->cost[root]) {
+		return;
+	}
+
+	inner_len = 1; // the root stays where it is
+	BVH_TreeletEmit(k, root, full, leaves, inner, &inner_len, part);
+}
+
+/* BVH_TreeletEmit : rebuilds the treelet's links from the partitions found */
+static void BVH_TreeletEmit(struct lbvh_t *k, u32 node, u32 mask, u32 *leaves, u32 *inner, s32 *inner_len, u8 *part)
+{
+	u32 sides[2], child;
+	s32 i;
+
+	sides[0] = part[mask];
+	sides[1] = mask ^ part[mask];
+
+	for (i = 0; i < 2; i++) {
+		if ((sides[i] & (sides[i] - 1)) == 0) {
+			child = leaves[__builtin_ctz(sides[i])];
+		} else {
+			child = inner[(*inner_len)++];
+			BVH_TreeletEmit(k, child, sides[i], leaves, inner, inner_len, part);
+		}
+
+		if (i == 0) {
+			k->left[node] = child;
+		} else {
+			k->right[node] = child;
+		}
+
+		k->parent[child] = node;
+	}
+
+	BVH_KarrasMerge(k, node);
+}
+
+/* BVH_Alloc : (re)allocates the arrays for a tree over len references */
+static int BVH_Alloc(struct bvh_t *bvh, size_t len)
+{
+	size_t cap;
+
+	cap = 2 * len; // a binary tree with len leaves never has more nodes
+
+	if (bvh->nodes_cap < cap) {
+		bvh->nodes = realloc(bvh->nodes, cap * sizeof(*bvh->nodes));
+		bvh->parent = realloc(bvh->parent, cap * sizeof(*bvh->parent));
+		bvh->visits = realloc(bvh->visits, cap * sizeof(*bvh->visits));
+		bvh->leaves = realloc(bvh->leaves, cap * sizeof(*bvh->leaves));
+		bvh->prims = realloc(bvh->prims, cap * sizeof(*bvh->prims));
+		bvh->nodes_cap = cap;
+	}
+
+	if (!bvh->nodes || !bvh->parent || !bvh->visits || !bvh->leaves || !bvh->prims) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* BVH_Subdivide : recursively splits the references of a node */
+static void BVH_Subdivide(struct bvh_t *bvh, struct bvhref_t *refs, u32 node, u32 first, u32 count, s32 depth)
+{
+	struct bvhsplit_t split;
+	struct aabb_t box, cbox;
+	u32 i, l;
+
+	AABB_Empty(&box);
+	AABB_Empty(&cbox);
+	for (i = first; i < first + count; i++) {
+		AABB_Union(&box, &refs[i].box);
+		AABB_Grow(&cbox, refs[i].c);
+	}
+
+	Vec3Copy(bvh->nodes[node].min, box.min);
+	Vec3Copy(bvh->nodes[node].max, box.max);
+
+	if (count == 1) {
+		BVH_MakeLeaf(bvh, node, first, count);
+		return;
+	}
+
+	BVH_ObjectSplit(refs + first, count, &cbox, &split);
+
+	if (count <= BVH_MAXLEAF && count * BVH_COST_ISECT <= BVH_SplitCost(&split, &box)) {
+		BVH_MakeLeaf(bvh, node, first, count);
+		return;
+	}
+
+	// fall back to a median split on degenerate input, or once the tree gets
+	// deep enough to threaten the traversal stack
+	l = count / 2;
+
+	if (split.axis >= 0 && depth < BVH_MAXDEPTH) {
+		i = BVH_ObjectPartition(refs + first, count, &cbox, &split);
+		if (0 < i && i < count) {
+			l = i;
+		}
+	}
+
+	i = bvh->nodes_len;
+	bvh->nodes_len += 2;
+
+	bvh->nodes[node].left = i;
+	bvh->nodes[node].count = 0;
+	bvh->parent[i + 0] = node;
+	bvh->parent[i + 1] = node;
+
+	BVH_Subdivide(bvh, refs, i + 0, first, l, depth + 1);
+	BVH_Subdivide(bvh, refs, i + 1, first + l, count - l, depth + 1);
+}
+
+/* BVH_SubdivideSpatial : like BVH_Subdivide, but may split references in two */
+static void BVH_SubdivideSpatial(struct sbvh_t *sb, struct bvhref_t *refs, u32 node, u32 count, s32 depth)
+{
+	struct bvh_t *bvh;
+	struct bvhsplit_t split, spatial;
+	struct bvhref_t *lrefs, *rrefs, l, r;
+	struct aabb_t box, cbox, overlap;
+	f32 plane, scale;
+	u32 i, lcount, rcount, dups;
+	s32 b0, b1;
+
+	bvh = sb->bvh;
+
+	AABB_Empty(&box);
+	AABB_Empty(&cbox);
+	for (i = 0; i < count; i++) {
+		AABB_Union(&box, &refs[i].box);
+		AABB_Grow(&cbox, refs[i].c);
+	}
+
+	Vec3Copy(bvh->nodes[node].min, box.min);
+	Vec3Copy(bvh->nodes[node].max, box.max);
+
+	if (count == 1) {
+		BVH_SpatialLeaf(bvh, refs, node, count);
+		return;
+	}
+
+	BVH_ObjectSplit(refs, count, &cbox, &split);
+
+	// only bother with spatial splits where the object split's children overlap
+	spatial.axis = -1;
+
+	if (split.axis >= 0 && depth < BVH_MAXDEPTH && sb->refs_len < sb->refs_cap) {
+		overlap = split.lbox;
+		for (i = 0; i < 3; i++) {
+			overlap.min[i] = MAX(overlap.min[i], split.rbox.min[i]);
+			overlap.max[i] = MIN(overlap.max[i], split.rbox.max[i]);
+		}
+
+		if (overlap.min[0] <= overlap.max[0] && overlap.min[1] <= overlap.max[1] &&
+			overlap.min[2] <= overlap.max[2] && AABB_Area(&overlap) > BVH_SBVH_ALPHA * sb->root_area) {
+			BVH_SpatialSplit(sb->tris, refs, count, &box, &spatial);
+
+			dups = spatial.lcount + spatial.rcount - count;
+			if (spatial.axis >= 0 && (spatial.cost >= split.cost || sb->refs_len + dups > sb->refs_cap)) {
+				spatial.axis = -1;
+			}
+		}
+	}
+
+	if (spatial.axis < 0 && count <= BVH_MAXLEAF && count * BVH_COST_ISECT <= BVH_SplitCost(&split, &box)) {
+		BVH_SpatialLeaf(bvh, refs, node, count);
+		return;
+	}
+
+	lrefs = malloc(count * sizeof(*lrefs));
+	rrefs = malloc(count * sizeof(*rrefs));
+
+	if (spatial.axis >= 0) {
+		// straddling references get clipped into both children
+		scale = BVH_BINS / (box.max[spatial.axis] - box.min[spatial.axis]);
+		plane = box.min[spatial.axis] + spatial.bin / scale;
+
+		for (i = 0, lcount = 0, rcount = 0; i < count; i++) {
+			b0 = BVH_SpatialBin(refs[i].box.min[spatial.axis], &box, spatial.axis, scale);
+			b1 = BVH_SpatialBin(refs[i].box.max[spatial.axis], &box, spatial.axis, scale);
+
+			if (b1 < spatial.bin) {
+				lrefs[lcount++] = refs[i];
+			} else if (b0 >= spatial.bin) {
+				rrefs[rcount++] = refs[i];
+			} else {
+				BVH_SplitRef(sb->tris, refs + i, spatial.axis, plane, &l, &r);
+				lrefs[lcount++] = l;
+				rrefs[rcount++] = r;
+			}
+		}
+
+		sb->refs_len += lcount + rcount - count;
+	} else {
+		lcount = count / 2;
+
+		if (split.axis >= 0 && depth < BVH_MAXDEPTH) {
+			i = BVH_ObjectPartition(refs, count, &cbox, &split);
+			if (0 < i && i < count) {
+				lcount = i;
+			}
+		}
+
+		rcount = count - lcount;
+		memcpy(lrefs, refs, lcount * sizeof(*refs));
+		memcpy(rrefs, refs + lcount, rcount * sizeof(*refs));
+	}
+
+	free(refs);
+
+	i = bvh->nodes_len;
+	bvh->nodes_len += 2;
+
+	bvh->nodes[node].left = i;
+	bvh->nodes[node].count = 0;
+	bvh->parent[i + 0] = node;
+	bvh->parent[i + 1] = node;
+
+	BVH_SubdivideSpatial(sb, lrefs, i + 0, lcount, depth + 1);
+	BVH_SubdivideSpatial(sb, rrefs, i + 1, rcount, depth + 1);
+}
+
+/* BVH_SpatialLeaf : turns the node into a leaf, appending its prims */
+static void BVH_SpatialLeaf(struct bvh_t *bvh, struct bvhref_t *refs, u32 node, u32 count)
+{
+	u32 i;
+
+	for (i = 0; i < count; i++) {
+		bvh->prims[bvh->prims_len + i] = refs[i].prim;
+	}
+
+	BVH_MakeLeaf(bvh, node, bvh->prims_len, count);
+	bvh->prims_len += count;
+
+	free(refs);
+}
+
+/* BVH_SplitCost : the SAH cost of the split, relative to its parent's box */
+static f32 BVH_SplitCost(struct bvhsplit_t *split, struct aabb_t *box)
+{
+	f32 area;
+
+	area = AABB_Area(box);
+	if (split->axis < 0 || area <= 0) {
+		return FLT_MAX;
+	}
+
+	return BVH_COST_TRAV + BVH_COST_ISECT * split->cost / area;
+}
+
+/* BVH_ObjectSplit : bins the centroids along each axis, for the cheapest split */
+static void BVH_ObjectSplit(struct bvhref_t *refs, u32 count, struct aabb_t *cbox, struct bvhsplit_t *split)
+{
+	struct bvhbin_t bins[BVH_BINS];
+	struct aabb_t lboxes[BVH_BINS], rbox;
+	u32 lcounts[BVH_BINS];
+	f32 cost, scale;
+	s32 axis, b;
+	u32 i, j;
+
+	split->cost = FLT_MAX;
+	split->axis = -1;
+
+	for (axis = 0; axis < 3; axis++) {
+		if (cbox->max[axis] - cbox->min[axis] <= 0) {
+			continue;
+		}
+
+		scale = BVH_BINS / (cbox->max[axis] - cbox->min[axis]);
+
+		for (b = 0; b < BVH_BINS; b++) {
+			AABB_Empty(&bins[b].box);
+			bins[b].count = 0;
+		}
+
+		for (i = 0; i < count; i++) {
+			b = MIN(BVH_BINS - 1, (s32)((refs[i].c[axis] - cbox->min[axis]) * scale));
+			AABB_Union(&bins[b].box, &refs[i].box);
+			bins[b].count++;
+		}
+
+		for (b = 0, j = 0; b < BVH_BINS - 1; b++) {
+			lboxes[b] = b ? lboxes[b - 1] : bins[b].box;
+			AABB_Union(lboxes + b, &bins[b].box);
+			j += bins[b].count;
+			lcounts[b] = j;
+		}
+
+		AABB_Empty(&rbox);
+		for (b = BVH_BINS - 1, j = 0; b > 0; b--) {
+			AABB_Union(&rbox, &bins[b].box);
+			j += bins[b].count;
+
+			if (lcounts[b - 1] == 0 || j == 0) {
+				continue;
+			}
+
+			cost = AABB_Area(lboxes + b - 1) * lcounts[b - 1] + AABB_Area(&rbox) * j;
+			if (cost < split->cost) {
+				split->cost = cost;
+				split->axis = axis;
+				split->bin = b;
+				split->lcount = lcounts[b - 1];
+				split->rcount = j;
+				split->lbox = lboxes[b - 1];
+				split->rbox = rbox;
+			}
+		}
+	}
+}
+
+/* BVH_ObjectPartition : partitions in place by the split, returns the left count */
+static u32 BVH_ObjectPartition(struct bvhref_t *refs, u32 count, struct aabb_t *cbox, struct bvhsplit_t *split)
+{
+	f32 scale;
+	u32 i, j;
+	s32 b;
+
+	scale = BVH_BINS / (cbox->max[split->axis] - cbox->min[split->axis]);
+
+	for (i = 0, j = count; i < j;) {
+		b = MIN(BVH_BINS - 1, (s32)((refs[i].c[split->axis] - cbox->min[split->axis]) * scale));
+		if (b < split->bin) {
+			i++;
+		} else {
+			SWAP(refs[i], refs[j - 1]);
+			j--;
+		}
+	}
+
+	return i;
+}
+
+/* BVH_SpatialBin : which of the node's spatial bins the coordinate falls in */
+static s32 BVH_SpatialBin(f32 x, struct aabb_t *box, s32 axis, f32 scale)
+{
+	return MAX(0, MIN(BVH_BINS - 1, (s32)((x - box->min[axis]) * scale)));
+}
+
+/* BVH_SpatialSplit : bins clipped references along each axis, for the cheapest split */
+static void BVH_SpatialSplit(struct triangle_t *tris, struct bvhref_t *refs, u32 count, struct aabb_t *box, struct bvhsplit_t *split)
+{
+	struct aabb_t bins[BVH_BINS], lboxes[BVH_BINS], rbox;
+	u32 enter[BVH_BINS], leave[BVH_BINS], lcounts[BVH_BINS];
+	struct bvhref_t cur, l, r;
+	f32 cost, scale;
+	s32 axis, b, b0, b1;
+	u32 i, j;
+
+	split->cost = FLT_MAX;
+	split->axis = -1;
+
+	for (axis = 0; axis < 3; axis++) {
+		if (box->max[axis] - box->min[axis] <= 0) {
+			continue;
+		}
+
+		scale = BVH_BINS / (box->max[axis] - box->min[axis]);
+
+		for (b = 0; b < BVH_BINS; b++) {
+			AABB_Empty(bins + b);
+			enter[b] = 0;
+			leave[b] = 0;
+		}
+
+		// chop every reference up at the bin boundaries it crosses
+		for (i = 0; i < count; i++) {
+			b0 = BVH_SpatialBin(refs[i].box.min[axis], box, axis, scale);
+			b1 = BVH_SpatialBin(refs[i].box.max[axis], box, axis, scale);
+
+			cur = refs[i];
+			for (b = b0; b < b1; b++) {
+				BVH_SplitRef(tris, &cur, axis, box->min[axis] + (b + 1) / scale, &l, &r);
+				AABB_Union(bins + b, &l.box);
+				cur = r;
+			}
+			AABB_Union(bins + b1, &cur.box);
+
+			enter[b0]++;
+			leave[b1]++;
+		}
+
+		for (b = 0, j = 0; b < BVH_BINS - 1; b++) {
+			lboxes[b] = b ? lboxes[b - 1] : bins[b];
+			AABB_Union(lboxes + b, bins + b);
+			j += enter[b];
+			lcounts[b] = j;
+		}
+
+		AABB_Empty(&rbox);
+		for (b = BVH_BINS - 1, j = 0; b > 0; b--) {
+			AABB_Union(&rbox, bins + b);
+			j += leave[b];
+
+			// splits that don't get rid of anything on one side go nowhere
+			if (lcounts[b - 1] == 0 || j == 0 || lcounts[b - 1] == count || j == count) {
+				continue;
+			}
+
+			cost = AABB_Area(lboxes + b - 1) * lcounts[b - 1] + AABB_Area(&rbox) * j;
+			if (cost < split->cost) {
+				split->cost = cost;
+				split->axis = axis;
+				split->bin = b;
+				split->lcount = lcounts[b - 1];
+				split->rcount = j;
+				split->lbox = lboxes[b - 1];
+				split->rbox = rbox;
+			}
+		}
+	}
+}
+
+/* BVH_SplitRef : clips the reference's triangle against the plane, into two */
+static void BVH_SplitRef(struct triangle_t *tris, struct bvhref_t *ref, s32 axis, f32 plane, struct bvhref_t *l, struct bvhref_t *r)
+{
+	f32 *v[3], *p, *q;
+	vecf3_t x;
+	f32 t;
+	s32 i, j;
+
+	v[0] = tris[ref->prim].a;
+	v[1] = tris[ref->prim].b;
+	v[2] = tris[ref->prim].c;
+
+	AABB_Empty(&l->box);
+	AABB_Empty(&r->box);
+
+	// walk the edges, putting each vertex and every plane crossing on its side
+	for (i = 0; i < 3; i++) {
+		p = v[i];
+		q = v[(i + 1) % 3];
+
+		if (p[axis] <= plane) {
+			AABB_Grow(&l->box, p);
+		}
+		if (p[axis] >= plane) {
+			AABB_Grow(&r->box, p);
+		}
+
+		if ((p[axis] < plane && plane < q[axis]) || (q[axis] < plane && plane < p[axis])) {
+			t = (plane - p[axis]) / (q[axis] - p[axis]);
+			for (j = 0; j < 3; j++) {
+				x[j] = p[j] + (q[j] - p[j]) * t;
+			}
+			x[axis] = plane;
+			AABB_Grow(&l->box, x);
+			AABB_Grow(&r->box, x);
+		}
+	}
+
+	// the reference may have already been clipped, so stay inside of it
+	for (i = 0; i < 3; i++) {
+		l->box.min[i] = MAX(l->box.min[i], ref->box.min[i]);
+		l->box.max[i] = MIN(l->box.max[i], ref->box.max[i]);
+		r->box.min[i] = MAX(r->box.min[i], ref->box.min[i]);
+		r->box.max[i] = MIN(r->box.max[i], ref->box.max[i]);
+	}
+	l->box.max[axis] = MIN(l->box.max[axis], plane);
+	r->box.min[axis] = MAX(r->box.min[axis], plane);
+
+	// rounding can leave an empty side, which then just becomes the plane
+	for (i = 0; i < 3; i++) {
+		if (l->box.min[i] > l->box.max[i]) {
+			l->box.min[i] = l->box.max[i] = i == axis ? plane : ref->box.min[i];
+		}
+		if (r->box.min[i] > r->box.max[i]) {
+			r->box.min[i] = r->box.max[i] = i == axis ? plane : ref->box.max[i];
+		}
+	}
+
+	l->prim = ref->prim;
+	r->prim = ref->prim;
+
+	Vec3Add(l->c, l->box.min, l->box.max);
+	Vec3Scale(l->c, l->c, 0.5f);
+	Vec3Add(r->c, r->box.min, r->box.max);
+	Vec3Scale(r->c, r->c, 0.5f);
+}
+
+/* BVH_PreSplit : splits the triangles that fill their boxes worst, up front */
+static struct bvhref_t *BVH_PreSplit(struct triangle_t *tris, size_t len, size_t extra, size_t *refs_len)
+{
+	struct bvhref_t *refs, ref;
+	struct aabb_t box;
+	vecf3_t e1, e2, n;
+	f32 *prio, total, lo, hi, beta;
+	u32 *splits;
+	size_t *offs, used;
+	s64 i;
+	s32 k;
+
+	prio = malloc(len * sizeof(*prio));
+	splits = malloc(len * sizeof(*splits));
+	offs = malloc((len + 1) * sizeof(*offs));
+
+	if (!prio || !splits || !offs) {
+		free(prio);
+		free(splits);
+		free(offs);
+		return NULL;
+	}
+
+	// a triangle's priority is how much more area its box has than it needs,
+	// and it gets floor(beta * priority) splits, with beta found by bisection
+	// so that the splits just about use up the budget
+	total = 0;
+
+#pragma omp parallel for schedule(static) private(box, e1, e2, n) reduction(+:total)
+	for (i = 0; i < (s64)len; i++) {
+		BVH_TriangleBox(&box, tris + i);
+		Vec3Sub(e1, tris[i].b, tris[i].a);
+		Vec3Sub(e2, tris[i].c, tris[i].a);
+		Vec3Cross(n, e1, e2);
+
+		// AABB_Area is the half area, which is what an axis aligned
+		// right triangle of the same area would have
+		prio[i] = AABB_Area(&box) - sqrtf(Vec3Dot(n, n));
+		prio[i] = prio[i] > 0 ? sqrtf(prio[i]) : 0;
+		total += prio[i];
+	}
+
+	lo = 0;
+	hi = total > 0 ? 2 * extra / total : 0;
+
+	for (k = 0; k < 24 && hi > 0; k++) {
+		beta = (lo + hi) * 0.5f;
+		used = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:used)
+		for (i = 0; i < (s64)len; i++) {
+			used += (size_t)(beta * prio[i]);
+		}
+
+		if (used > extra) {
+			hi = beta;
+		} else {
+			lo = beta;
+		}
+	}
+
+	offs[0] = 0;
+	for (i = 0; i < (s64)len; i++) {
+		splits[i] = (u32)(lo * prio[i]);
+		offs[i + 1] = offs[i] + 1 + splits[i];
+	}
+
+	*refs_len = offs[len];
+
+	refs = malloc(*refs_len * sizeof(*refs));
+
+	if (refs) {
+#pragma omp parallel for schedule(dynamic, 1024) private(ref)
+		for (i = 0; i < (s64)len; i++) {
+			BVH_TriangleBox(&ref.box, tris + i);
+			ref.prim = i;
+			BVH_PreSplitRef(tris, &ref, splits[i] + 1, refs + offs[i]);
+		}
+	}
+
+	free(prio);
+	free(splits);
+	free(offs);
+
+	return refs;
+}
+
+/* BVH_PreSplitRef : cuts the reference into pieces along its longest axis */
+static void BVH_PreSplitRef(struct triangle_t *tris, struct bvhref_t *ref, u32 pieces, struct bvhref_t *out)
+{
+	struct bvhref_t l, r;
+	vecf3_t d;
+	f32 la, ra;
+	s32 axis;
+	u32 lpieces;
+
+	Vec3Sub(d, ref->box.max, ref->box.min);
+	axis = d[0] > d[1] ? (d[0] > d[2] ? 0 : 2) : (d[1] > d[2] ? 1 : 2);
+
+	if (pieces <= 1 || d[axis] <= 0) {
+		for (; pieces > 0; pieces--, out++) { // pad out anything left over
+			*out = *ref;
+			Vec3Add(out->c, ref->box.min, ref->box.max);
+			Vec3Scale(out->c, out->c, 0.5f);
+		}
+		return;
+	}
+
+	BVH_SplitRef(tris, ref, axis, ref->box.min[axis] + d[axis] * 0.5f, &l, &r);
+
+	// hand out the remaining pieces by how much area each side ended up with
+	la = AABB_Area(&l.box);
+	ra = AABB_Area(&r.box);
+	lpieces = la + ra > 0 ? (u32)(pieces * la / (la + ra) + 0.5f) : pieces / 2;
+	lpieces = MAX(1, MIN(pieces - 1, lpieces));
+
+	BVH_PreSplitRef(tris, &l, lpieces, out);
+	BVH_PreSplitRef(tris, &r, pieces - lpieces, out + lpieces);
+}
+
+/* BVH_MakeLeaf : turns the node into a leaf over the given references */
+static void BVH_MakeLeaf(struct bvh_t *bvh, u32 node, u32 first, u32 count)
+{
+	bvh->nodes[node].left = first;
+	bvh->nodes[node].count = count;
+	bvh->leaves[bvh->leaves_len++] = node;
+}
+
+/* BVH_Refit : recomputes node bounds bottom-up after the vertices have moved */
+void BVH_Refit(struct bvh_t *bvh, struct triangle_t *tris)
+{
+	struct bvhnode_t *n, *l, *r;
+	struct aabb_t box, tbox;
+	u32 node, p, i;
+	s64 k;
+
+	if (bvh->nodes_len == 0) {
+		return;
+	}
+
+	memset(bvh->visits, 0, bvh->nodes_len * sizeof(*bvh->visits));
+
+#pragma omp parallel for schedule(static) private(n, l, r, box, tbox, node, p, i)
+	for (k = 0; k < (s64)bvh->leaves_len; k++) {
+		node = bvh->leaves[k];
+		n = bvh->nodes + node;
+
+		AABB_Empty(&box);
+		for (i = n->left; i < n->left + n->count; i++) {
+			BVH_TriangleBox(&tbox, tris + bvh->prims[i]);
+			AABB_Union(&box, &tbox);
+		}
+
+		Vec3Copy(n->min, box.min);
+		Vec3Copy(n->max, box.max);
+
+		// the first child to arrive stops, the second one merges the parent
+		while ((p = bvh->parent[node]) != BVH_NONE) {
+			if (__atomic_fetch_add(bvh->visits + p, 1, __ATOMIC_ACQ_REL) == 0) {
+				break;
+			}
+
+			n = bvh->nodes + p;
+			l = bvh->nodes + n->left;
+			r = l + 1;
+
+			n->min[0] = MIN(l->min[0], r->min[0]);
+			n->min[1] = MIN(l->min[1], r->min[1]);
+			n->min[2] = MIN(l->min[2], r->min[2]);
+			n->max[0] = MAX(l->max[0], r->max[0]);
+			n->max[1] = MAX(l->max[1], r->max[1]);
+			n->max[2] = MAX(l->max[2], r->max[2]);
+
+			node = p;
+		}
+	}
+}
+
+/* BVH_Update : refits, and rebuilds if the tree quality degraded too far */
+int BVH_Update(struct bvh_t *bvh, struct triangle_t *tris, size_t len)
+{
+	if (len != bvh->tris_len || bvh->nodes_len == 0) {
+		return BVH_Build(bvh, tris, len);
+	}
+
+	BVH_Refit(bvh, tris);
+
+	if (BVH_Cost(bvh) > bvh->cost * BVH_REBUILD) {
+		return BVH_Build(bvh, tris, len);
+	}
+
+	if (BVH_Collapse(bvh) < 0) {
+		return -1;
+	}
+
+	return BVH_Quantize(bvh);
+}
+
+/* BVH_Collapse : builds the BVH_WIDTH wide tree from the binary one */
+int BVH_Collapse(struct bvh_t *bvh)
+{
+	struct bvhnode_t *n;
+	struct bvhwide_t *w;
+	struct aabb_t box;
+	u32 *stack;
+	u32 kids[BVH_WIDTH];
+	size_t stack_len, cap;
+	f32 area, best_area;
+	s32 i, j, best, kids_len;
+	u32 node, wide;
+
+	bvh->wide_len = 0;
+
+	if (bvh->nodes_len == 0) {
+		return 0;
+	}
+
+	// every wide node uses up at least one binary interior node, except when
+	// the root is a leaf all by itself
+	cap = bvh->nodes_len / 2 + 1;
+
+	if (bvh->wide_cap < cap) {
+		C_AlignedFree(bvh->wide);
+		bvh->wide = C_AlignedAlloc(64, cap * sizeof(*bvh->wide));
+		bvh->wide_cap = bvh->wide ? cap : 0;
+	}
+
+	stack = malloc(2 * bvh->nodes_len * sizeof(*stack));
+
+	if (!bvh->wide || !stack) {
+		free(stack);
+		return -1;
+	}
+
+	stack_len = 0;
+	stack[stack_len++] = 0; // binary node
+	stack[stack_len++] = 0; // the wide node it becomes
+	bvh->wide_len = 1;
+
+	while (stack_len) {
+		wide = stack[--stack_len];
+		node = stack[--stack_len];
+
+		n = bvh->nodes + node;
+		if (n->count) {
+			kids[0] = node;
+			kids_len = 1;
+		} else {
+			kids[0] = n->left;
+			kids[1] = n->left + 1;
+			kids_len = 2;
+		}
+
+		// open up the biggest interior children until the node is full
+		while (kids_len < BVH_WIDTH) {
+			best = -1;
+			best_area = -1;
+
+			for (i = 0; i < kids_len; i++) {
+				n = bvh->nodes + kids[i];
+				if (n->count) {
+					continue;
+				}
+
+				Vec3Copy(box.min, n->min);
+				Vec3Copy(box.max, n->max);
+				area = AABB_Area(&box);
+
+				if (area > best_area) {
+					best_area = area;
+					best = i;
+				}
+			}
+
+			if (best < 0) {
+				break;
+			}
+
+			n = bvh->nodes + kids[best];
+			kids[best] = n->left;
+			kids[kids_len++] = n->left + 1;
+		}
+
+		w = bvh->wide + wide;
+
+		for (i = 0; i < BVH_WIDTH; i++) {
+			if (i >= kids_len) {
+				for (j = 0; j < 3; j++) {
+					w->bounds[j + 0][i] = FLT_MAX;
+					w->bounds[j + 3][i] = -FLT_MAX;
+				}
+				w->child[i] = BVH_NONE;
+				w->count[i] = 0;
+				continue;
+			}
+
+			n = bvh->nodes + kids[i];
+
+			for (j = 0; j < 3; j++) {
+				w->bounds[j + 0][i] = n->min[j];
+				w->bounds[j + 3][i] = n->max[j];
+			}
+
+			if (n->count) {
+				w->child[i] = n->left;
+				w->count[i] = n->count;
+			} else {
+				w->child[i] = bvh->wide_len++;
+				w->count[i] = 0;
+				stack[stack_len++] = kids[i];
+				stack[stack_len++] = w->child[i];
+			}
+		}
+	}
+
+	free(stack);
+
+	return 0;
+}
+
+/* BVH_Quantize : builds the compressed copy of the wide tree */
+int BVH_Quantize(struct bvh_t *bvh)
+{
+	struct bvhwide_t *w;
+	struct bvhquant_t *q;
+	f32 lo, hi, step;
+	s32 e, i, j, k;
+	s64 n;
+
+	bvh->quant_len = 0;
+
+	// the leaf references only have so many bits
+	if (bvh->wide_len == 0 || bvh->prims_len > BVH_LEAFFIRST || BVH_MAXLEAF > 16) {
+		return 0;
+	}
+
+	if (bvh->quant_cap < bvh->wide_len) {
+		C_AlignedFree(bvh->quant);
+		bvh->quant = C_AlignedAlloc(64, bvh->wide_len * sizeof(*bvh->quant));
+		bvh->quant_cap = bvh->quant ? bvh->wide_len : 0;
+	}
+
+	if (!bvh->quant) {
+		return -1;
+	}
+
+#pragma omp parallel for schedule(static) private(w, q, lo, hi, step, e, i, j, k)
+	for (n = 0; n < (s64)bvh->wide_len; n++) {
+		w = bvh->wide + n;
+		q = bvh->quant + n;
+
+		for (j = 0; j < 3; j++) {
+			lo = FLT_MAX;
+			hi = -FLT_MAX;
+
+			for (i = 0; i < BVH_WIDTH; i++) {
+				if (w->child[i] != BVH_NONE) {
+					lo = MIN(lo, w->bounds[j + 0][i]);
+					hi = MAX(hi, w->bounds[j + 3][i]);
+				}
+			}
+
+			// smallest power of two step that spans the node in 255 steps
+			frexpf((hi - lo) / 255.0f, &e);
+			e = MAX(e, -100);
+			while (lo + 255.0f * ldexpf(1.0f, e) < hi) {
+				e++;
+			}
+
+			q->origin[j] = lo;
+			q->exp[j] = e;
+			step = ldexpf(1.0f, e);
+
+			for (i = 0; i < BVH_WIDTH; i++) {
+				if (w->child[i] == BVH_NONE) { // inside out, so it never hits
+					q->q[j + 0][i] = 255;
+					q->q[j + 3][i] = 0;
+					continue;
+				}
+
+				// round outwards, checking against the exact dequantization
+				k = MAX(0, MIN(255, (s32)floorf((w->bounds[j + 0][i] - lo) / step)));
+				while (k > 0 && lo + k * step > w->bounds[j + 0][i]) {
+					k--;
+				}
+				q->q[j + 0][i] = k;
+
+				k = MAX(0, MIN(255, (s32)ceilf((w->bounds[j + 3][i] - lo) / step)));
+				while (k < 255 && lo + k * step < w->bounds[j + 3][i]) {
+					k++;
+				}
+				q->q[j + 3][i] = k;
+			}
+		}
+
+		q->pad = 0;
+
+		for (i = 0; i < BVH_WIDTH; i++) {
+			if (w->count[i]) {
+				q->child[i] = BVH_LEAF | (w->count[i] - 1) << BVH_LEAFSHIFT | w->child[i];
+			} else {
+				q->child[i] = w->child[i];
+			}
+		}
+	}
+
+	bvh->quant_len = bvh->wide_len;
+
+	return 0;
+}
+
+/* BVH_Cost : computes the SAH cost of the tree */
+f32 BVH_Cost(struct bvh_t *bvh)
+{
+	struct bvhnode_t *n;
+	struct aabb_t box;
+	f32 cost, area;
+	s64 i;
+
+	if (bvh->nodes_len == 0) {
+		return 0;
+	}
+
+	cost = 0;
+
+#pragma omp parallel for schedule(static) private(n, box) reduction(+:cost)
+	for (i = 0; i < (s64)bvh->nodes_len; i++) {
+		n = bvh->nodes + i;
+		Vec3Copy(box.min, n->min);
+		Vec3Copy(box.max, n->max);
+
+		if (n->count) {
+			cost += AABB_Area(&box) * n->count * BVH_COST_ISECT;
+		} else {
+			cost += AABB_Area(&box) * BVH_COST_TRAV;
+		}
+	}
+
+	Vec3Copy(box.min, bvh->nodes[0].min);
+	Vec3Copy(box.max, bvh->nodes[0].max);
+	area = AABB_Area(&box);
+
+	return area > 0 ? cost / area : cost;
+}
+
+/* BVH_Free : frees the hierarchy's resources */
+void BVH_Free(struct bvh_t *bvh)
+{
+	if (bvh) {
+		free(bvh->nodes);
+		free(bvh->parent);
+		free(bvh->prims);
+		free(bvh->leaves);
+		free(bvh->visits);
+		C_AlignedFree(bvh->wide);
+		C_AlignedFree(bvh->quant);
+		memset(bvh, 0, sizeof(*bvh));
+	}
+}
+
+/* BVH_TriangleBox : computes the bounding box of a triangle */
+static void BVH_TriangleBox(struct aabb_t *box, struct triangle_t *t)
+{
+	AABB_Empty(box);
+	AABB_Grow(box, t->a);
+	AABB_Grow(box, t->b);
+	AABB_Grow(box, t->c);
+}
+
+/* AABB_Empty : sets up an inside-out box, ready to be grown */
+void AABB_Empty(struct aabb_t *box)
+{
+	Vec3(box->min, FLT_MAX, FLT_MAX, FLT_MAX);
+	Vec3(box->max, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+/* AABB_Grow : grows the box to contain the point */
+void AABB_Grow(struct aabb_t *box, vecf3_t p)
+{
+	box->min[0] = MIN(box->min[0], p[0]);
+	box->min[1] = MIN(box->min[1], p[1]);
+	box->min[2] = MIN(box->min[2], p[2]);
+	box->max[0] = MAX(box->max[0], p[0]);
+	box->max[1] = MAX(box->max[1], p[1]);
+	box->max[2] = MAX(box->max[2], p[2]);
+}
+
+/* AABB_Union : grows the box to contain the other box */
+void AABB_Union(struct aabb_t *box, struct aabb_t *other)
+{
+	box->min[0] = MIN(box->min[0], other->min[0]);
+	box->min[1] = MIN(box->min[1], other->min[1]);
+	box->min[2] = MIN(box->min[2], other->min[2]);
+	box->max[0] = MAX(box->max[0], other->max[0]);
+	box->max[1] = MAX(box->max[1], other->max[1]);
+	box->max[2] = MAX(box->max[2], other->max[2]);
+}
+
+/* AABB_Area : the surface area of the box (half of it, really) */
+f32 AABB_Area(struct aabb_t *box)
+{
+	vecf3_t d;
+
+	if (box->max[0] < box->min[0]) {
+		return 0;
+	}
+
+	Vec3Sub(d, box->max, box->min);
+
+	return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+}
+
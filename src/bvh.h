@@ -0,0 +1,166 @@
+#ifndef BVH_H
+#define BVH_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Bounding Volume Hierarchy
+ *
+ * The tree is a flat array of nodes. The children of an interior node are
+ * always allocated as a pair, so the right child lives at left + 1. Leaves
+ * point into the prims array, which holds indicies into the triangle array.
+ *
+ * Animated meshes don't need a fresh build each frame: BVH_Refit recomputes
+ * the node bounds bottom-up, and BVH_Update only rebuilds once the refit
+ * tree's SAH cost has grown past BVH_REBUILD times the cost it was built with.
+ *
+ * There are three builders, picked with bvh_t::builder. BVH_BUILD_SAH is the
+ * top-down binned SAH builder, BVH_BUILD_SBVH is the same with spatial splits
+ * for long, thin and overlapping triangles. BVH_BUILD_LBVH sorts the triangles along a
+ * Morton curve and emits the whole tree in parallel (Karras 2012), for when
+ * the build has to happen every frame; bvh_t::treelets optionally runs that
+ * many passes of treelet restructuring (Karras and Aila 2013) afterwards, to
+ * win back most of the SAH quality.
+ *
+ * The SAH builders can pre-split the worst fitting triangles (bvh_t::presplit),
+ * and together with the spatial splits they may add up to bvh_t::budget extra
+ * references per triangle. Refitting such a tree is still correct, but leaf
+ * boxes grow back to cover the whole triangles.
+ *
+ * For traversal, BVH_Collapse turns the binary tree into a BVH_WIDTH wide one,
+ * with the child bounds laid out SoA so a single SSE (4 wide) or AVX (8 wide)
+ * slab test checks every child of a node at once.
+ *
+ * BVH_Quantize then compresses the wide tree for scenes whose hierarchy no
+ * longer fits in cache. Each node stores its own bounds as an origin and a
+ * power of two step per axis, and the child bounds as 8-bit step counts from
+ * that origin, rounded outwards so the boxes only ever grow. Leaves are packed
+ * into the child reference itself, see BVH_LEAF.
+ */
+
+#include "common.h"
+#include "math.h"
+
+#define BVH_BINS     (16)    // SAH bins per axis
+#define BVH_MAXLEAF  (4)     // most triangles we'll put into a single leaf
+#define BVH_MAXDEPTH (64)    // past this, the builder only does median splits
+#define BVH_STACK    (128)   // traversal stack depth
+#define BVH_REBUILD  (1.4f)  // cost growth that triggers a rebuild
+
+#define BVH_TREELET   (7)          // leaves per restructured treelet
+#define BVH_MORTON30  (1 << 20)    // up to here 30-bit Morton codes, then 63
+#define BVH_SBVH_ALPHA (1e-5f)     // child overlap, relative to the root, worth a spatial split
+
+#define BVH_COST_TRAV  (1.0f) // SAH cost of stepping through a node
+#define BVH_COST_ISECT (1.0f) // SAH cost of a ray-triangle test
+
+#define BVH_NONE     (0xffffffff)
+
+// quantized leaf references: BVH_LEAF | (count - 1) << BVH_LEAFSHIFT | first
+#define BVH_LEAF       (0x80000000)
+#define BVH_LEAFSHIFT  (27)
+#define BVH_LEAFFIRST  ((1 << BVH_LEAFSHIFT) - 1)
+#define BVH_LEAFCOUNT(x)  ((((x) >> BVH_LEAFSHIFT) & 0xf) + 1)
+
+#ifndef BVH_WIDTH
+#if defined(__AVX__)
+#define BVH_WIDTH    (8)
+#else
+#define BVH_WIDTH    (4)
+#endif
+#endif
+
+struct triangle_t;
+
+enum {
+	BVH_BUILD_SAH,
+	BVH_BUILD_LBVH,
+	BVH_BUILD_SBVH,
+	BVH_BUILD_TOTAL
+};
+
+struct aabb_t {
+	vecf3_t min, max;
+};
+
+struct bvhnode_t {
+	vecf3_t min;
+	u32 left;  // interior: left child (right is left + 1), leaf: first prim
+	vecf3_t max;
+	u32 count; // leaf: number of prims, interior: 0
+};
+
+struct bvhwide_t {
+	f32 bounds[6][BVH_WIDTH]; // min x, y, z, then max x, y, z, per child
+	u32 child[BVH_WIDTH];     // interior: wide node, leaf: first prim
+	u32 count[BVH_WIDTH];     // leaf: number of prims, interior or empty: 0
+};
+
+struct bvhquant_t {
+	vecf3_t origin;        // min corner of the node's own bounds
+	s8 exp[3];             // per axis step size, as a power of two
+	u8 pad;
+	u8 q[6][BVH_WIDTH];    // child lo x, y, z, then hi x, y, z, in steps
+	u32 child[BVH_WIDTH];  // interior: quantized node, leaf: see BVH_LEAF
+};
+
+struct bvh_t {
+	struct bvhnode_t *nodes;
+	u32 *parent;  // parent of each node, BVH_NONE for the root
+	u32 *prims;   // triangle indicies, referenced by the leaves
+	u32 *leaves;  // leaf node indicies, where the refit starts from
+	u32 *visits;  // per node arrival counters for the refit
+	size_t nodes_len, nodes_cap;
+	size_t prims_len;
+	size_t leaves_len;
+	size_t tris_len; // triangle count the tree was built over
+	f32 cost;     // SAH cost as of the last full build
+
+	s32 builder;  // BVH_BUILD_*
+	s32 treelets; // LBVH only, treelet restructuring passes
+	s32 presplit; // SAH and SBVH only, split the worst triangles up front
+	f32 budget;   // SAH and SBVH only, extra references allowed per triangle
+
+	struct bvhwide_t *wide; // the collapsed tree, root at 0
+	size_t wide_len, wide_cap;
+
+	struct bvhquant_t *quant; // the wide tree, quantized, same indicies
+	size_t quant_len, quant_cap;
+};
+
+/* BVH_Build : builds the hierarchy over the triangles from scratch */
+int BVH_Build(struct bvh_t *bvh, struct triangle_t *tris, size_t len);
+
+/* BVH_Refit : recomputes node bounds bottom-up after the vertices have moved */
+void BVH_Refit(struct bvh_t *bvh, struct triangle_t *tris);
+
+/* BVH_Update : refits, and rebuilds if the tree quality degraded too far */
+int BVH_Update(struct bvh_t *bvh, struct triangle_t *tris, size_t len);
+
+/* BVH_Collapse : builds the BVH_WIDTH wide tree from the binary one */
+int BVH_Collapse(struct bvh_t *bvh);
+
+/* BVH_Quantize : builds the compressed copy of the wide tree */
+int BVH_Quantize(struct bvh_t *bvh);
+
+/* BVH_Cost : computes the SAH cost of the tree */
+f32 BVH_Cost(struct bvh_t *bvh);
+
+/* BVH_Free : frees the hierarchy's resources */
+void BVH_Free(struct bvh_t *bvh);
+
+/* AABB_Empty : sets up an inside-out box, ready to be grown */
+void AABB_Empty(struct aabb_t *box);
+
+/* AABB_Grow : grows the box to contain the point */
+void AABB_Grow(struct aabb_t *box, vecf3_t p);
+
+/* AABB_Union : grows the box to contain the other box */
+void AABB_Union(struct aabb_t *box, struct aabb_t *other);
+
+/* AABB_Area : the surface area of the box (half of it, really) */
+f32 AABB_Area(struct aabb_t *box);
+
+#endif // BVH_H
+
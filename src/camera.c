@@ -0,0 +1,189 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Cameras
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "math.h"
+#include "camera.h"
+
+/* CAM_Default : the camera bray always used, 10 units back from the origin */
+void CAM_Default(struct camera_t *cam)
+{
+	memset(cam, 0, sizeof(*cam));
+
+	cam->type = CAM_PINHOLE;
+	Vec3(cam->pos, 0, -10, 1);
+	Vec3(cam->target, 0, 0, 0);
+	Vec3(cam->up, 0, 0, 1);
+	cam->fov = 53.13f; // a film 1 unit wide, 1 unit in front of the eye
+	cam->ortho_w = 10;
+}
+
+/* CAM_Setup : precomputes the camera's per pixel steps for a w x h image */
+void CAM_Setup(struct camera_t *cam, s32 w, s32 h)
+{
+	vecf3_t x, y, z, tmp;
+	mat4_t view;
+	f32 half_w, half_h;
+
+	cam->w = w;
+	cam->h = h;
+
+	// z points back at the eye, and y points down, so row 0 is the top
+	view = M4_LookAt(cam->pos, cam->target, cam->up);
+	M4_Column(x, &view, 0);
+	M4_Column(y, &view, 1);
+	M4_Column(z, &view, 2);
+
+	if (cam->type == CAM_ORTHO) {
+		half_w = cam->ortho_w / 2;
+	} else {
+		half_w = tanf(cam->fov * (M_PI / 180) / 2);
+	}
+	half_h = half_w * ((f32)h / (f32)w);
+
+	Vec3Scale(cam->dx, x, 2 * half_w / w);
+	Vec3Scale(cam->dy, y, 2 * half_h / h);
+	Vec3Scale(cam->dir, z, -1);
+
+	// the film's corner, moved half a step in so rays go through pixel centers
+	if (cam->type == CAM_ORTHO) {
+		Vec3Copy(cam->corner, cam->pos);
+	} else {
+		Vec3Copy(cam->corner, cam->dir);
+	}
+
+	Vec3Scale(tmp, x, -half_w);
+	Vec3Add(cam->corner, cam->corner, tmp);
+	Vec3Scale(tmp, y, -half_h);
+	Vec3Add(cam->corner, cam->corner, tmp);
+	Vec3Scale(tmp, cam->dx, 0.5f);
+	Vec3Add(cam->corner, cam->corner, tmp);
+	Vec3Scale(tmp, cam->dy, 0.5f);
+	Vec3Add(cam->corner, cam->corner, tmp);
+}
+
+/* CAM_Row : generates the rays of row j, left to right */
+void CAM_Row(struct camera_t *cam, s32 j, struct camrow_t *row)
+{
+	f32 *p[3], *q[3];
+	vecf3_t start;
+	vec3x8_t v, base, step, fixed;
+	f32x8_t col;
+	s32 i, k;
+
+	// everything in the row is start + i * dx, in p, while q holds the same
+	// value for the whole row
+	for (k = 0; k < 3; k++) {
+		start[k] = cam->corner[k] + j * cam->dy[k];
+	}
+
+	if (cam->type == CAM_ORTHO) {
+		memcpy(p, row->o, sizeof(p));
+		memcpy(q, row->d, sizeof(q));
+		fixed = V3x8_Set1(cam->dir);
+	} else {
+		memcpy(p, row->d, sizeof(p));
+		memcpy(q, row->o, sizeof(q));
+		fixed = V3x8_Set1(cam->pos);
+	}
+
+	base = V3x8_Set1(start);
+	step = V3x8_Set1(cam->dx);
+
+	// rows are padded out to CAM_LANES, so there's never a partial register
+	for (i = 0; i < row->len; i += CAM_LANES) {
+		col = F8_Add(F8_Set1(i), F8_Set(0, 1, 2, 3, 4, 5, 6, 7));
+		v = V3x8_Add(base, V3x8_Scale(step, col));
+
+		if (cam->type != CAM_ORTHO) {
+			v = V3x8_NormFast(v);
+		}
+
+		V3x8_Store(p[0] + i, p[1] + i, p[2] + i, v);
+		V3x8_Store(q[0] + i, q[1] + i, q[2] + i, fixed);
+	}
+}
+
+/* CAM_Ray : one ray through film position x, y, where whole numbers are pixel centers */
+void CAM_Ray(struct camera_t *cam, f32 x, f32 y, vecf3_t origin, vecf3_t dir)
+{
+	vecf3_t p;
+	s32 k;
+
+	for (k = 0; k < 3; k++) {
+		p[k] = cam->corner[k] + x * cam->dx[k] + y * cam->dy[k];
+	}
+
+	if (cam->type == CAM_ORTHO) {
+		Vec3Copy(origin, p);
+		Vec3Copy(dir, cam->dir);
+	} else {
+		Vec3Copy(origin, cam->pos);
+		Vec3Norm(dir, p);
+	}
+}
+
+/* CAM_Differentials : the differentials of the camera's ray along unit dir, scaled by scale */
+void CAM_Differentials(struct camera_t *cam, vecf3_t dir, f32 scale, struct raydiff_t *rd)
+{
+	f32 len;
+	s32 k;
+
+	if (cam->type == CAM_ORTHO) {
+		Vec3Scale(rd->dodx, cam->dx, scale);
+		Vec3Scale(rd->dody, cam->dy, scale);
+		Vec3(rd->dddx, 0, 0, 0);
+		Vec3(rd->dddy, 0, 0, 0);
+		return;
+	}
+
+	// the film point p is 1 along the view, so |p| is 1 / dot(dir, view), and
+	// the derivative of p / |p| is the step less its part along dir, over |p|
+	len = Vec3Dot(dir, cam->dir) * scale;
+
+	for (k = 0; k < 3; k++) {
+		rd->dddx[k] = (cam->dx[k] - dir[k] * Vec3Dot(dir, cam->dx)) * len;
+		rd->dddy[k] = (cam->dy[k] - dir[k] * Vec3Dot(dir, cam->dy)) * len;
+	}
+
+	Vec3(rd->dodx, 0, 0, 0);
+	Vec3(rd->dody, 0, 0, 0);
+}
+
+/* CAM_RowInit : allocates room for a row of w rays */
+int CAM_RowInit(struct camrow_t *row, s32 w)
+{
+	s32 stride, k;
+
+	// pad each array out, so CAM_Row can always store whole registers
+	stride = (w + CAM_LANES - 1) / CAM_LANES * CAM_LANES;
+
+	row->mem = C_AlignedAlloc(32, 6 * stride * sizeof(*row->mem));
+	if (!row->mem) {
+		return -1;
+	}
+
+	for (k = 0; k < 3; k++) {
+		row->o[k] = row->mem + (k + 0) * stride;
+		row->d[k] = row->mem + (k + 3) * stride;
+	}
+	row->len = w;
+
+	return 0;
+}
+
+/* CAM_RowFree : frees the row */
+void CAM_RowFree(struct camrow_t *row)
+{
+	C_AlignedFree(row->mem);
+	memset(row, 0, sizeof(*row));
+}
+
@@ -0,0 +1,82 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Cameras
+ *
+ * CAM_Setup turns the camera's position, target and lens into a film corner
+ * and per pixel steps, so CAM_Row never has to rebuild a film point from
+ * scratch. A row's directions are the row's start plus i times the column
+ * step. They're normalized a SIMD register at a time with a fast reciprocal
+ * square root and one Newton-Raphson step. Rows are independent, so threads
+ * can generate and trace their own.
+ *
+ * CAM_Differentials gives a ray's differentials (Igehy 1999), how its origin
+ * and direction change from one pixel to the next, so whatever the ray hits
+ * knows how much of the surface the pixel covers there.
+ */
+
+#include "common.h"
+#include "math.h"
+
+#define CAM_LANES (8) // rows are padded out to a multiple of this
+
+enum {
+	CAM_PINHOLE, // every ray starts at pos, spreading out over fov
+	CAM_ORTHO,   // every ray points along the view, spread over ortho_w
+	CAM_TOTAL
+};
+
+struct camera_t {
+	s32 type;         // CAM_*
+	vecf3_t pos;
+	vecf3_t target;   // what the center of the image looks at
+	vecf3_t up;
+	f32 fov;          // pinhole, horizontal field of view in degrees
+	f32 ortho_w;      // ortho, width of the image in world units
+
+	// filled in by CAM_Setup
+	s32 w, h;
+	vecf3_t corner;   // pinhole: direction to pixel 0, 0; ortho: its origin
+	vecf3_t dx, dy;   // step from one pixel to the next, and one row to the next
+	vecf3_t dir;      // the view, and ortho's direction for every ray
+};
+
+struct raydiff_t { // ray differentials, per pixel step across the film
+	vecf3_t dodx, dody; // of the origin
+	vecf3_t dddx, dddy; // of the unit direction
+};
+
+struct camrow_t { // one row of rays, SoA
+	f32 *o[3];   // origins
+	f32 *d[3];   // unit directions
+	s32 len;
+	f32 *mem;
+};
+
+/* CAM_Default : the camera bray always used, 10 units back from the origin */
+void CAM_Default(struct camera_t *cam);
+
+/* CAM_Setup : precomputes the camera's per pixel steps for a w x h image */
+void CAM_Setup(struct camera_t *cam, s32 w, s32 h);
+
+/* CAM_Row : generates the rays of row j, left to right */
+void CAM_Row(struct camera_t *cam, s32 j, struct camrow_t *row);
+
+/* CAM_Ray : one ray through film position x, y, where whole numbers are pixel centers */
+void CAM_Ray(struct camera_t *cam, f32 x, f32 y, vecf3_t origin, vecf3_t dir);
+
+/* CAM_Differentials : the differentials of the camera's ray along unit dir, scaled by scale */
+void CAM_Differentials(struct camera_t *cam, vecf3_t dir, f32 scale, struct raydiff_t *rd);
+
+/* CAM_RowInit : allocates room for a row of w rays */
+int CAM_RowInit(struct camrow_t *row, s32 w);
+
+/* CAM_RowFree : frees the row */
+void CAM_RowFree(struct camrow_t *row);
+
+#endif // CAMERA_H
+
@@ -6,6 +6,11 @@
  */
 
 #include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 #include "common.h"
 
@@ -31,3 +36,36 @@ void C_ArrayRealloc(void *p, size_t *cnt, size_t *len, size_t elem)
 	}
 }
 
+/* C_AlignedAlloc : allocates memory aligned to align bytes (a power of 2) */
+void *C_AlignedAlloc(size_t align, size_t size)
+{
+	// NOTE (brian) aligned_alloc wants the size to be a multiple of align
+	size = (size + align - 1) & ~(align - 1);
+
+#ifdef _WIN32
+	return _aligned_malloc(size, align);
+#else
+	return aligned_alloc(align, size);
+#endif
+}
+
+/* C_AlignedFree : frees memory from C_AlignedAlloc */
+void C_AlignedFree(void *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/* C_Time : wall clock time in seconds, for timing things */
+f64 C_Time(void)
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return (f64)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
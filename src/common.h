@@ -4,6 +4,19 @@
 #include <stdint.h>
 #include <stdarg.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num()  (0)
+#define omp_get_num_threads() (1)
+#define omp_get_max_threads() (1)
+typedef int omp_lock_t;
+#define omp_init_lock(l)      ((void)(l))
+#define omp_destroy_lock(l)   ((void)(l))
+#define omp_set_lock(l)       ((void)(l))
+#define omp_unset_lock(l)     ((void)(l))
+#endif
+
 #define BUFSMALL  (256)
 #define BUFLARGE  (4096)
 
@@ -52,5 +65,14 @@ typedef double             f64;
 /* C_ArrayRealloc : realloc an array as needed */
 void C_ArrayRealloc(void *p, size_t *cnt, size_t *len, size_t elem);
 
+/* C_AlignedAlloc : allocates memory aligned to align bytes (a power of 2) */
+void *C_AlignedAlloc(size_t align, size_t size);
+
+/* C_AlignedFree : frees memory from C_AlignedAlloc */
+void C_AlignedFree(void *p);
+
+/* C_Time : wall clock time in seconds, for timing things */
+f64 C_Time(void);
+
 #endif
 
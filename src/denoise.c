@@ -0,0 +1,348 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Denoising
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "math.h"
+#include "bray.h"
+#include "denoise.h"
+
+#define D_IDX(p,x,y) ((x) + D_PAD + ((y) + D_PAD) * (p)->stride)
+#define D_PLANES     (13)
+
+struct dplanes_t { // the image, SoA, with D_PAD of nothing all the way around
+	f32 *r, *g, *b, *var;     // what the pass reads, color divided by albedo
+	f32 *tr, *tg, *tb, *tvar; // what it writes, swapped after
+	f32 *nx, *ny, *nz;
+	f32 *z, *dz;              // depth, and how much it changes per pixel
+	f32 *blur;                // var, blurred for the pass
+	f32 *mem;
+	s32 w, h, stride;         // stride is w rounded up to 8, plus the padding
+};
+
+/* D_Luminance : the luminance of a color */
+static inline f32 D_Luminance(f32 r, f32 g, f32 b);
+
+/* D_Albedo : the albedo the color gets divided by, no channel of it 0 */
+static inline void D_Albedo(vecf3_t out, vecf3_t albedo);
+
+/* D_Load : fills the planes from the framebuffer and the AOVs */
+static void D_Load(struct dplanes_t *p, vecf3_t *framebuffer, struct aov_t *aov);
+
+/* D_Variance : estimates the variance of pixels without one, from their neighbors */
+static void D_Variance(struct dplanes_t *p);
+
+/* D_Gradient : how much the depth changes from one pixel to the next */
+static void D_Gradient(struct dplanes_t *p);
+
+/* D_Blur : the variance, blurred 3x3 */
+static void D_Blur(struct dplanes_t *p);
+
+/* D_Pass : one a-trous pass, the taps step pixels apart */
+static void D_Pass(struct dplanes_t *p, s32 step);
+
+/* D_Store : multiplies the albedo back in, into the framebuffer */
+static void D_Store(struct dplanes_t *p, vecf3_t *framebuffer, struct aov_t *aov);
+
+/* D_Denoise : filters the framebuffer in place, guided by the AOVs */
+int D_Denoise(vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h)
+{
+	struct dplanes_t p;
+	size_t n;
+	s32 i;
+
+	memset(&p, 0, sizeof(p));
+
+	p.w = w;
+	p.h = h;
+	p.stride = D_PAD + ((w + 7) & ~7) + D_PAD;
+	n = (size_t)p.stride * (h + 2 * D_PAD);
+
+	p.mem = C_AlignedAlloc(32, D_PLANES * n * sizeof(*p.mem));
+	if (!p.mem) {
+		return -1;
+	}
+
+	memset(p.mem, 0, D_PLANES * n * sizeof(*p.mem));
+
+	p.r = p.mem;
+	p.g = p.r + n;
+	p.b = p.g + n;
+	p.var = p.b + n;
+	p.tr = p.var + n;
+	p.tg = p.tr + n;
+	p.tb = p.tg + n;
+	p.tvar = p.tb + n;
+	p.nx = p.tvar + n;
+	p.ny = p.nx + n;
+	p.nz = p.ny + n;
+	p.z = p.nz + n;
+	p.dz = p.z + n;
+
+	D_Load(&p, framebuffer, aov);
+	D_Variance(&p);
+	D_Gradient(&p);
+
+	for (i = 0; i < D_PASSES; i++) {
+		p.blur = p.tvar; // each pixel's is read before the pass writes its tvar
+		D_Blur(&p);
+		D_Pass(&p, 1 << i);
+
+		SWAP(p.r, p.tr);
+		SWAP(p.g, p.tg);
+		SWAP(p.b, p.tb);
+		SWAP(p.var, p.tvar);
+	}
+
+	D_Store(&p, framebuffer, aov);
+
+	C_AlignedFree(p.mem);
+
+	return 0;
+}
+
+/* D_Luminance : the luminance of a color */
+static inline f32 D_Luminance(f32 r, f32 g, f32 b)
+{
+	return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+/* D_Albedo : the albedo the color gets divided by, no channel of it 0 */
+static inline void D_Albedo(vecf3_t out, vecf3_t albedo)
+{
+	s32 k;
+
+	// black channels only hold light the surface gave off, keep it as it is
+	for (k = 0; k < 3; k++) {
+		out[k] = albedo[k] > 0.001f ? albedo[k] : 1;
+	}
+}
+
+/* D_Load : fills the planes from the framebuffer and the AOVs */
+static void D_Load(struct dplanes_t *p, vecf3_t *framebuffer, struct aov_t *aov)
+{
+	vecf3_t a;
+	f32 l;
+	s32 x, y, i, c;
+
+#pragma omp parallel for private(a, l, x, i, c) schedule(static)
+	for (y = 0; y < p->h; y++) {
+		for (x = 0; x < p->w; x++) {
+			i = x + y * p->w;
+			c = D_IDX(p, x, y);
+
+			if (aov->depth[i] <= 0) {
+				continue;
+			}
+
+			D_Albedo(a, aov->albedo[i]);
+
+			p->r[c] = framebuffer[i][0] / a[0];
+			p->g[c] = framebuffer[i][1] / a[1];
+			p->b[c] = framebuffer[i][2] / a[2];
+
+			// the variance of the luminance scales with the square of the albedo's
+			l = D_Luminance(a[0], a[1], a[2]);
+			p->var[c] = aov->variance[i] < 0 ? -1 : aov->variance[i] / (l * l);
+
+			p->nx[c] = aov->shading[i][0];
+			p->ny[c] = aov->shading[i][1];
+			p->nz[c] = aov->shading[i][2];
+			p->z[c] = aov->depth[i];
+		}
+	}
+}
+
+/* D_Variance : estimates the variance of pixels without one, from their neighbors */
+static void D_Variance(struct dplanes_t *p)
+{
+	f32 l, sum, sum2, cnt;
+	s32 x, y, i, j, c, q;
+
+	// a 5x5 window of whatever was hit, written into tvar so the window doesn't see it
+#pragma omp parallel for private(l, sum, sum2, cnt, x, i, j, c, q) schedule(static)
+	for (y = 0; y < p->h; y++) {
+		for (x = 0; x < p->w; x++) {
+			c = D_IDX(p, x, y);
+			p->tvar[c] = p->var[c];
+
+			if (p->var[c] >= 0) {
+				continue;
+			}
+
+			sum = sum2 = cnt = 0;
+
+			for (j = -2; j <= 2; j++) {
+				for (i = -2; i <= 2; i++) {
+					q = c + i + j * p->stride;
+					if (p->z[q] <= 0) {
+						continue;
+					}
+
+					l = D_Luminance(p->r[q], p->g[q], p->b[q]);
+					sum += l;
+					sum2 += l * l;
+					cnt++;
+				}
+			}
+
+			p->tvar[c] = MAX(0, sum2 / cnt - (sum / cnt) * (sum / cnt));
+		}
+	}
+
+	SWAP(p->var, p->tvar);
+}
+
+/* D_Gradient : how much the depth changes from one pixel to the next */
+static void D_Gradient(struct dplanes_t *p)
+{
+	f32 gx, gy, z;
+	s32 x, y, c;
+
+	// the smaller one sided difference per axis, so an edge doesn't count as a slope
+#pragma omp parallel for private(gx, gy, z, x, c) schedule(static)
+	for (y = 0; y < p->h; y++) {
+		for (x = 0; x < p->w; x++) {
+			c = D_IDX(p, x, y);
+			z = p->z[c];
+
+			gx = MIN(fabsf(p->z[c + 1] - z), fabsf(z - p->z[c - 1]));
+			gy = MIN(fabsf(p->z[c + p->stride] - z), fabsf(z - p->z[c - p->stride]));
+
+			p->dz[c] = MAX(gx, gy);
+		}
+	}
+}
+
+/* D_Blur : the variance, blurred 3x3 */
+static void D_Blur(struct dplanes_t *p)
+{
+	f32 kernel[3] = { 0.25f, 0.5f, 0.25f };
+	f32x8_t sum;
+	s32 x, y, i, j, c;
+
+#pragma omp parallel for private(sum, x, i, j, c) schedule(static)
+	for (y = 0; y < p->h; y++) {
+		for (x = 0; x < p->w; x += 8) {
+			c = D_IDX(p, x, y);
+			sum = F8_Zero();
+
+			for (j = -1; j <= 1; j++) {
+				for (i = -1; i <= 1; i++) {
+					sum = F8_Add(sum, F8_Mul(F8_Set1(kernel[i + 1] * kernel[j + 1]),
+						F8_LoadU(p->var + c + i + j * p->stride)));
+				}
+			}
+
+			F8_Store(p->blur + c, sum);
+		}
+	}
+}
+
+/* D_Pass : one a-trous pass, the taps step pixels apart */
+static void D_Pass(struct dplanes_t *p, s32 step)
+{
+	f32 kernel[3] = { 3.0f / 8, 1.0f / 4, 1.0f / 16 }; // B3 spline, from the middle out
+	f32x8_t nx, ny, nz, z, lum, iz, il, sign;
+	f32x8_t wn, wt, d, sr, sg, sb, sv, sw;
+	f32 h, dist;
+	s32 x, y, i, j, k, c, q;
+
+	sign = F8_Set1(-0.0f); // and'ed off for the absolute value
+
+#pragma omp parallel for private(nx, ny, nz, z, lum, iz, il, wn, wt, d, sr, sg, sb, sv, sw, h, dist, x, i, j, k, c, q) schedule(static)
+	for (y = 0; y < p->h; y++) {
+		for (x = 0; x < p->w; x += 8) {
+			c = D_IDX(p, x, y);
+
+			nx = F8_Load(p->nx + c);
+			ny = F8_Load(p->ny + c);
+			nz = F8_Load(p->nz + c);
+			z = F8_Load(p->z + c);
+
+			lum = F8_Add(F8_Mul(F8_Set1(0.2126f), F8_Load(p->r + c)),
+				F8_Add(F8_Mul(F8_Set1(0.7152f), F8_Load(p->g + c)),
+					F8_Mul(F8_Set1(0.0722f), F8_Load(p->b + c))));
+
+			// the depth difference allowed per pixel, and the luminance difference
+			iz = F8_Div(F8_Set1(1), F8_Add(F8_Mul(F8_Set1(D_SIGMAZ), F8_Load(p->dz + c)),
+				F8_Add(F8_Mul(F8_Set1(0.001f), z), F8_Set1(1e-6f))));
+			il = F8_Div(F8_Set1(1), F8_Add(F8_Mul(F8_Set1(D_SIGMAL), F8_Sqrt(F8_Load(p->blur + c))),
+				F8_Set1(1e-4f)));
+
+			sr = sg = sb = sv = sw = F8_Zero();
+
+			for (j = -2; j <= 2; j++) {
+				for (i = -2; i <= 2; i++) {
+					q = c + (i + j * p->stride) * step;
+					h = kernel[i < 0 ? -i : i] * kernel[j < 0 ? -j : j];
+					dist = step * MAX(1, (i < 0 ? -i : i) + (j < 0 ? -j : j));
+
+					wn = F8_Add(F8_Mul(nx, F8_LoadU(p->nx + q)),
+						F8_Add(F8_Mul(ny, F8_LoadU(p->ny + q)), F8_Mul(nz, F8_LoadU(p->nz + q))));
+					wn = F8_Max(wn, F8_Zero());
+					for (k = 1; k < D_SIGMAN; k <<= 1) {
+						wn = F8_Mul(wn, wn);
+					}
+
+					// depth and luminance, both in one exp
+					d = F8_Mul(F8_AndNot(sign, F8_Sub(z, F8_LoadU(p->z + q))), F8_Mul(iz, F8_Set1(1 / dist)));
+
+					wt = F8_Add(F8_Mul(F8_Set1(0.2126f), F8_LoadU(p->r + q)),
+						F8_Add(F8_Mul(F8_Set1(0.7152f), F8_LoadU(p->g + q)),
+							F8_Mul(F8_Set1(0.0722f), F8_LoadU(p->b + q))));
+					d = F8_Add(d, F8_Mul(F8_AndNot(sign, F8_Sub(lum, wt)), il));
+
+					wt = F8_Mul(F8_Mul(F8_Set1(h), wn), F8_Exp(F8_Sub(F8_Zero(), d)));
+
+					sr = F8_Add(sr, F8_Mul(wt, F8_LoadU(p->r + q)));
+					sg = F8_Add(sg, F8_Mul(wt, F8_LoadU(p->g + q)));
+					sb = F8_Add(sb, F8_Mul(wt, F8_LoadU(p->b + q)));
+					sv = F8_Add(sv, F8_Mul(F8_Mul(wt, wt), F8_LoadU(p->var + q)));
+					sw = F8_Add(sw, wt);
+				}
+			}
+
+			// misses and the padding have no weight at all, not even their own
+			d = F8_Div(F8_Set1(1), F8_Max(sw, F8_Set1(1e-8f)));
+
+			F8_Store(p->tr + c, F8_Mul(sr, d));
+			F8_Store(p->tg + c, F8_Mul(sg, d));
+			F8_Store(p->tb + c, F8_Mul(sb, d));
+			F8_Store(p->tvar + c, F8_Mul(sv, F8_Mul(d, d)));
+		}
+	}
+}
+
+/* D_Store : multiplies the albedo back in, into the framebuffer */
+static void D_Store(struct dplanes_t *p, vecf3_t *framebuffer, struct aov_t *aov)
+{
+	vecf3_t a;
+	s32 x, y, i, c;
+
+#pragma omp parallel for private(a, x, i, c) schedule(static)
+	for (y = 0; y < p->h; y++) {
+		for (x = 0; x < p->w; x++) {
+			i = x + y * p->w;
+			c = D_IDX(p, x, y);
+
+			if (aov->depth[i] <= 0) {
+				continue;
+			}
+
+			D_Albedo(a, aov->albedo[i]);
+
+			framebuffer[i][0] = p->r[c] * a[0];
+			framebuffer[i][1] = p->g[c] * a[1];
+			framebuffer[i][2] = p->b[c] * a[2];
+		}
+	}
+}
+
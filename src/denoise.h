@@ -0,0 +1,51 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Denoising
+ *
+ * An edge avoiding a-trous wavelet filter (Dammertz et al. 2010), with the
+ * edge stopping functions of SVGF (Schied et al. 2017), run over the finished
+ * framebuffer with the AOVs W_Render kept of the first hits.
+ *
+ * The color is divided by the albedo first, so texture and material detail
+ * doesn't get blurred along with the noise, and multiplied back in at the
+ * end. Then D_PASSES passes of a 5x5 B3 spline kernel, its taps spread 1, 2,
+ * 4, ... pixels apart, each tap weighed by how alike the two pixels are:
+ *
+ *   normal    - max(0, dot)^D_SIGMAN of the shading normals, so creases stay
+ *               sharp and smoothed meshes don't show their facets
+ *   depth     - the difference against what the center's depth gradient
+ *               expects that far away, so slanted floors still blur
+ *   luminance - the difference against the center's standard deviation, so
+ *               noisy pixels blur more, and converged ones hardly at all
+ *
+ * The variance comes from the samples when there's more than one, else it's
+ * estimated from the neighborhood. Every pass carries it forward the same way
+ * the color goes, weights squared, and blurs it 3x3 before using it.
+ *
+ * The passes work on padded planes, a float per pixel, eight pixels at a time
+ * with the f32x8_t ops, and the rows split over the threads. The padding has
+ * no normal, so it never gets any weight, and the taps need no bounds checks.
+ * Misses have no normal either, they keep their color.
+ */
+
+#include "common.h"
+#include "math.h"
+
+#define D_PASSES (5)       // a-trous passes, the widest reaches 2 << D_PASSES pixels out
+#define D_PAD    (32)      // 2 << (D_PASSES - 1), a multiple of 8 keeps the rows aligned
+#define D_SIGMAN (128)     // normal exponent, a power of 2
+#define D_SIGMAZ (1.0f)    // depth tolerance, in gradients
+#define D_SIGMAL (4.0f)    // luminance tolerance, in standard deviations
+
+struct aov_t;
+
+/* D_Denoise : filters the framebuffer in place, guided by the AOVs */
+int D_Denoise(vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h);
+
+#endif // DENOISE_H
+
@@ -0,0 +1,296 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Brian's Raytracer - traversal kernels
+ *
+ * No include guard, on purpose. bray.c includes this once per variant, with
+ * these set up beforehand:
+ *
+ *   KERNEL(name)  - pastes the variant's suffix onto a function name
+ *   KERNEL_CULL   - 1 to skip back faces, 0 for double-sided geometry
+ *   KERNEL_ANY    - 1 to stop at the first hit (shadow rays), 0 for the closest
+ *   KERNEL_ISECT  - the ISECT_* ray-triangle test the leaves use
+ *
+ * The last three are compile time constants, so the mode checks below fold
+ * away and the inner loops of each variant only contain the work that
+ * variant needs. The ray-triangle tests are static inline, and take the
+ * culling mode as an argument for the same reason. All four are undefined
+ * again at the end, ready for the next variant.
+ */
+
+/* R_IntersectLeaf : tests the leaf's triangles, returns the closest hit so far */
+static u32 KERNEL(R_IntersectLeaf)(struct world_t *world, struct ray_t *ray, u32 first, u32 count, f32 *tmax, vecf3_t tuv, u32 hit)
+{
+	vecf3_t cur;
+	f32 t[4], u[4], v[4];
+	u32 i, j, mask, prim;
+
+	ray->tris += count;
+
+// keeps the hit if it's closer, and for any-hit, that's the end of it
+#define LEAF_ACCEPT(p, tt, uu, vv) \
+	do { \
+		if (EPSILON < (tt) && (tt) < *tmax) { \
+			*tmax = (tt); \
+			Vec3(tuv, (tt), (uu), (vv)); \
+			hit = (p); \
+			if (KERNEL_ANY) { \
+				return hit; \
+			} \
+		} \
+	} while (0)
+
+	// a constant, so only the variant's own test is left
+	switch (KERNEL_ISECT) {
+	case ISECT_WATERTIGHT_SIMD:
+		for (i = first; i < first + count; i += 4) {
+			mask = R_IntersectWatertight4(world, ray, world->bvh.prims + i,
+				MIN(4, first + count - i), t, u, v, KERNEL_CULL);
+
+			for (; mask; mask &= mask - 1) {
+				j = __builtin_ctz(mask);
+				LEAF_ACCEPT(world->bvh.prims[i + j], t[j], u[j], v[j]);
+			}
+		}
+		break;
+
+	case ISECT_WATERTIGHT:
+		for (i = first; i < first + count; i++) {
+			prim = world->bvh.prims[i];
+			if (R_IntersectWatertight(cur, world->t + prim, ray, KERNEL_CULL)) {
+				LEAF_ACCEPT(prim, cur[0], cur[1], cur[2]);
+			}
+		}
+		break;
+
+	case ISECT_BALDWIN:
+		for (i = first; i < first + count; i++) {
+			prim = world->bvh.prims[i];
+			if (R_IntersectBaldwin(cur, world->xf + prim, ray, KERNEL_CULL)) {
+				LEAF_ACCEPT(prim, cur[0], cur[1], cur[2]);
+			}
+		}
+		break;
+
+	default:
+		for (i = first; i < first + count; i++) {
+			prim = world->bvh.prims[i];
+			if (R_IntersectTriangle(cur, world->t + prim, ray->origin, ray->dir, KERNEL_CULL)) {
+				LEAF_ACCEPT(prim, cur[0], cur[1], cur[2]);
+			}
+		}
+		break;
+	}
+
+#undef LEAF_ACCEPT
+
+	return hit;
+}
+
+/* R_TraverseWide : finds a triangle closer than tmax with the wide BVH, returns its index */
+static u32 KERNEL(R_TraverseWide)(struct world_t *world, struct ray_t *ray, vecf3_t tuv, f32 tmax)
+{
+	struct bvh_t *bvh;
+	struct bvhwide_t *node;
+	struct widestack_t stack[BVH_STACK * BVH_WIDTH];
+	struct widestack_t hits[BVH_WIDTH], e;
+	f32 dist[BVH_WIDTH];
+	s32 stack_len;
+	u32 i, j, mask, hit, hits_len;
+
+	bvh = &world->bvh;
+	hit = BVH_NONE;
+
+	if (bvh->wide_len == 0) {
+		return hit;
+	}
+
+	stack_len = 0;
+	stack[stack_len].child = 0;
+	stack[stack_len].count = 0;
+	stack[stack_len].t = 0;
+	stack_len++;
+
+	while (stack_len) {
+		e = stack[--stack_len];
+
+		if (e.t >= tmax) { // something closer was found since this was pushed
+			continue;
+		}
+
+		ray->nodes++;
+
+		if (e.count) {
+			hit = KERNEL(R_IntersectLeaf)(world, ray, e.child, e.count, &tmax, tuv, hit);
+			if (KERNEL_ANY && hit != BVH_NONE) {
+				return hit;
+			}
+			continue;
+		}
+
+		node = bvh->wide + e.child;
+		mask = R_IntersectWide(ray, node, tmax, dist);
+
+		// sort the children we hit far to near, so the nearest is popped first
+		for (hits_len = 0; mask; mask &= mask - 1) {
+			i = __builtin_ctz(mask);
+
+			for (j = hits_len; j > 0 && hits[j - 1].t < dist[i]; j--) {
+				hits[j] = hits[j - 1];
+			}
+
+			hits[j].child = node->child[i];
+			hits[j].count = node->count[i];
+			hits[j].t = dist[i];
+			hits_len++;
+		}
+
+		for (i = 0; i < hits_len; i++) {
+			stack[stack_len++] = hits[i];
+		}
+	}
+
+	return hit;
+}
+
+/* R_TraverseQuant : finds a triangle closer than tmax with the quantized BVH, returns its index */
+static u32 KERNEL(R_TraverseQuant)(struct world_t *world, struct ray_t *ray, vecf3_t tuv, f32 tmax)
+{
+	struct bvh_t *bvh;
+	struct bvhquant_t *node;
+	struct widestack_t stack[BVH_STACK * BVH_WIDTH];
+	struct widestack_t hits[BVH_WIDTH], e;
+	f32 dist[BVH_WIDTH];
+	s32 stack_len;
+	u32 i, j, mask, hit, ref, hits_len;
+
+	bvh = &world->bvh;
+	hit = BVH_NONE;
+
+	if (bvh->quant_len == 0) {
+		return hit;
+	}
+
+	stack_len = 0;
+	stack[stack_len].child = 0;
+	stack[stack_len].count = 0;
+	stack[stack_len].t = 0;
+	stack_len++;
+
+	while (stack_len) {
+		e = stack[--stack_len];
+
+		if (e.t >= tmax) {
+			continue;
+		}
+
+		ray->nodes++;
+
+		if (e.count) {
+			hit = KERNEL(R_IntersectLeaf)(world, ray, e.child, e.count, &tmax, tuv, hit);
+			if (KERNEL_ANY && hit != BVH_NONE) {
+				return hit;
+			}
+			continue;
+		}
+
+		node = bvh->quant + e.child;
+		mask = R_IntersectQuant(ray, node, tmax, dist);
+
+		for (hits_len = 0; mask; mask &= mask - 1) {
+			i = __builtin_ctz(mask);
+
+			for (j = hits_len; j > 0 && hits[j - 1].t < dist[i]; j--) {
+				hits[j] = hits[j - 1];
+			}
+
+			ref = node->child[i];
+			if (ref & BVH_LEAF) {
+				hits[j].child = ref & BVH_LEAFFIRST;
+				hits[j].count = BVH_LEAFCOUNT(ref);
+			} else {
+				hits[j].child = ref;
+				hits[j].count = 0;
+			}
+			hits[j].t = dist[i];
+			hits_len++;
+		}
+
+		for (i = 0; i < hits_len; i++) {
+			stack[stack_len++] = hits[i];
+		}
+	}
+
+	return hit;
+}
+
+/* R_TraverseBVH : finds a triangle closer than tmax with the binary BVH, returns its index */
+static u32 KERNEL(R_TraverseBVH)(struct world_t *world, struct ray_t *ray, vecf3_t tuv, f32 tmax)
+{
+	struct bvh_t *bvh;
+	struct bvhnode_t *node, *l, *r;
+	u32 stack[BVH_STACK];
+	s32 stack_len;
+	f32 tl, tr;
+	u32 hit;
+
+	bvh = &world->bvh;
+	hit = BVH_NONE;
+
+	if (bvh->nodes_len == 0) {
+		return hit;
+	}
+
+	if (R_IntersectAABB(ray, bvh->nodes[0].min, bvh->nodes[0].max, tmax) == FLT_MAX) {
+		return hit;
+	}
+
+	stack_len = 0;
+	node = bvh->nodes;
+
+	for (;;) {
+		ray->nodes++;
+
+		if (node->count) {
+			hit = KERNEL(R_IntersectLeaf)(world, ray, node->left, node->count, &tmax, tuv, hit);
+			if (KERNEL_ANY && hit != BVH_NONE) {
+				return hit;
+			}
+		} else {
+			// visit the nearer child first, and save the other for later
+			l = bvh->nodes + node->left;
+			r = l + 1;
+
+			tl = R_IntersectAABB(ray, l->min, l->max, tmax);
+			tr = R_IntersectAABB(ray, r->min, r->max, tmax);
+
+			if (tl > tr) {
+				SWAP(tl, tr);
+				SWAP(l, r);
+			}
+
+			if (tl != FLT_MAX) {
+				if (tr != FLT_MAX) {
+					stack[stack_len++] = r - bvh->nodes;
+				}
+				node = l;
+				continue;
+			}
+		}
+
+		if (stack_len == 0) {
+			break;
+		}
+
+		node = bvh->nodes + stack[--stack_len];
+	}
+
+	return hit;
+}
+
+#undef KERNEL
+#undef KERNEL_CULL
+#undef KERNEL_ANY
+#undef KERNEL_ISECT
+
@@ -0,0 +1,610 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Light Selection
+ *
+ * The tree builder is top-down and binned, like the BVH's SAH builder, but a
+ * split's cost weighs each side's surface area by its power, and by how wide
+ * its normal cone is. Both are a cheap stand-in for the orientation measure
+ * of Conty Estevez and Kulla; a side that's bright, large and facing every
+ * which way is the one that's hard to pick well from.
+ *
+ * Picking walks down from the root with a single random number, rescaling it
+ * into whichever child it picked, so it takes no more randomness than the
+ * uniform pick did.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "common.h"
+#include "math.h"
+#include "bray.h"
+#include "bvh.h"
+#include "light.h"
+
+#define L_ONEMINUS (0x1.fffffep-1f) // the largest float under 1
+
+struct lightcone_t { // the normals of some lights, either way along axis
+	vecf3_t axis;
+	f32 theta; // half angle, negative when there's nothing in it
+};
+
+struct lightref_t { // a light, while building
+	struct aabb_t box;
+	vecf3_t c;
+	struct lightcone_t cone;
+	f32 power;
+	u32 light;
+};
+
+struct lightbin_t {
+	struct aabb_t box;
+	struct lightcone_t cone;
+	f32 power;
+	u32 count;
+};
+
+struct lightsplit_t {
+	f32 cost;
+	s32 axis; // -1 when nothing beat leaving it alone
+	s32 bin;
+};
+
+/* L_Alias : builds the alias table over the lights' power */
+static int L_Alias(struct lights_t *lights);
+
+/* L_Subdivide : recursively splits the lights under a node */
+static void L_Subdivide(struct lights_t *lights, struct lightref_t *refs, u32 node, u32 first, u32 count);
+
+/* L_BestSplit : finds the cheapest binned split of the lights */
+static void L_BestSplit(struct lightref_t *refs, u32 count, struct aabb_t *cbox, struct lightsplit_t *split);
+
+/* L_SplitCost : cost of one side of a split */
+static f32 L_SplitCost(struct aabb_t *box, struct lightcone_t *cone, f32 power);
+
+/* L_ConeEmpty : sets up a cone with nothing in it */
+static void L_ConeEmpty(struct lightcone_t *cone);
+
+/* L_ConeUnion : grows the cone to take in the other one */
+static void L_ConeUnion(struct lightcone_t *cone, struct lightcone_t *other);
+
+/* L_Importance : how much the node's lights could light the shading point */
+static f32 L_Importance(struct lightnode_t *node, vecf3_t pos, vecf3_t n);
+
+/* L_Left : the chance of going left at an interior node */
+static f32 L_Left(struct lights_t *lights, u32 node, vecf3_t pos, vecf3_t n);
+
+/* L_Build : collects the emissive triangles, and builds what mode picks with */
+int L_Build(struct lights_t *lights, struct triangle_t *tris, u16 *mat, struct material_t *materials, size_t len)
+{
+	struct lightref_t *refs;
+	struct material_t *m;
+	vecf3_t e1, e2, cr;
+	f32 lum, area;
+	s32 mode;
+	size_t i, j;
+
+	mode = lights->mode;
+	L_Free(lights);
+	lights->mode = mode;
+
+	// an empty world is an empty set, which L_Sample and L_Pdf turn away
+	if (len == 0) {
+		return 0;
+	}
+
+	lights->slot = malloc(len * sizeof(*lights->slot));
+	lights->prims = malloc(len * sizeof(*lights->prims));
+	lights->power = malloc(len * sizeof(*lights->power));
+	lights->slot_len = len;
+
+	if (!lights->slot || !lights->prims || !lights->power) {
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		lights->slot[i] = BVH_NONE;
+
+		m = materials + mat[i];
+		lum = 0.2126f * m->emission[0] + 0.7152f * m->emission[1] + 0.0722f * m->emission[2];
+
+		Vec3Sub(e1, tris[i].b, tris[i].a);
+		Vec3Sub(e2, tris[i].c, tris[i].a);
+		Vec3Cross(cr, e1, e2);
+		area = 0.5f * sqrtf(Vec3Dot(cr, cr));
+
+		// slivers can't be sampled, and only darken the lights that can
+		if (lum > 0 && area > 0) {
+			lights->slot[i] = lights->len;
+			lights->prims[lights->len] = i;
+			lights->power[lights->len] = lum * area;
+			lights->total += lum * area;
+			lights->len++;
+		}
+	}
+
+	if (lights->len == 0) {
+		return 0;
+	}
+
+	if (L_Alias(lights) < 0) {
+		return -1;
+	}
+
+	// a leaf per light, so a full binary tree
+	lights->nodes = malloc((2 * lights->len - 1) * sizeof(*lights->nodes));
+	lights->leaf = malloc(lights->len * sizeof(*lights->leaf));
+	refs = malloc(lights->len * sizeof(*refs));
+
+	if (!lights->nodes || !lights->leaf || !refs) {
+		free(refs);
+		return -1;
+	}
+
+	for (i = 0; i < lights->len; i++) {
+		j = lights->prims[i];
+
+		AABB_Empty(&refs[i].box);
+		AABB_Grow(&refs[i].box, tris[j].a);
+		AABB_Grow(&refs[i].box, tris[j].b);
+		AABB_Grow(&refs[i].box, tris[j].c);
+		Vec3Add(refs[i].c, refs[i].box.min, refs[i].box.max);
+		Vec3Scale(refs[i].c, refs[i].c, 0.5f);
+
+		Vec3Sub(e1, tris[j].b, tris[j].a);
+		Vec3Sub(e2, tris[j].c, tris[j].a);
+		Vec3Cross(refs[i].cone.axis, e1, e2);
+		Vec3Norm(refs[i].cone.axis, refs[i].cone.axis);
+		refs[i].cone.theta = 0;
+
+		refs[i].power = lights->power[i];
+		refs[i].light = i;
+	}
+
+	lights->nodes_len = 1;
+	lights->nodes[0].parent = BVH_NONE;
+
+	L_Subdivide(lights, refs, 0, 0, lights->len);
+
+	free(refs);
+
+	return 0;
+}
+
+/* L_Alias : builds the alias table over the lights' power */
+static int L_Alias(struct lights_t *lights)
+{
+	u32 *work;
+	size_t small, large, i;
+	u32 a, b;
+
+	lights->prob = malloc(lights->len * sizeof(*lights->prob));
+	lights->alias = malloc(lights->len * sizeof(*lights->alias));
+	work = malloc(lights->len * sizeof(*work));
+
+	if (!lights->prob || !lights->alias || !work) {
+		free(work);
+		return -1;
+	}
+
+	// Vose's method: under-full bins stack up from the front, over-full ones
+	// from the back, and every under-full bin is topped up from an over-full one
+	small = 0;
+	large = lights->len;
+
+	for (i = 0; i < lights->len; i++) {
+		lights->prob[i] = lights->power[i] * lights->len / lights->total;
+		lights->alias[i] = i;
+
+		if (lights->prob[i] < 1) {
+			work[small++] = i;
+		} else {
+			work[--large] = i;
+		}
+	}
+
+	while (small > 0 && large < lights->len) {
+		a = work[--small];
+		b = work[large];
+
+		lights->alias[a] = b;
+		lights->prob[b] -= 1 - lights->prob[a];
+
+		if (lights->prob[b] < 1) {
+			work[small++] = b;
+			large++;
+		}
+	}
+
+	// whatever's left over is full, up to rounding
+	while (small > 0) {
+		lights->prob[work[--small]] = 1;
+	}
+
+	while (large < lights->len) {
+		lights->prob[work[large++]] = 1;
+	}
+
+	free(work);
+
+	return 0;
+}
+
+/* L_Subdivide : recursively splits the lights under a node */
+static void L_Subdivide(struct lights_t *lights, struct lightref_t *refs, u32 node, u32 first, u32 count)
+{
+	struct lightnode_t *n;
+	struct lightsplit_t split;
+	struct lightcone_t cone;
+	struct aabb_t box, cbox;
+	f32 power, scale;
+	u32 i, j, l;
+	s32 b;
+
+	AABB_Empty(&box);
+	AABB_Empty(&cbox);
+	L_ConeEmpty(&cone);
+	power = 0;
+
+	for (i = first; i < first + count; i++) {
+		AABB_Union(&box, &refs[i].box);
+		AABB_Grow(&cbox, refs[i].c);
+		L_ConeUnion(&cone, &refs[i].cone);
+		power += refs[i].power;
+	}
+
+	n = lights->nodes + node;
+	Vec3Copy(n->min, box.min);
+	Vec3Copy(n->max, box.max);
+	Vec3Copy(n->axis, cone.axis);
+	n->cos_o = cosf(cone.theta);
+	n->power = power;
+
+	if (count == 1) {
+		n->left = refs[first].light;
+		n->count = 1;
+		lights->leaf[refs[first].light] = node;
+		return;
+	}
+
+	L_BestSplit(refs + first, count, &cbox, &split);
+
+	// lights stacked on top of each other just get split down the middle
+	l = count / 2;
+
+	if (split.axis >= 0) {
+		scale = L_BINS / (cbox.max[split.axis] - cbox.min[split.axis]);
+
+		for (i = first, j = first + count; i < j;) {
+			b = MIN(L_BINS - 1, (s32)((refs[i].c[split.axis] - cbox.min[split.axis]) * scale));
+			if (b < split.bin) {
+				i++;
+			} else {
+				SWAP(refs[i], refs[j - 1]);
+				j--;
+			}
+		}
+
+		if (first < i && i < first + count) {
+			l = i - first;
+		}
+	}
+
+	i = lights->nodes_len;
+	lights->nodes_len += 2;
+
+	n->left = i;
+	n->count = 0;
+	lights->nodes[i + 0].parent = node;
+	lights->nodes[i + 1].parent = node;
+
+	L_Subdivide(lights, refs, i + 0, first, l);
+	L_Subdivide(lights, refs, i + 1, first + l, count - l);
+}
+
+/* L_BestSplit : finds the cheapest binned split of the lights */
+static void L_BestSplit(struct lightref_t *refs, u32 count, struct aabb_t *cbox, struct lightsplit_t *split)
+{
+	struct lightbin_t bins[L_BINS], lbins[L_BINS], rbin;
+	f32 cost, scale;
+	s32 axis, b;
+	u32 i;
+
+	split->cost = FLT_MAX;
+	split->axis = -1;
+
+	for (axis = 0; axis < 3; axis++) {
+		if (cbox->max[axis] - cbox->min[axis] <= 0) {
+			continue;
+		}
+
+		scale = L_BINS / (cbox->max[axis] - cbox->min[axis]);
+
+		for (b = 0; b < L_BINS; b++) {
+			AABB_Empty(&bins[b].box);
+			L_ConeEmpty(&bins[b].cone);
+			bins[b].power = 0;
+			bins[b].count = 0;
+		}
+
+		for (i = 0; i < count; i++) {
+			b = MIN(L_BINS - 1, (s32)((refs[i].c[axis] - cbox->min[axis]) * scale));
+			AABB_Union(&bins[b].box, &refs[i].box);
+			L_ConeUnion(&bins[b].cone, &refs[i].cone);
+			bins[b].power += refs[i].power;
+			bins[b].count++;
+		}
+
+		// everything in bins 0 through b, then sweep back from the right
+		for (b = 0; b < L_BINS - 1; b++) {
+			lbins[b] = bins[b];
+			if (b) {
+				AABB_Union(&lbins[b].box, &lbins[b - 1].box);
+				L_ConeUnion(&lbins[b].cone, &lbins[b - 1].cone);
+				lbins[b].power += lbins[b - 1].power;
+				lbins[b].count += lbins[b - 1].count;
+			}
+		}
+
+		rbin = bins[L_BINS - 1];
+		for (b = L_BINS - 1; b > 0; b--) {
+			if (b < L_BINS - 1) {
+				AABB_Union(&rbin.box, &bins[b].box);
+				L_ConeUnion(&rbin.cone, &bins[b].cone);
+				rbin.power += bins[b].power;
+				rbin.count += bins[b].count;
+			}
+
+			if (lbins[b - 1].count == 0 || rbin.count == 0) {
+				continue;
+			}
+
+			cost = L_SplitCost(&lbins[b - 1].box, &lbins[b - 1].cone, lbins[b - 1].power) +
+				L_SplitCost(&rbin.box, &rbin.cone, rbin.power);
+
+			if (cost < split->cost) {
+				split->cost = cost;
+				split->axis = axis;
+				split->bin = b;
+			}
+		}
+	}
+}
+
+/* L_SplitCost : cost of one side of a split */
+static f32 L_SplitCost(struct aabb_t *box, struct lightcone_t *cone, f32 power)
+{
+	return power * AABB_Area(box) * (1 + MAX(cone->theta, 0));
+}
+
+/* L_ConeEmpty : sets up a cone with nothing in it */
+static void L_ConeEmpty(struct lightcone_t *cone)
+{
+	Vec3(cone->axis, 0, 0, 1);
+	cone->theta = -1;
+}
+
+/* L_ConeUnion : grows the cone to take in the other one */
+static void L_ConeUnion(struct lightcone_t *cone, struct lightcone_t *other)
+{
+	vecf3_t axis, perp;
+	f32 d, theta_d, theta_o, r;
+	s32 k;
+
+	if (other->theta < 0) {
+		return;
+	}
+
+	if (cone->theta < 0) {
+		*cone = *other;
+		return;
+	}
+
+	// the cones bound lines, so flip the other axis onto this one's side
+	d = Vec3Dot(cone->axis, other->axis);
+	if (d < 0) {
+		Vec3Scale(axis, other->axis, -1);
+		d = -d;
+	} else {
+		Vec3Copy(axis, other->axis);
+	}
+
+	theta_d = acosf(MIN(d, 1));
+
+	if (theta_d + other->theta <= cone->theta) {
+		return;
+	}
+
+	if (theta_d + cone->theta <= other->theta) {
+		Vec3Copy(cone->axis, axis);
+		cone->theta = other->theta;
+		return;
+	}
+
+	// a hemisphere's worth of lines already covers every line
+	theta_o = 0.5f * (cone->theta + theta_d + other->theta);
+	if (theta_o >= M_PI / 2) {
+		cone->theta = M_PI / 2;
+		return;
+	}
+
+	// swing the axis toward the other, until both cones' far edges are inside
+	r = theta_o - cone->theta;
+	for (k = 0; k < 3; k++) {
+		perp[k] = axis[k] - d * cone->axis[k];
+	}
+	Vec3Norm(perp, perp);
+
+	for (k = 0; k < 3; k++) {
+		cone->axis[k] = cosf(r) * cone->axis[k] + sinf(r) * perp[k];
+	}
+	Vec3Norm(cone->axis, cone->axis);
+	cone->theta = theta_o;
+}
+
+/* L_Importance : how much the node's lights could light the shading point */
+static f32 L_Importance(struct lightnode_t *node, vecf3_t pos, vecf3_t n)
+{
+	vecf3_t d;
+	f32 dist2, r2, e, cos_u, sin_u, cos_o, sin_o, cos_b, sin_b;
+	f32 cos_e, sin_e, cos_r, sin_r;
+	s32 k;
+
+	// the box's bounding sphere, as seen from the point
+	for (k = 0, dist2 = 0, r2 = 0; k < 3; k++) {
+		d[k] = 0.5f * (node->min[k] + node->max[k]) - pos[k];
+		e = 0.5f * (node->max[k] - node->min[k]);
+		dist2 += d[k] * d[k];
+		r2 += e * e;
+	}
+
+	// inside it, the lights could be in any direction
+	if (dist2 <= r2) {
+		return node->power / MAX(r2, FLT_MIN);
+	}
+
+	Vec3Scale(d, d, (1.0f / sqrtf(dist2)));
+
+	sin_u = sqrtf(r2 / dist2);
+	cos_u = sqrtf(1 - r2 / dist2);
+
+	// at the lights, the angle off the cone's axis, less the cone and the sphere
+	cos_o = node->cos_o;
+	sin_o = sqrtf(MAX(0, 1 - cos_o * cos_o));
+	cos_b = cos_o * cos_u - sin_o * sin_u;
+	sin_b = sin_o * cos_u + cos_o * sin_u;
+
+	cos_e = fabsf(Vec3Dot(node->axis, d));
+	sin_e = sqrtf(MAX(0, 1 - cos_e * cos_e));
+	cos_e = cos_e < cos_b ? cos_e * cos_b + sin_e * sin_b : 1;
+
+	// at the point, the angle off its normal, less the sphere
+	cos_r = Vec3Dot(n, d);
+	sin_r = sqrtf(MAX(0, 1 - cos_r * cos_r));
+	cos_r = cos_r < cos_u ? cos_r * cos_u + sin_r * sin_u : 1;
+
+	if (cos_r <= 0) {
+		return 0;
+	}
+
+	return node->power * cos_e * cos_r / dist2;
+}
+
+/* L_Left : the chance of going left at an interior node */
+static f32 L_Left(struct lights_t *lights, u32 node, vecf3_t pos, vecf3_t n)
+{
+	struct lightnode_t *l, *r;
+	f32 il, ir;
+
+	l = lights->nodes + lights->nodes[node].left;
+	r = l + 1;
+
+	il = L_Importance(l, pos, n);
+	ir = L_Importance(r, pos, n);
+
+	// neither side can light the point, so it doesn't matter, but stay consistent
+	if (il + ir <= 0) {
+		il = l->power;
+		ir = r->power;
+	}
+
+	return il / (il + ir);
+}
+
+/* L_Sample : picks a light for the shading point, returns its triangle and the pick's probability, BVH_NONE if there are none */
+u32 L_Sample(struct lights_t *lights, vecf3_t pos, vecf3_t n, f32 u, f32 *pdf)
+{
+	f32 x, left;
+	u32 node, j;
+
+	if (lights->len == 0) {
+		*pdf = 0;
+		return BVH_NONE;
+	}
+
+	if (lights->mode == LIGHTS_UNIFORM) {
+		j = MIN((u32)(u * lights->len), lights->len - 1);
+		*pdf = 1.0f / lights->len;
+		return lights->prims[j];
+	}
+
+	if (lights->mode == LIGHTS_POWER) {
+		x = u * lights->len;
+		j = MIN((u32)x, lights->len - 1);
+		if (x - j >= lights->prob[j]) {
+			j = lights->alias[j];
+		}
+		*pdf = lights->power[j] / lights->total;
+		return lights->prims[j];
+	}
+
+	*pdf = 1;
+
+	for (node = 0; lights->nodes[node].count == 0;) {
+		left = L_Left(lights, node, pos, n);
+
+		if (u < left) {
+			u = u / left;
+			*pdf *= left;
+			node = lights->nodes[node].left;
+		} else {
+			u = (u - left) / (1 - left);
+			*pdf *= 1 - left;
+			node = lights->nodes[node].left + 1;
+		}
+
+		u = MIN(u, L_ONEMINUS);
+	}
+
+	return lights->prims[lights->nodes[node].left];
+}
+
+/* L_Pdf : the probability L_Sample picks the triangle, for the shading point */
+f32 L_Pdf(struct lights_t *lights, vecf3_t pos, vecf3_t n, u32 prim)
+{
+	f32 pdf, left;
+	u32 node, parent, j;
+
+	if (lights->len == 0 || prim >= lights->slot_len || lights->slot[prim] == BVH_NONE) {
+		return 0;
+	}
+
+	j = lights->slot[prim];
+
+	if (lights->mode == LIGHTS_UNIFORM) {
+		return 1.0f / lights->len;
+	}
+
+	if (lights->mode == LIGHTS_POWER) {
+		return lights->power[j] / lights->total;
+	}
+
+	pdf = 1;
+
+	for (node = lights->leaf[j]; (parent = lights->nodes[node].parent) != BVH_NONE; node = parent) {
+		left = L_Left(lights, parent, pos, n);
+		pdf *= node == lights->nodes[parent].left ? left : 1 - left;
+	}
+
+	return pdf;
+}
+
+/* L_Free : frees the lights */
+void L_Free(struct lights_t *lights)
+{
+	if (lights) {
+		free(lights->prims);
+		free(lights->power);
+		free(lights->slot);
+		free(lights->prob);
+		free(lights->alias);
+		free(lights->nodes);
+		free(lights->leaf);
+		memset(lights, 0, sizeof(*lights));
+	}
+}
+
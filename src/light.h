@@ -0,0 +1,96 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Light Selection
+ *
+ * Next event estimation first has to pick one of the emissive triangles, and
+ * with thousands of them a uniform pick almost always lands on one that's far
+ * away, facing the wrong way, or dim. There are three ways to pick, set with
+ * lights_t::mode:
+ *
+ *   LIGHTS_UNIFORM - every light alike, the baseline
+ *   LIGHTS_POWER   - in proportion to emitted power, through an alias table
+ *                    (Walker 1977, Vose 1991) so the pick is O(1)
+ *   LIGHTS_TREE    - down a hierarchy over the lights (Conty Estevez and
+ *                    Kulla 2018), choosing between the two children of every
+ *                    node by an estimate of how much they could light the
+ *                    shading point
+ *
+ * The tree is laid out like the BVH's, a flat array with the children of an
+ * interior node as a pair at left and left + 1. Every node bounds its lights'
+ * positions with a box and their normals with a cone, and sums their power.
+ * A node's importance is its power over the squared distance, times the
+ * cosines at the emitter and the receiver, each widened as far as the box
+ * and cone allow. That bound is conservative, so a node with none can't light
+ * the point at all. Emission is two sided, so the cones are too: they bound
+ * the lines the normals lie along, never wider than a hemisphere.
+ *
+ * Every leaf holds a single light, so the probability of having picked any
+ * given light is exact: L_Pdf walks from its leaf up to the root, multiplying
+ * together the chances of each turn, which is what MIS needs when a bounce
+ * lands on a light by itself.
+ */
+
+#include "common.h"
+#include "math.h"
+
+#define L_BINS (12) // split candidates per axis for the tree builder
+
+struct triangle_t;
+struct material_t;
+
+enum {
+	LIGHTS_UNIFORM,
+	LIGHTS_POWER,
+	LIGHTS_TREE,
+	LIGHTS_TOTAL
+};
+
+struct lightnode_t {
+	vecf3_t min;
+	u32 left;     // interior: left child (right is left + 1), leaf: the light
+	vecf3_t max;
+	u32 count;    // leaf: 1, interior: 0
+	vecf3_t axis; // normal cone, along either direction
+	f32 cos_o;    // cosine of the cone's half angle
+	f32 power;    // of every light underneath
+	u32 parent;   // BVH_NONE for the root
+};
+
+struct lights_t {
+	u32 *prims;   // the emissive triangles
+	f32 *power;   // per light, luminance times area
+	size_t len;
+	f64 total;    // power of every light together
+
+	u32 *slot;    // per triangle, its light, or BVH_NONE if it doesn't emit
+	size_t slot_len;
+
+	f32 *prob;    // alias table, the chance of keeping bin i over alias[i]
+	u32 *alias;
+
+	struct lightnode_t *nodes; // the tree, root at 0
+	u32 *leaf;    // per light, its leaf node
+	size_t nodes_len;
+
+	s32 mode;     // LIGHTS_*
+};
+
+/* L_Build : collects the emissive triangles, and builds what mode picks with */
+int L_Build(struct lights_t *lights, struct triangle_t *tris, u16 *mat, struct material_t *materials, size_t len);
+
+/* L_Sample : picks a light for the shading point, returns its triangle and the pick's probability, BVH_NONE if there are none */
+u32 L_Sample(struct lights_t *lights, vecf3_t pos, vecf3_t n, f32 u, f32 *pdf);
+
+/* L_Pdf : the probability L_Sample picks the triangle, for the shading point */
+f32 L_Pdf(struct lights_t *lights, vecf3_t pos, vecf3_t n, u32 prim);
+
+/* L_Free : frees the lights */
+void L_Free(struct lights_t *lights);
+
+#endif // LIGHT_H
+
@@ -17,12 +17,239 @@
 /* Vecf3Norm : normalize a vec3_t */
 void Vec3Norm(vecf3_t out, vecf3_t in)
 {
-	f32 m;
+	f32 r;
 
-	m = sqrt(in[0] * in[0] + in[1] * in[1] + in[2] * in[2]);
+	r = F_Rsqrt(Vec3Dot(in, in));
 
-	out[0] /= m;
-	out[1] /= m;
-	out[2] /= m;
+	Vec3Scale(out, in, r);
+}
+
+/* Vec3NormFast : normalize a vec3_t, with the approximate rsqrt */
+void Vec3NormFast(vecf3_t out, vecf3_t in)
+{
+	f32 r;
+
+	r = F_RsqrtFast(Vec3Dot(in, in));
+
+	Vec3Scale(out, in, r);
+}
+
+/* Vec3Basis : two unit vectors that make an orthonormal basis with unit n */
+void Vec3Basis(vecf3_t t, vecf3_t b, vecf3_t n)
+{
+	f32 sign, a, c;
+
+	// Duff et al. 2017, no branches and no normalizing
+	sign = copysignf(1.0f, n[2]);
+	a = -1.0f / (sign + n[2]);
+	c = n[0] * n[1] * a;
+
+	Vec3(t, 1.0f + sign * n[0] * n[0] * a, sign * c, -sign * n[0]);
+	Vec3(b, c, sign + n[1] * n[1] * a, -n[1]);
+}
+
+/* Vec3OctEncode : packs unit n into 32 bits, 16 per axis of its octahedral map */
+u32 Vec3OctEncode(vecf3_t n)
+{
+	f32 l, x, y, t;
+	s32 qx, qy;
+
+	// Cigolle et al. 2014, project onto the octahedron, fold the lower half over
+	// the upper one's corners, and keep x, y as signed 16 bit fractions
+	l = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	if (l <= 0) {
+		return 0;
+	}
+
+	x = n[0] / l;
+	y = n[1] / l;
+
+	if (n[2] < 0) {
+		t = x;
+		x = (1 - fabsf(y)) * (t < 0 ? -1 : 1);
+		y = (1 - fabsf(t)) * (y < 0 ? -1 : 1);
+	}
+
+	qx = lrintf(MIN(MAX(x, -1), 1) * 32767);
+	qy = lrintf(MIN(MAX(y, -1), 1) * 32767);
+
+	return (u32)(u16)qx | (u32)(u16)qy << 16;
+}
+
+/* Vec3OctDecode : unpacks a unit vector from Vec3OctEncode */
+void Vec3OctDecode(vecf3_t out, u32 oct)
+{
+	f32 x, y, z, t;
+
+	x = (s16)(oct & 0xffff) * (1.0f / 32767);
+	y = (s16)(oct >> 16) * (1.0f / 32767);
+	z = 1 - fabsf(x) - fabsf(y);
+
+	if (z < 0) {
+		t = x;
+		x = (1 - fabsf(y)) * (t < 0 ? -1 : 1);
+		y = (1 - fabsf(t)) * (y < 0 ? -1 : 1);
+	}
+
+	Vec3(out, x, y, z);
+	Vec3Norm(out, out);
+}
+
+/* F_Rsqrt : 1 / sqrt(x) */
+f32 F_Rsqrt(f32 x)
+{
+	return 1.0f / sqrtf(x);
+}
+
+/* F_RsqrtFast : 1 / sqrt(x), from the hardware estimate */
+f32 F_RsqrtFast(f32 x)
+{
+	return F4_Lane0(F4_RsqrtFast(F4_Set1(x)));
+}
+
+/* M4_Identity : the identity matrix */
+mat4_t M4_Identity(void)
+{
+	mat4_t m;
+
+	m.r[0] = F4_Set(1, 0, 0, 0);
+	m.r[1] = F4_Set(0, 1, 0, 0);
+	m.r[2] = F4_Set(0, 0, 1, 0);
+	m.r[3] = F4_Set(0, 0, 0, 1);
+
+	return m;
+}
+
+/* M4_Mul : a * b */
+mat4_t M4_Mul(mat4_t a, mat4_t b)
+{
+	mat4_t m;
+	f32 f[4] __attribute__((aligned(16)));
+	s32 i;
+
+	// each row of the result is a's row weighting b's rows
+	for (i = 0; i < 4; i++) {
+		F4_Store(f, a.r[i]);
+		m.r[i] = F4_Mul(F4_Set1(f[0]), b.r[0]);
+		m.r[i] = F4_Add(m.r[i], F4_Mul(F4_Set1(f[1]), b.r[1]));
+		m.r[i] = F4_Add(m.r[i], F4_Mul(F4_Set1(f[2]), b.r[2]));
+		m.r[i] = F4_Add(m.r[i], F4_Mul(F4_Set1(f[3]), b.r[3]));
+	}
+
+	return m;
+}
+
+/* M4_Transpose : swaps rows and columns */
+mat4_t M4_Transpose(mat4_t m)
+{
+	f32 f[4][4] __attribute__((aligned(16)));
+	s32 i;
+
+	for (i = 0; i < 4; i++) {
+		F4_Store(f[i], m.r[i]);
+	}
+
+	for (i = 0; i < 4; i++) {
+		m.r[i] = F4_Set(f[0][i], f[1][i], f[2][i], f[3][i]);
+	}
+
+	return m;
+}
+
+/* M4_InverseAffine : inverts a rotation, scale and translation, ignoring the last row */
+mat4_t M4_InverseAffine(mat4_t m)
+{
+	mat4_t inv;
+	vecf3_t c[3], t;
+	f32 f[3][4] __attribute__((aligned(16)));
+	f32 det;
+	s32 i;
+
+	for (i = 0; i < 3; i++) {
+		F4_Store(f[i], m.r[i]);
+	}
+
+	// the rows of the inverse 3x3 are the cross products of the columns
+	for (i = 0; i < 3; i++) {
+		Vec3(c[i], f[0][i], f[1][i], f[2][i]);
+	}
+
+	Vec3(t, f[0][3], f[1][3], f[2][3]);
+
+	Vec3Cross(f[0], c[1], c[2]);
+	Vec3Cross(f[1], c[2], c[0]);
+	Vec3Cross(f[2], c[0], c[1]);
+
+	det = 1.0f / Vec3Dot(c[0], f[0]);
+
+	for (i = 0; i < 3; i++) {
+		Vec3Scale(f[i], f[i], det);
+		f[i][3] = -Vec3Dot(f[i], t);
+		inv.r[i] = F4_Load(f[i]);
+	}
+
+	inv.r[3] = F4_Set(0, 0, 0, 1);
+
+	return inv;
+}
+
+/* M4_LookAt : camera to world transform, looking down -z from pos at target */
+mat4_t M4_LookAt(vecf3_t pos, vecf3_t target, vecf3_t up)
+{
+	vecf3_t x, y, z;
+	mat4_t m;
+
+	// z points back at the eye, and y points down, so row 0 of an image is the top
+	Vec3Sub(z, pos, target);
+	Vec3Norm(z, z);
+	Vec3Cross(x, up, z);
+	Vec3Norm(x, x);
+	Vec3Cross(y, x, z);
+
+	m.r[0] = F4_Set(x[0], y[0], z[0], pos[0]);
+	m.r[1] = F4_Set(x[1], y[1], z[1], pos[1]);
+	m.r[2] = F4_Set(x[2], y[2], z[2], pos[2]);
+	m.r[3] = F4_Set(0, 0, 0, 1);
+
+	return m;
+}
+
+/* M4_Translate : a translation */
+mat4_t M4_Translate(vecf3_t t)
+{
+	mat4_t m;
+
+	m = M4_Identity();
+	m.r[0] = F4_Set(1, 0, 0, t[0]);
+	m.r[1] = F4_Set(0, 1, 0, t[1]);
+	m.r[2] = F4_Set(0, 0, 1, t[2]);
+
+	return m;
+}
+
+/* M4_Scale : a scale along each axis */
+mat4_t M4_Scale(vecf3_t s)
+{
+	mat4_t m;
+
+	m = M4_Identity();
+	m.r[0] = F4_Set(s[0], 0, 0, 0);
+	m.r[1] = F4_Set(0, s[1], 0, 0);
+	m.r[2] = F4_Set(0, 0, s[2], 0);
+
+	return m;
+}
+
+/* M4_Column : pulls out column c's x, y and z */
+void M4_Column(vecf3_t out, mat4_t *m, s32 c)
+{
+	f32 f[3][4] __attribute__((aligned(16)));
+	s32 i;
+
+	for (i = 0; i < 3; i++) {
+		F4_Store(f[i], m->r[i]);
+	}
+
+	Vec3(out, f[0][c], f[1][c], f[2][c]);
 }
 
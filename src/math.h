@@ -7,14 +7,40 @@
  *
  * Brian's Math Library
  *
+ * The Vec3 macros work on plain vecf3_t arrays, and are what everything
+ * outside of the hot loops uses.
+ *
+ * The hot loops use the SIMD types instead, all static inline so they
+ * compile down to the bare instructions:
+ *
+ *   f32x4_t   - four floats, one SSE register
+ *   f32x8_t   - eight floats, one AVX register, or a pair of f32x4_t
+ *   vec3x4_t  - four vectors, SoA, one f32x4_t per axis
+ *   vec3x8_t  - eight vectors, SoA, one f32x8_t per axis
+ *   vec4_t    - an aligned x, y, z, w vector, in an f32x4_t
+ *   mat4_t    - an aligned row major 4x4 matrix, a vec4_t per row
+ *
+ * Without SSE, f32x4_t falls back to four plain floats, so the same code
+ * still builds anywhere, just slower.
+ *
+ * Anything ending in Fast trades accuracy for speed: the reciprocal square
+ * roots are the hardware estimate plus one Newton-Raphson step, good to
+ * about 23 bits. F4_Exp and F8_Exp are a polynomial, good to a few ulps.
+ * The others are exact.
+ *
  * TODO (brian)
  * 1. organize the typedefs for vectors and matricies
  */
 
 #include "common.h"
 
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
 #define MAX(x,y)    ((x) > (y) ? (x) : (y))
 #define MIN(x,y)    ((x) < (y) ? (x) : (y))
+#define CLAMP(x,a,b) (MIN(MAX((x),(a)),(b)))
 
 typedef f32 vecf_t;
 typedef vecf_t vecf2_t [2];
@@ -36,9 +62,491 @@ typedef veci_t veci4_t [4];
 #define Vec3(d,a,b,c)  (d[0]=(a),d[1]=(b),d[2]=(c))
 #define Vec3Scale(d,v,s) ((d)[0]=(v)[0]*s,(d)[1]=(v)[1]*s,(d)[2]=(v)[2]*s)
 #define Vec3Copy(d,v)  ((d)[0]=(v)[0],(d)[1]=(v)[1],(d)[2]=(v)[2])
+#define Vec3Lerp(d,a,b,t) \
+	((d)[0]=(a)[0]+((b)[0]-(a)[0])*(t),\
+	 (d)[1]=(a)[1]+((b)[1]-(a)[1])*(t),\
+	 (d)[2]=(a)[2]+((b)[2]-(a)[2])*(t))
 
 /* Vecf3Norm : normalize a vec3_t */
 void Vec3Norm(vecf3_t out, vecf3_t in);
 
+/* Vec3NormFast : normalize a vec3_t, with the approximate rsqrt */
+void Vec3NormFast(vecf3_t out, vecf3_t in);
+
+/* Vec3Basis : two unit vectors that make an orthonormal basis with unit n */
+void Vec3Basis(vecf3_t t, vecf3_t b, vecf3_t n);
+
+/* Vec3OctEncode : packs unit n into 32 bits, 16 per axis of its octahedral map */
+u32 Vec3OctEncode(vecf3_t n);
+
+/* Vec3OctDecode : unpacks a unit vector from Vec3OctEncode */
+void Vec3OctDecode(vecf3_t out, u32 oct);
+
+/* F_Rsqrt : 1 / sqrt(x) */
+f32 F_Rsqrt(f32 x);
+
+/* F_RsqrtFast : 1 / sqrt(x), from the hardware estimate */
+f32 F_RsqrtFast(f32 x);
+
+// f32x4_t
+#if defined(__SSE__)
+typedef __m128 f32x4_t;
+
+static inline f32x4_t F4_Set1(f32 x)               { return _mm_set1_ps(x); }
+static inline f32x4_t F4_Set(f32 a, f32 b, f32 c, f32 d) { return _mm_setr_ps(a, b, c, d); }
+static inline f32x4_t F4_Zero(void)                { return _mm_setzero_ps(); }
+static inline f32x4_t F4_Load(f32 *p)              { return _mm_load_ps(p); }
+static inline f32x4_t F4_LoadU(f32 *p)             { return _mm_loadu_ps(p); }
+static inline void    F4_Store(f32 *p, f32x4_t a)  { _mm_store_ps(p, a); }
+static inline void    F4_StoreU(f32 *p, f32x4_t a) { _mm_storeu_ps(p, a); }
+static inline f32x4_t F4_Add(f32x4_t a, f32x4_t b) { return _mm_add_ps(a, b); }
+static inline f32x4_t F4_Sub(f32x4_t a, f32x4_t b) { return _mm_sub_ps(a, b); }
+static inline f32x4_t F4_Mul(f32x4_t a, f32x4_t b) { return _mm_mul_ps(a, b); }
+static inline f32x4_t F4_Div(f32x4_t a, f32x4_t b) { return _mm_div_ps(a, b); }
+static inline f32x4_t F4_Min(f32x4_t a, f32x4_t b) { return _mm_min_ps(a, b); }
+static inline f32x4_t F4_Max(f32x4_t a, f32x4_t b) { return _mm_max_ps(a, b); }
+static inline f32x4_t F4_Sqrt(f32x4_t a)           { return _mm_sqrt_ps(a); }
+static inline f32x4_t F4_RsqrtEst(f32x4_t a)       { return _mm_rsqrt_ps(a); }
+static inline f32x4_t F4_And(f32x4_t a, f32x4_t b) { return _mm_and_ps(a, b); }
+static inline f32x4_t F4_Or(f32x4_t a, f32x4_t b)  { return _mm_or_ps(a, b); }
+static inline f32x4_t F4_AndNot(f32x4_t a, f32x4_t b) { return _mm_andnot_ps(a, b); }
+static inline f32x4_t F4_CmpLT(f32x4_t a, f32x4_t b) { return _mm_cmplt_ps(a, b); }
+static inline f32x4_t F4_CmpLE(f32x4_t a, f32x4_t b) { return _mm_cmple_ps(a, b); }
+static inline f32x4_t F4_CmpGT(f32x4_t a, f32x4_t b) { return _mm_cmpgt_ps(a, b); }
+static inline f32x4_t F4_CmpGE(f32x4_t a, f32x4_t b) { return _mm_cmpge_ps(a, b); }
+static inline f32x4_t F4_CmpEQ(f32x4_t a, f32x4_t b) { return _mm_cmpeq_ps(a, b); }
+static inline f32x4_t F4_CmpNE(f32x4_t a, f32x4_t b) { return _mm_cmpneq_ps(a, b); }
+static inline u32     F4_Mask(f32x4_t a)           { return _mm_movemask_ps(a); }
+static inline f32     F4_Lane0(f32x4_t a)          { return _mm_cvtss_f32(a); }
+#else
+#include <string.h>
+
+typedef struct { f32 f[4]; } f32x4_t;
+
+#define F4_LANES(expr) \
+	f32x4_t r; s32 i; for (i = 0; i < 4; i++) { r.f[i] = (expr); } return r
+
+#define F4_CMP(op) \
+	f32x4_t r; s32 i; for (i = 0; i < 4; i++) { \
+		u32 m = a.f[i] op b.f[i] ? 0xffffffff : 0; memcpy(r.f + i, &m, 4); \
+	} return r
+
+#define F4_BITS(op) \
+	f32x4_t r; u32 x, y; s32 i; for (i = 0; i < 4; i++) { \
+		memcpy(&x, a.f + i, 4); memcpy(&y, b.f + i, 4); x = op; memcpy(r.f + i, &x, 4); \
+	} return r
+
+static inline f32x4_t F4_Set1(f32 x)               { F4_LANES(x); }
+static inline f32x4_t F4_Set(f32 a, f32 b, f32 c, f32 d) { f32x4_t r = { { a, b, c, d } }; return r; }
+static inline f32x4_t F4_Zero(void)                { F4_LANES(0); }
+static inline f32x4_t F4_Load(f32 *p)              { F4_LANES(p[i]); }
+static inline f32x4_t F4_LoadU(f32 *p)             { F4_LANES(p[i]); }
+static inline void    F4_Store(f32 *p, f32x4_t a)  { memcpy(p, a.f, sizeof(a.f)); }
+static inline void    F4_StoreU(f32 *p, f32x4_t a) { memcpy(p, a.f, sizeof(a.f)); }
+static inline f32x4_t F4_Add(f32x4_t a, f32x4_t b) { F4_LANES(a.f[i] + b.f[i]); }
+static inline f32x4_t F4_Sub(f32x4_t a, f32x4_t b) { F4_LANES(a.f[i] - b.f[i]); }
+static inline f32x4_t F4_Mul(f32x4_t a, f32x4_t b) { F4_LANES(a.f[i] * b.f[i]); }
+static inline f32x4_t F4_Div(f32x4_t a, f32x4_t b) { F4_LANES(a.f[i] / b.f[i]); }
+static inline f32x4_t F4_Min(f32x4_t a, f32x4_t b) { F4_LANES(a.f[i] < b.f[i] ? a.f[i] : b.f[i]); }
+static inline f32x4_t F4_Max(f32x4_t a, f32x4_t b) { F4_LANES(a.f[i] > b.f[i] ? a.f[i] : b.f[i]); }
+static inline f32x4_t F4_Sqrt(f32x4_t a)           { F4_LANES(__builtin_sqrtf(a.f[i])); }
+static inline f32x4_t F4_RsqrtEst(f32x4_t a)       { F4_LANES(1 / __builtin_sqrtf(a.f[i])); }
+static inline f32x4_t F4_And(f32x4_t a, f32x4_t b) { F4_BITS(x & y); }
+static inline f32x4_t F4_Or(f32x4_t a, f32x4_t b)  { F4_BITS(x | y); }
+static inline f32x4_t F4_AndNot(f32x4_t a, f32x4_t b) { F4_BITS(~x & y); }
+static inline f32x4_t F4_CmpLT(f32x4_t a, f32x4_t b) { F4_CMP(<); }
+static inline f32x4_t F4_CmpLE(f32x4_t a, f32x4_t b) { F4_CMP(<=); }
+static inline f32x4_t F4_CmpGT(f32x4_t a, f32x4_t b) { F4_CMP(>); }
+static inline f32x4_t F4_CmpGE(f32x4_t a, f32x4_t b) { F4_CMP(>=); }
+static inline f32x4_t F4_CmpEQ(f32x4_t a, f32x4_t b) { F4_CMP(==); }
+static inline f32x4_t F4_CmpNE(f32x4_t a, f32x4_t b) { F4_CMP(!=); }
+static inline f32     F4_Lane0(f32x4_t a)          { return a.f[0]; }
+
+static inline u32 F4_Mask(f32x4_t a)
+{
+	u32 x, m; s32 i;
+	for (i = 0, m = 0; i < 4; i++) { memcpy(&x, a.f + i, 4); m |= (x >> 31) << i; }
+	return m;
+}
+
+#undef F4_LANES
+#undef F4_CMP
+#undef F4_BITS
+#endif
+
+/* F4_Select : picks a where the mask is set, b where it isn't */
+static inline f32x4_t F4_Select(f32x4_t mask, f32x4_t a, f32x4_t b)
+{
+	return F4_Or(F4_And(mask, a), F4_AndNot(mask, b));
+}
+
+/* F4_Rsqrt : 1 / sqrt(a) */
+static inline f32x4_t F4_Rsqrt(f32x4_t a)
+{
+	return F4_Div(F4_Set1(1), F4_Sqrt(a));
+}
+
+/* F4_RsqrtFast : 1 / sqrt(a), the estimate refined by one Newton-Raphson step */
+static inline f32x4_t F4_RsqrtFast(f32x4_t a)
+{
+	f32x4_t r;
+
+	r = F4_RsqrtEst(a);
+	return F4_Mul(F4_Mul(F4_Set1(0.5f), r), F4_Sub(F4_Set1(3), F4_Mul(a, F4_Mul(r, r))));
+}
+
+/* F4_Exp : e^a, to about single precision, clamped to normal floats */
+static inline f32x4_t F4_Exp(f32x4_t a)
+{
+#if defined(__SSE2__)
+	__m128i n;
+	f32x4_t t, f, p;
+
+	// 2^t, split into 2^n, straight into the exponent bits, times 2^f for |f| <= 1/2
+	t = F4_Mul(F4_Min(F4_Max(a, F4_Set1(-87.0f)), F4_Set1(88.0f)), F4_Set1(1.44269504f));
+	n = _mm_cvtps_epi32(t);
+	f = F4_Sub(t, _mm_cvtepi32_ps(n));
+
+	// taylor series of 2^f, (f ln 2)^k / k!
+	p = F4_Set1(1.5403530e-4f);
+	p = F4_Add(F4_Mul(p, f), F4_Set1(1.3333558e-3f));
+	p = F4_Add(F4_Mul(p, f), F4_Set1(9.6181291e-3f));
+	p = F4_Add(F4_Mul(p, f), F4_Set1(5.5504109e-2f));
+	p = F4_Add(F4_Mul(p, f), F4_Set1(2.4022651e-1f));
+	p = F4_Add(F4_Mul(p, f), F4_Set1(6.9314718e-1f));
+	p = F4_Add(F4_Mul(p, f), F4_Set1(1));
+
+	return F4_Mul(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+#else
+	f32 f[4];
+	s32 i;
+
+	F4_StoreU(f, a);
+	for (i = 0; i < 4; i++) {
+		f[i] = __builtin_expf(f[i]);
+	}
+	return F4_LoadU(f);
+#endif
+}
+
+// f32x8_t
+#if defined(__AVX__)
+typedef __m256 f32x8_t;
+
+static inline f32x8_t F8_Set1(f32 x)               { return _mm256_set1_ps(x); }
+static inline f32x8_t F8_Set(f32 a, f32 b, f32 c, f32 d, f32 e, f32 f, f32 g, f32 h) { return _mm256_setr_ps(a, b, c, d, e, f, g, h); }
+static inline f32x8_t F8_Zero(void)                { return _mm256_setzero_ps(); }
+static inline f32x8_t F8_Load(f32 *p)              { return _mm256_load_ps(p); }
+static inline f32x8_t F8_LoadU(f32 *p)             { return _mm256_loadu_ps(p); }
+static inline void    F8_Store(f32 *p, f32x8_t a)  { _mm256_store_ps(p, a); }
+static inline void    F8_StoreU(f32 *p, f32x8_t a) { _mm256_storeu_ps(p, a); }
+static inline f32x8_t F8_Add(f32x8_t a, f32x8_t b) { return _mm256_add_ps(a, b); }
+static inline f32x8_t F8_Sub(f32x8_t a, f32x8_t b) { return _mm256_sub_ps(a, b); }
+static inline f32x8_t F8_Mul(f32x8_t a, f32x8_t b) { return _mm256_mul_ps(a, b); }
+static inline f32x8_t F8_Div(f32x8_t a, f32x8_t b) { return _mm256_div_ps(a, b); }
+static inline f32x8_t F8_Min(f32x8_t a, f32x8_t b) { return _mm256_min_ps(a, b); }
+static inline f32x8_t F8_Max(f32x8_t a, f32x8_t b) { return _mm256_max_ps(a, b); }
+static inline f32x8_t F8_Sqrt(f32x8_t a)           { return _mm256_sqrt_ps(a); }
+static inline f32x8_t F8_RsqrtEst(f32x8_t a)       { return _mm256_rsqrt_ps(a); }
+static inline f32x8_t F8_And(f32x8_t a, f32x8_t b) { return _mm256_and_ps(a, b); }
+static inline f32x8_t F8_Or(f32x8_t a, f32x8_t b)  { return _mm256_or_ps(a, b); }
+static inline f32x8_t F8_AndNot(f32x8_t a, f32x8_t b) { return _mm256_andnot_ps(a, b); }
+static inline f32x8_t F8_CmpLT(f32x8_t a, f32x8_t b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline f32x8_t F8_CmpLE(f32x8_t a, f32x8_t b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline f32x8_t F8_CmpGT(f32x8_t a, f32x8_t b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline f32x8_t F8_CmpGE(f32x8_t a, f32x8_t b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline f32x8_t F8_CmpEQ(f32x8_t a, f32x8_t b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline f32x8_t F8_CmpNE(f32x8_t a, f32x8_t b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+static inline u32     F8_Mask(f32x8_t a)           { return _mm256_movemask_ps(a); }
+#else
+typedef struct { f32x4_t lo, hi; } f32x8_t;
+
+static inline f32x8_t F8_Set1(f32 x)               { f32x8_t r; r.lo = r.hi = F4_Set1(x); return r; }
+static inline f32x8_t F8_Set(f32 a, f32 b, f32 c, f32 d, f32 e, f32 f, f32 g, f32 h) { f32x8_t r; r.lo = F4_Set(a, b, c, d); r.hi = F4_Set(e, f, g, h); return r; }
+static inline f32x8_t F8_Zero(void)                { f32x8_t r; r.lo = r.hi = F4_Zero(); return r; }
+static inline f32x8_t F8_Load(f32 *p)              { f32x8_t r; r.lo = F4_Load(p); r.hi = F4_Load(p + 4); return r; }
+static inline f32x8_t F8_LoadU(f32 *p)             { f32x8_t r; r.lo = F4_LoadU(p); r.hi = F4_LoadU(p + 4); return r; }
+static inline void    F8_Store(f32 *p, f32x8_t a)  { F4_Store(p, a.lo); F4_Store(p + 4, a.hi); }
+static inline void    F8_StoreU(f32 *p, f32x8_t a) { F4_StoreU(p, a.lo); F4_StoreU(p + 4, a.hi); }
+static inline f32x8_t F8_Add(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_Add(a.lo, b.lo); r.hi = F4_Add(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Sub(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_Sub(a.lo, b.lo); r.hi = F4_Sub(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Mul(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_Mul(a.lo, b.lo); r.hi = F4_Mul(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Div(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_Div(a.lo, b.lo); r.hi = F4_Div(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Min(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_Min(a.lo, b.lo); r.hi = F4_Min(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Max(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_Max(a.lo, b.lo); r.hi = F4_Max(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Sqrt(f32x8_t a)           { f32x8_t r; r.lo = F4_Sqrt(a.lo); r.hi = F4_Sqrt(a.hi); return r; }
+static inline f32x8_t F8_RsqrtEst(f32x8_t a)       { f32x8_t r; r.lo = F4_RsqrtEst(a.lo); r.hi = F4_RsqrtEst(a.hi); return r; }
+static inline f32x8_t F8_And(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_And(a.lo, b.lo); r.hi = F4_And(a.hi, b.hi); return r; }
+static inline f32x8_t F8_Or(f32x8_t a, f32x8_t b)  { f32x8_t r; r.lo = F4_Or(a.lo, b.lo); r.hi = F4_Or(a.hi, b.hi); return r; }
+static inline f32x8_t F8_AndNot(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_AndNot(a.lo, b.lo); r.hi = F4_AndNot(a.hi, b.hi); return r; }
+static inline f32x8_t F8_CmpLT(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_CmpLT(a.lo, b.lo); r.hi = F4_CmpLT(a.hi, b.hi); return r; }
+static inline f32x8_t F8_CmpLE(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_CmpLE(a.lo, b.lo); r.hi = F4_CmpLE(a.hi, b.hi); return r; }
+static inline f32x8_t F8_CmpGT(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_CmpGT(a.lo, b.lo); r.hi = F4_CmpGT(a.hi, b.hi); return r; }
+static inline f32x8_t F8_CmpGE(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_CmpGE(a.lo, b.lo); r.hi = F4_CmpGE(a.hi, b.hi); return r; }
+static inline f32x8_t F8_CmpEQ(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_CmpEQ(a.lo, b.lo); r.hi = F4_CmpEQ(a.hi, b.hi); return r; }
+static inline f32x8_t F8_CmpNE(f32x8_t a, f32x8_t b) { f32x8_t r; r.lo = F4_CmpNE(a.lo, b.lo); r.hi = F4_CmpNE(a.hi, b.hi); return r; }
+static inline u32     F8_Mask(f32x8_t a)           { return F4_Mask(a.lo) | F4_Mask(a.hi) << 4; }
+#endif
+
+/* F8_Select : picks a where the mask is set, b where it isn't */
+static inline f32x8_t F8_Select(f32x8_t mask, f32x8_t a, f32x8_t b)
+{
+	return F8_Or(F8_And(mask, a), F8_AndNot(mask, b));
+}
+
+/* F8_Rsqrt : 1 / sqrt(a) */
+static inline f32x8_t F8_Rsqrt(f32x8_t a)
+{
+	return F8_Div(F8_Set1(1), F8_Sqrt(a));
+}
+
+/* F8_RsqrtFast : 1 / sqrt(a), the estimate refined by one Newton-Raphson step */
+static inline f32x8_t F8_RsqrtFast(f32x8_t a)
+{
+	f32x8_t r;
+
+	r = F8_RsqrtEst(a);
+	return F8_Mul(F8_Mul(F8_Set1(0.5f), r), F8_Sub(F8_Set1(3), F8_Mul(a, F8_Mul(r, r))));
+}
+
+/* F8_Exp : e^a, to about single precision, clamped to normal floats */
+static inline f32x8_t F8_Exp(f32x8_t a)
+{
+#if defined(__AVX2__)
+	__m256i n;
+	f32x8_t t, f, p;
+
+	t = F8_Mul(F8_Min(F8_Max(a, F8_Set1(-87.0f)), F8_Set1(88.0f)), F8_Set1(1.44269504f));
+	n = _mm256_cvtps_epi32(t);
+	f = F8_Sub(t, _mm256_cvtepi32_ps(n));
+
+	p = F8_Set1(1.5403530e-4f);
+	p = F8_Add(F8_Mul(p, f), F8_Set1(1.3333558e-3f));
+	p = F8_Add(F8_Mul(p, f), F8_Set1(9.6181291e-3f));
+	p = F8_Add(F8_Mul(p, f), F8_Set1(5.5504109e-2f));
+	p = F8_Add(F8_Mul(p, f), F8_Set1(2.4022651e-1f));
+	p = F8_Add(F8_Mul(p, f), F8_Set1(6.9314718e-1f));
+	p = F8_Add(F8_Mul(p, f), F8_Set1(1));
+
+	return F8_Mul(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23)));
+#elif defined(__AVX__)
+	// no 256 bit integer ops, so a half at a time
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(F4_Exp(_mm256_castps256_ps128(a))),
+		F4_Exp(_mm256_extractf128_ps(a, 1)), 1);
+#else
+	f32x8_t r;
+
+	r.lo = F4_Exp(a.lo);
+	r.hi = F4_Exp(a.hi);
+	return r;
+#endif
+}
+
+// SoA bundles of vectors
+typedef struct { f32x4_t x, y, z; } vec3x4_t;
+typedef struct { f32x8_t x, y, z; } vec3x8_t;
+
+/* V3x8_Set1 : the same vector in every lane */
+static inline vec3x8_t V3x8_Set1(vecf3_t v)
+{
+	vec3x8_t r;
+
+	r.x = F8_Set1(v[0]);
+	r.y = F8_Set1(v[1]);
+	r.z = F8_Set1(v[2]);
+	return r;
+}
+
+/* V3x8_Load : loads eight vectors from three aligned arrays */
+static inline vec3x8_t V3x8_Load(f32 *x, f32 *y, f32 *z)
+{
+	vec3x8_t r;
+
+	r.x = F8_Load(x);
+	r.y = F8_Load(y);
+	r.z = F8_Load(z);
+	return r;
+}
+
+/* V3x8_Store : stores eight vectors into three aligned arrays */
+static inline void V3x8_Store(f32 *x, f32 *y, f32 *z, vec3x8_t v)
+{
+	F8_Store(x, v.x);
+	F8_Store(y, v.y);
+	F8_Store(z, v.z);
+}
+
+/* V3x8_Add : a + b */
+static inline vec3x8_t V3x8_Add(vec3x8_t a, vec3x8_t b)
+{
+	vec3x8_t r;
+
+	r.x = F8_Add(a.x, b.x);
+	r.y = F8_Add(a.y, b.y);
+	r.z = F8_Add(a.z, b.z);
+	return r;
+}
+
+/* V3x8_Sub : a - b */
+static inline vec3x8_t V3x8_Sub(vec3x8_t a, vec3x8_t b)
+{
+	vec3x8_t r;
+
+	r.x = F8_Sub(a.x, b.x);
+	r.y = F8_Sub(a.y, b.y);
+	r.z = F8_Sub(a.z, b.z);
+	return r;
+}
+
+/* V3x8_Scale : v * s, per lane */
+static inline vec3x8_t V3x8_Scale(vec3x8_t v, f32x8_t s)
+{
+	vec3x8_t r;
+
+	r.x = F8_Mul(v.x, s);
+	r.y = F8_Mul(v.y, s);
+	r.z = F8_Mul(v.z, s);
+	return r;
+}
+
+/* V3x8_Dot : a . b, per lane */
+static inline f32x8_t V3x8_Dot(vec3x8_t a, vec3x8_t b)
+{
+	return F8_Add(F8_Add(F8_Mul(a.x, b.x), F8_Mul(a.y, b.y)), F8_Mul(a.z, b.z));
+}
+
+/* V3x8_Cross : a x b, per lane */
+static inline vec3x8_t V3x8_Cross(vec3x8_t a, vec3x8_t b)
+{
+	vec3x8_t r;
+
+	r.x = F8_Sub(F8_Mul(a.y, b.z), F8_Mul(a.z, b.y));
+	r.y = F8_Sub(F8_Mul(a.z, b.x), F8_Mul(a.x, b.z));
+	r.z = F8_Sub(F8_Mul(a.x, b.y), F8_Mul(a.y, b.x));
+	return r;
+}
+
+/* V3x8_Norm : normalizes every lane */
+static inline vec3x8_t V3x8_Norm(vec3x8_t v)
+{
+	return V3x8_Scale(v, F8_Rsqrt(V3x8_Dot(v, v)));
+}
+
+/* V3x8_NormFast : normalizes every lane, with the approximate rsqrt */
+static inline vec3x8_t V3x8_NormFast(vec3x8_t v)
+{
+	return V3x8_Scale(v, F8_RsqrtFast(V3x8_Dot(v, v)));
+}
+
+// vec4_t, one vector per register, x, y, z and w
+typedef f32x4_t vec4_t;
+
+/* V4_Load3 : x, y, z from a vecf3_t, w of 0 */
+static inline vec4_t V4_Load3(vecf3_t v)
+{
+	return F4_Set(v[0], v[1], v[2], 0);
+}
+
+/* V4_Store3 : x, y, z into a vecf3_t */
+static inline void V4_Store3(vecf3_t out, vec4_t v)
+{
+	f32 f[4] __attribute__((aligned(16)));
+
+	F4_Store(f, v);
+	Vec3Copy(out, f);
+}
+
+/* V4_Dot3 : a . b over x, y and z */
+static inline f32 V4_Dot3(vec4_t a, vec4_t b)
+{
+	f32 f[4] __attribute__((aligned(16)));
+
+	F4_Store(f, F4_Mul(a, b));
+	return f[0] + f[1] + f[2];
+}
+
+/* V4_Dot4 : a . b over all four */
+static inline f32 V4_Dot4(vec4_t a, vec4_t b)
+{
+	f32 f[4] __attribute__((aligned(16)));
+
+	F4_Store(f, F4_Mul(a, b));
+	return f[0] + f[1] + f[2] + f[3];
+}
+
+/* V4_Cross3 : a x b over x, y and z, w of 0 */
+static inline vec4_t V4_Cross3(vec4_t a, vec4_t b)
+{
+#if defined(__SSE__)
+	f32x4_t a_yzx, b_yzx, c;
+
+	a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+#else
+	return F4_Set(a.f[1] * b.f[2] - a.f[2] * b.f[1],
+		a.f[2] * b.f[0] - a.f[0] * b.f[2],
+		a.f[0] * b.f[1] - a.f[1] * b.f[0], 0);
+#endif
+}
+
+/* V4_Norm3 : normalizes x, y and z */
+static inline vec4_t V4_Norm3(vec4_t v)
+{
+	return F4_Mul(v, F4_Rsqrt(F4_Set1(V4_Dot3(v, v))));
+}
+
+/* V4_Norm3Fast : normalizes x, y and z, with the approximate rsqrt */
+static inline vec4_t V4_Norm3Fast(vec4_t v)
+{
+	return F4_Mul(v, F4_RsqrtFast(F4_Set1(V4_Dot3(v, v))));
+}
+
+// mat4_t, row major, so a point p transforms as M * (p, 1)
+typedef struct { vec4_t r[4]; } mat4_t;
+
+/* M4_Identity : the identity matrix */
+mat4_t M4_Identity(void);
+
+/* M4_Mul : a * b */
+mat4_t M4_Mul(mat4_t a, mat4_t b);
+
+/* M4_Transpose : swaps rows and columns */
+mat4_t M4_Transpose(mat4_t m);
+
+/* M4_InverseAffine : inverts a rotation, scale and translation, ignoring the last row */
+mat4_t M4_InverseAffine(mat4_t m);
+
+/* M4_LookAt : camera to world transform, looking down -z from pos at target */
+mat4_t M4_LookAt(vecf3_t pos, vecf3_t target, vecf3_t up);
+
+/* M4_Translate : a translation */
+mat4_t M4_Translate(vecf3_t t);
+
+/* M4_Scale : a scale along each axis */
+mat4_t M4_Scale(vecf3_t s);
+
+/* M4_Column : pulls out column c's x, y and z */
+void M4_Column(vecf3_t out, mat4_t *m, s32 c);
+
+/* M4_MulPoint : transforms a point, translation included */
+static inline void M4_MulPoint(vecf3_t out, mat4_t *m, vecf3_t p)
+{
+	vec4_t v;
+
+	v = F4_Set(p[0], p[1], p[2], 1);
+	Vec3(out, V4_Dot4(m->r[0], v), V4_Dot4(m->r[1], v), V4_Dot4(m->r[2], v));
+}
+
+/* M4_MulDir : transforms a direction, no translation */
+static inline void M4_MulDir(vecf3_t out, mat4_t *m, vecf3_t d)
+{
+	vec4_t v;
+
+	v = V4_Load3(d);
+	Vec3(out, V4_Dot3(m->r[0], v), V4_Dot3(m->r[1], v), V4_Dot3(m->r[2], v));
+}
+
 #endif // MATH_H
 
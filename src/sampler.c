@@ -0,0 +1,332 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Samplers
+ *
+ * The Owen scrambling is Burley's: reverse the bits, so the permutation only
+ * lets lower bits depend on higher ones the way nested uniform scrambling
+ * needs, run the Laine-Karras style hash, and reverse them back. The same
+ * scramble applied to the sample index is what shuffles the padded groups.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "common.h"
+#include "math.h"
+#include "sampler.h"
+
+#define S_R2X (0.7548776662) // the R2 sequence, each dimension's offset into the mask
+#define S_R2Y (0.5698402910)
+
+struct sobolpoly_t { // Joe and Kuo's primitive polynomials and initial numbers
+	s32 s, a;
+	u32 m[3];
+};
+
+/* S_Hash : scrambles x */
+static inline u32 S_Hash(u32 x);
+
+/* S_Seed : hashes three numbers into one */
+static inline u32 S_Seed(u32 x, u32 y, u32 z);
+
+/* S_Reverse : reverses the bits of x */
+static inline u32 S_Reverse(u32 x);
+
+/* S_Owen : nested uniform scramble of x's bits, by seed */
+static inline u32 S_Owen(u32 x, u32 seed);
+
+/* S_Sobol : the index'th Sobol point's coordinate in the dimension */
+static inline u32 S_Sobol(struct sampler_t *sampler, u32 index, u32 dim);
+
+/* S_Mask : makes the blue noise mask, by void and cluster */
+static int S_Mask(struct sampler_t *sampler);
+
+/* S_MaskToggle : flips a point of the void and cluster pattern, updating the energy */
+static void S_MaskToggle(u8 *pattern, f32 *energy, f32 *lut, s32 p);
+
+/* S_MaskFind : the tightest cluster (want 1) or largest void (want 0) in the pattern */
+static s32 S_MaskFind(u8 *pattern, f32 *energy, s32 want);
+
+/* S_Init : fills in the tables the sampler type needs */
+int S_Init(struct sampler_t *sampler)
+{
+	struct sobolpoly_t polys[S_SOBOLDIMS] = {
+		{ 0, 0, { 0 } },       // van der Corput, handled separately
+		{ 1, 0, { 1 } },
+		{ 2, 1, { 1, 3 } },
+		{ 3, 1, { 1, 3, 1 } },
+	};
+	struct sobolpoly_t *p;
+	u32 *v, g;
+	s32 d, k, j;
+
+	for (k = 0; k < 32; k++) {
+		sampler->sobol[0][k] = 1u << (31 - k);
+	}
+
+	for (d = 1; d < S_SOBOLDIMS; d++) {
+		p = polys + d;
+		v = sampler->sobol[d];
+
+		for (k = 0; k < p->s; k++) {
+			v[k] = p->m[k] << (31 - k);
+		}
+
+		for (k = p->s; k < 32; k++) {
+			v[k] = v[k - p->s] ^ (v[k - p->s] >> p->s);
+			for (j = 1; j < p->s; j++) {
+				if ((p->a >> (p->s - 1 - j)) & 1) {
+					v[k] ^= v[k - j];
+				}
+			}
+		}
+	}
+
+	for (d = 0, g = 1; d < S_DIMS; d++, g *= S_KOROBOV) {
+		sampler->gen[d] = g;
+	}
+
+	if (sampler->type == SAMPLER_LATTICE && !sampler->mask) {
+		return S_Mask(sampler);
+	}
+
+	return 0;
+}
+
+/* S_Get : the sample's value in [0, 1) for the dimension, at pixel x, y */
+f32 S_Get(struct sampler_t *sampler, u32 x, u32 y, u32 sample, u32 dim)
+{
+	u32 v, seed, mx, my, rank;
+
+	switch (sampler->type) {
+	case SAMPLER_SOBOL:
+	case SAMPLER_OWEN:
+		seed = S_Seed(x, y, dim / S_SOBOLDIMS);
+		v = S_Sobol(sampler, S_Owen(sample, seed), dim % S_SOBOLDIMS);
+		seed = S_Hash(seed + dim % S_SOBOLDIMS + 1);
+		v = sampler->type == SAMPLER_OWEN ? S_Owen(v, seed) : v ^ seed;
+		break;
+
+	case SAMPLER_LATTICE:
+		v = S_Reverse(sample) * sampler->gen[dim % S_DIMS];
+
+		if (sampler->mask) {
+			mx = (x + (u32)(dim * S_R2X * S_MASK)) % S_MASK;
+			my = (y + (u32)(dim * S_R2Y * S_MASK)) % S_MASK;
+			rank = sampler->mask[mx + my * S_MASK];
+
+			// a shift to the middle of the rank's share of [0, 1)
+			v += (u32)(((2 * (u64)rank + 1) << 31) / (S_MASK * S_MASK));
+		}
+		break;
+
+	default:
+		v = S_Hash(S_Seed(x, y, dim) ^ S_Hash(sample));
+		break;
+	}
+
+	return (v >> 8) * (1.0f / (1 << 24));
+}
+
+/* S_Free : frees the sampler's tables */
+void S_Free(struct sampler_t *sampler)
+{
+	if (sampler) {
+		free(sampler->mask);
+		sampler->mask = NULL;
+	}
+}
+
+/* S_Hash : scrambles x */
+static inline u32 S_Hash(u32 x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+/* S_Seed : hashes three numbers into one */
+static inline u32 S_Seed(u32 x, u32 y, u32 z)
+{
+	return S_Hash(x ^ S_Hash(y ^ S_Hash(z)));
+}
+
+/* S_Reverse : reverses the bits of x */
+static inline u32 S_Reverse(u32 x)
+{
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+/* S_Owen : nested uniform scramble of x's bits, by seed */
+static inline u32 S_Owen(u32 x, u32 seed)
+{
+	x = S_Reverse(x);
+
+	// every bit only ever flips depending on the bits below it
+	x += seed;
+	x ^= x * 0x6c50b47c;
+	x ^= x * 0xb82f1e52;
+	x ^= x * 0xc7afe638;
+	x ^= x * 0x8d22f6e6;
+
+	return S_Reverse(x);
+}
+
+/* S_Sobol : the index'th Sobol point's coordinate in the dimension */
+static inline u32 S_Sobol(struct sampler_t *sampler, u32 index, u32 dim)
+{
+	u32 v, k;
+
+	for (v = 0, k = 0; index; index >>= 1, k++) {
+		if (index & 1) {
+			v ^= sampler->sobol[dim][k];
+		}
+	}
+
+	return v;
+}
+
+/* S_Mask : makes the blue noise mask, by void and cluster */
+static int S_Mask(struct sampler_t *sampler)
+{
+	u8 *pattern, *initial;
+	f32 *energy, *saved, *lut;
+	s32 n, ones, rank, x, y, dx, dy, p, q;
+
+	n = S_MASK * S_MASK;
+
+	sampler->mask = malloc(n * sizeof(*sampler->mask));
+	pattern = malloc(n * sizeof(*pattern));
+	initial = malloc(n * sizeof(*initial));
+	energy = malloc(n * sizeof(*energy));
+	saved = malloc(n * sizeof(*saved));
+	lut = malloc(n * sizeof(*lut));
+
+	if (!sampler->mask || !pattern || !initial || !energy || !saved || !lut) {
+		free(pattern);
+		free(initial);
+		free(energy);
+		free(saved);
+		free(lut);
+		S_Free(sampler);
+		return -1;
+	}
+
+	// a gaussian over the toroidal distance, so the mask tiles
+	for (y = 0; y < S_MASK; y++) {
+		for (x = 0; x < S_MASK; x++) {
+			dx = MIN(x, S_MASK - x);
+			dy = MIN(y, S_MASK - y);
+			lut[x + y * S_MASK] = expf(-(dx * dx + dy * dy) / (2 * S_SIGMA * S_SIGMA));
+		}
+	}
+
+	memset(pattern, 0, n * sizeof(*pattern));
+	memset(energy, 0, n * sizeof(*energy));
+
+	// a tenth of the points, hashed so the mask is the same every run
+	for (ones = 0, q = 0; ones < n / 10; q++) {
+		p = S_Hash(q) % n;
+		if (!pattern[p]) {
+			S_MaskToggle(pattern, energy, lut, p);
+			ones++;
+		}
+	}
+
+	// even it out, moving the tightest cluster into the largest void until
+	// that's where it came from
+	for (;;) {
+		p = S_MaskFind(pattern, energy, 1);
+		S_MaskToggle(pattern, energy, lut, p);
+
+		q = S_MaskFind(pattern, energy, 0);
+		S_MaskToggle(pattern, energy, lut, q);
+
+		if (p == q) {
+			break;
+		}
+	}
+
+	memcpy(initial, pattern, n * sizeof(*pattern));
+	memcpy(saved, energy, n * sizeof(*energy));
+
+	// the initial points are ranked by taking the tightest clusters out first
+	for (rank = ones - 1; rank >= 0; rank--) {
+		p = S_MaskFind(pattern, energy, 1);
+		S_MaskToggle(pattern, energy, lut, p);
+		sampler->mask[p] = rank;
+	}
+
+	// and the rest by filling in the largest voids, which past the halfway
+	// point is the same as the tightest clusters of what's left
+	memcpy(pattern, initial, n * sizeof(*pattern));
+	memcpy(energy, saved, n * sizeof(*energy));
+
+	for (rank = ones; rank < n; rank++) {
+		p = S_MaskFind(pattern, energy, 0);
+		S_MaskToggle(pattern, energy, lut, p);
+		sampler->mask[p] = rank;
+	}
+
+	free(pattern);
+	free(initial);
+	free(energy);
+	free(saved);
+	free(lut);
+
+	return 0;
+}
+
+/* S_MaskToggle : flips a point of the void and cluster pattern, updating the energy */
+static void S_MaskToggle(u8 *pattern, f32 *energy, f32 *lut, s32 p)
+{
+	f32 sign;
+	s32 x, y, px, py;
+
+	pattern[p] ^= 1;
+	sign = pattern[p] ? 1 : -1;
+
+	px = p % S_MASK;
+	py = p / S_MASK;
+
+	for (y = 0; y < S_MASK; y++) {
+		for (x = 0; x < S_MASK; x++) {
+			energy[x + y * S_MASK] += sign * lut[(x - px + S_MASK) % S_MASK + S_MASK * ((y - py + S_MASK) % S_MASK)];
+		}
+	}
+}
+
+/* S_MaskFind : the tightest cluster (want 1) or largest void (want 0) in the pattern */
+static s32 S_MaskFind(u8 *pattern, f32 *energy, s32 want)
+{
+	f32 best;
+	s32 i, p;
+
+	best = want ? -FLT_MAX : FLT_MAX;
+	p = 0;
+
+	for (i = 0; i < S_MASK * S_MASK; i++) {
+		if (pattern[i] != want) {
+			continue;
+		}
+
+		if (want ? energy[i] > best : energy[i] < best) {
+			best = energy[i];
+			p = i;
+		}
+	}
+
+	return p;
+}
+
@@ -0,0 +1,69 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Samplers
+ *
+ * Every random number the renderer uses is S_Get of a pixel, the sample's
+ * index within that pixel, and a dimension, which the caller keeps fixed
+ * for each decision (the pixel jitter, the light pick on the second bounce,
+ * and so on). Nothing is carried from one call to the next, so an image
+ * comes out the same no matter how many threads made it, or in what order.
+ *
+ *   SAMPLER_RANDOM  - hashed white noise, the baseline
+ *   SAMPLER_SOBOL   - Sobol points, scrambled by xor'ing a random number
+ *                     into each dimension (Kollig and Keller 2002)
+ *   SAMPLER_OWEN    - Sobol points, Owen scrambled with a hash (Laine and
+ *                     Karras 2011, Burley 2020)
+ *   SAMPLER_LATTICE - a rank-1 lattice sequence, shifted per pixel by a blue
+ *                     noise mask, so what error is left at low sample counts
+ *                     is spread out as high frequency noise
+ *
+ * Only the first S_SOBOLDIMS dimensions of Sobol are used. The sequence is
+ * padded out past that by shuffling the sample index, differently for every
+ * group of S_SOBOLDIMS dimensions and every pixel, which keeps each group
+ * stratified while decorrelating the groups from each other.
+ *
+ * The lattice is (1, a, a^2, ...) mod 2^32 with a = S_KOROBOV, visited in
+ * radical inverse order so every power of two prefix is a full lattice. The
+ * blue noise mask is made by void and cluster (Ulichney 1993) in S_Init, and
+ * each dimension reads it at a different toroidal offset.
+ */
+
+#include "common.h"
+
+#define S_SOBOLDIMS (4)    // dimensions of Sobol before padding
+#define S_DIMS      (256)  // lattice generators, past this they repeat
+#define S_KOROBOV   (1299) // lattice generator, the best 2D spacing in a small search
+#define S_MASK      (64)   // the blue noise mask is S_MASK x S_MASK
+#define S_SIGMA     (1.5f) // void and cluster filter width, in mask pixels
+
+enum {
+	SAMPLER_RANDOM,
+	SAMPLER_SOBOL,
+	SAMPLER_OWEN,
+	SAMPLER_LATTICE,
+	SAMPLER_TOTAL
+};
+
+struct sampler_t {
+	s32 type;                         // SAMPLER_*
+	u32 sobol[S_SOBOLDIMS][32];       // direction numbers
+	u32 gen[S_DIMS];                  // lattice generating vector
+	u16 *mask;                        // blue noise ranks, for SAMPLER_LATTICE
+};
+
+/* S_Init : fills in the tables the sampler type needs */
+int S_Init(struct sampler_t *sampler);
+
+/* S_Get : the sample's value in [0, 1) for the dimension, at pixel x, y */
+f32 S_Get(struct sampler_t *sampler, u32 x, u32 y, u32 sample, u32 dim);
+
+/* S_Free : frees the sampler's tables */
+void S_Free(struct sampler_t *sampler);
+
+#endif // SAMPLER_H
+
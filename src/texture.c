@@ -0,0 +1,762 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Textures
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "math.h"
+#include "texture.h"
+#include "stb_image.h"
+
+#define T_MAGIC   (0x58545242) // "BRTX", little endian
+#define T_VERSION (1)
+
+struct tilefile_t { // the header of a pre-tiled file, the texels of every level follow
+	u32 magic;
+	u32 version;
+	s32 w, h, levels;
+	s32 tile;        // T_TILE when it was written
+	u64 len;         // texels
+	struct texlevel_t level[T_LEVELS];
+};
+
+static f32 t_linear[256]; // sRGB bytes to linear, filled in by T_Table
+static s32 t_ready;
+
+/* T_Table : fills in the sRGB to linear table, the first time it's called */
+static void T_Table(void);
+
+/* T_Reduce : box filters the level in src down to the next one, into dst */
+static void T_Reduce(f32 *src, struct texlevel_t *l, f32 *dst, struct texlevel_t *n);
+
+/* T_ToLinear : an sRGB value in [0, 1] into linear */
+static inline f32 T_ToLinear(f32 x);
+
+/* T_ToSRGB : a linear value into an sRGB byte */
+static inline u32 T_ToSRGB(f32 x);
+
+/* T_Morton : interleaves the bits of x and y, x in the lowest */
+static inline u32 T_Morton(u32 x, u32 y);
+
+/* T_Tile : which of the level's tiles texel x, y is in */
+static inline size_t T_Tile(struct texlevel_t *level, s32 x, s32 y);
+
+/* T_Index : where texel x, y of the level lives in texture_t::texels */
+static inline size_t T_Index(struct texlevel_t *level, s32 x, s32 y);
+
+/* T_Texels : the texels at four x, y of the level, from memory or through the cache */
+static inline void T_Texels(struct texture_t *tex, struct texlevel_t *level, s32 *x, s32 *y, u32 *out);
+
+/* T_Unpack : one texel into linear floats */
+static inline f32x4_t T_Unpack(u32 c);
+
+/* T_Bilinear : the level bilinearly filtered at u, v, both in [0, 1] */
+static inline f32x4_t T_Bilinear(struct texture_t *tex, struct texlevel_t *level, f32 u, f32 v);
+
+/* T_Strdup : a copy of the string, NULL if there's no memory */
+static char *T_Strdup(char *s);
+
+/* T_WriteTiles : writes the texture's header and texels into a pre-tiled file */
+static int T_WriteTiles(struct texture_t *tex, char *path);
+
+/* T_ReadTile : reads one tile of the level from the pre-tiled file, returns the bytes read */
+static size_t T_ReadTile(struct texture_t *tex, struct texlevel_t *level, size_t tile, u32 *out);
+
+/* T_Seek : seeks to the byte, past 2GB too */
+static int T_Seek(FILE *fp, u64 offset);
+
+/* T_Hash : mixes a cache key's bits */
+static inline u32 T_Hash(u64 key);
+
+/* T_CacheRead : copies the texels of the tile that mask picks out of morton into out, through the cache */
+static void T_CacheRead(struct texture_t *tex, s32 level, size_t tile, u32 *morton, u32 mask, u32 *out);
+
+/* T_CacheLink : puts the slot at the new end of the shard's LRU list */
+static inline void T_CacheLink(struct tileshard_t *s, s32 i);
+
+/* T_CacheUnlink : takes the slot out of the shard's LRU list */
+static inline void T_CacheUnlink(struct tileshard_t *s, s32 i);
+
+/* T_CacheUnchain : takes the slot out of its hash chain */
+static inline void T_CacheUnchain(struct tileshard_t *s, s32 i);
+
+/* T_Load : reads the image and builds the texture from it, returns -1 if it couldn't */
+int T_Load(struct texture_t *tex, char *name)
+{
+	u8 *pixels;
+	s32 w, h, n, rc;
+
+	memset(tex, 0, sizeof(*tex));
+
+	pixels = stbi_load(name, &w, &h, &n, 4);
+	if (!pixels) {
+		return -1;
+	}
+
+	rc = T_Build(tex, pixels, w, h);
+	stbi_image_free(pixels);
+
+	tex->name = T_Strdup(name);
+	if (rc < 0 || !tex->name) {
+		T_Free(tex);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* T_Open : opens the image's pre-tiled file, writing it first if need be, its tiles paged in through the cache */
+int T_Open(struct texture_t *tex, char *name, struct texcache_t *cache, u32 id)
+{
+	struct tilefile_t hdr;
+	struct stat image, tiles;
+	char path[BUFLARGE];
+	FILE *fp;
+
+	T_Table();
+
+	snprintf(path, sizeof path, "%s.tiles", name);
+
+	// the pre-tiled file is good as long as the image hasn't changed since
+	fp = NULL;
+	if (stat(path, &tiles) == 0 && stat(name, &image) == 0 && tiles.st_mtime >= image.st_mtime) {
+		fp = fopen(path, "rb");
+	}
+
+	if (fp && fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+		hdr.magic == T_MAGIC && hdr.version == T_VERSION && hdr.tile == T_TILE &&
+		0 < hdr.levels && hdr.levels <= T_LEVELS) {
+		memset(tex, 0, sizeof(*tex));
+		tex->w = hdr.w;
+		tex->h = hdr.h;
+		tex->levels = hdr.levels;
+		tex->len = hdr.len;
+		memcpy(tex->level, hdr.level, sizeof(tex->level));
+
+		tex->name = T_Strdup(name);
+		if (!tex->name) {
+			fclose(fp);
+			return -1;
+		}
+	} else {
+		if (fp) {
+			fclose(fp);
+		}
+
+		if (T_Load(tex, name) < 0) {
+			return -1;
+		}
+
+		// with nowhere to write the tiles, the texture just stays in memory
+		tex->id = id;
+		if (T_WriteTiles(tex, path) < 0 || !(fp = fopen(path, "rb"))) {
+			return 0;
+		}
+
+		C_AlignedFree(tex->texels);
+		tex->texels = NULL;
+	}
+
+	tex->id = id;
+	tex->cache = cache;
+	tex->fp = fp;
+	omp_init_lock(&tex->lock);
+
+	return 0;
+}
+
+/* T_CacheInit : sets up the tile cache, budget bytes of tiles split over the shards */
+int T_CacheInit(struct texcache_t *cache, size_t budget)
+{
+	struct tileshard_t *s;
+	s32 i, j, buckets;
+
+	memset(cache, 0, sizeof(*cache));
+	cache->budget = budget;
+
+	for (i = 0; i < T_SHARDS; i++) {
+		s = cache->shards + i;
+		s->cap = MAX(1, budget / T_SHARDS / (T_TILE * T_TILE * sizeof(*s->tiles)));
+		s->oldest = s->newest = -1;
+		omp_init_lock(&s->lock);
+
+		for (buckets = 1; buckets < s->cap; buckets <<= 1) {
+		}
+		s->mask = buckets - 1;
+
+		s->entries = malloc(s->cap * sizeof(*s->entries));
+		s->tiles = C_AlignedAlloc(64, (size_t)s->cap * T_TILE * T_TILE * sizeof(*s->tiles));
+		s->buckets = malloc(buckets * sizeof(*s->buckets));
+
+		if (!s->entries || !s->tiles || !s->buckets) {
+			T_CacheFree(cache);
+			return -1;
+		}
+
+		for (j = 0; j < buckets; j++) {
+			s->buckets[j] = -1;
+		}
+	}
+
+	return 0;
+}
+
+/* T_CacheCounters : the hits, misses and bytes read, summed over every shard */
+void T_CacheCounters(struct texcache_t *cache, u64 *hits, u64 *misses, u64 *bytes)
+{
+	s32 i;
+
+	*hits = *misses = *bytes = 0;
+
+	for (i = 0; i < T_SHARDS; i++) {
+		*hits += cache->shards[i].hits;
+		*misses += cache->shards[i].misses;
+		*bytes += cache->shards[i].bytes;
+	}
+}
+
+/* T_CacheFree : frees the tile cache */
+void T_CacheFree(struct texcache_t *cache)
+{
+	struct tileshard_t *s;
+	s32 i;
+
+	for (i = 0; i < T_SHARDS; i++) {
+		s = cache->shards + i;
+		if (s->cap) {
+			free(s->entries);
+			C_AlignedFree(s->tiles);
+			free(s->buckets);
+			omp_destroy_lock(&s->lock);
+		}
+	}
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+/* T_Build : builds the tiled mip pyramid from w x h RGBA8 pixels */
+int T_Build(struct texture_t *tex, u8 *pixels, s32 w, s32 h)
+{
+	struct texlevel_t *l;
+	f32 *cur, *next, *c;
+	u8 *row;
+	s32 i, x, y, k;
+	size_t len;
+
+	T_Table();
+
+	tex->w = w;
+	tex->h = h;
+
+	// lay out every level first, so the whole pyramid is one allocation
+	for (i = 0, len = 0; i < T_LEVELS; i++) {
+		l = tex->level + i;
+		l->w = MAX(1, w >> i);
+		l->h = MAX(1, h >> i);
+		l->tw = (l->w + T_TILE - 1) / T_TILE;
+		l->offset = len;
+		len += (size_t)l->tw * ((l->h + T_TILE - 1) / T_TILE) * T_TILE * T_TILE;
+
+		if (l->w == 1 && l->h == 1) {
+			i++;
+			break;
+		}
+	}
+
+	tex->levels = i;
+	tex->len = len;
+
+	tex->texels = C_AlignedAlloc(64, len * sizeof(*tex->texels));
+	cur = malloc((size_t)w * h * 4 * sizeof(*cur));
+	next = malloc((size_t)MAX(1, w >> 1) * MAX(1, h >> 1) * 4 * sizeof(*next));
+
+	if (!tex->texels || !cur || !next) {
+		C_AlignedFree(tex->texels);
+		tex->texels = NULL;
+		free(cur);
+		free(next);
+		return -1;
+	}
+
+	// the partial tiles' padding is never read, but it shouldn't be garbage
+	memset(tex->texels, 0, len * sizeof(*tex->texels));
+
+	// images start at the top row, and v starts at the bottom
+	for (y = 0; y < h; y++) {
+		row = pixels + (size_t)(h - 1 - y) * w * 4;
+		c = cur + (size_t)y * w * 4;
+		for (k = 0; k < w * 4; k++) {
+			c[k] = (k & 3) == 3 ? row[k] * (1.0f / 255) : t_linear[row[k]];
+		}
+	}
+
+	for (i = 0; i < tex->levels; i++) {
+		l = tex->level + i;
+
+		for (y = 0; y < l->h; y++) {
+			for (x = 0; x < l->w; x++) {
+				c = cur + (x + y * l->w) * 4;
+				tex->texels[T_Index(l, x, y)] = T_ToSRGB(c[0]) | T_ToSRGB(c[1]) << 8 |
+					T_ToSRGB(c[2]) << 16 | (u32)(CLAMP(c[3], 0, 1) * 255 + 0.5f) << 24;
+			}
+		}
+
+		if (i + 1 == tex->levels) {
+			break;
+		}
+
+		// a box over the texels of this level under each of the next, which
+		// is 2x2 of them, but reaches a share of a third where a side is odd
+		T_Reduce(cur, l, next, tex->level + i + 1);
+
+		// every level after is smaller than the one that was in cur
+		SWAP(cur, next);
+	}
+
+	free(cur);
+	free(next);
+
+	return 0;
+}
+
+/* T_Sample : the linear color at u, v, trilinearly filtered at the lod (0 is the full size) */
+void T_Sample(struct texture_t *tex, f32 u, f32 v, f32 lod, vecf4_t out)
+{
+	f32x4_t c, d;
+	f32 f;
+	s32 i;
+
+	if (!isfinite(u) || !isfinite(v)) {
+		u = v = 0;
+	}
+
+	u -= floorf(u);
+	v -= floorf(v);
+
+	lod = CLAMP(lod, 0, tex->levels - 1);
+	i = (s32)lod;
+	f = lod - i;
+
+	c = T_Bilinear(tex, tex->level + i, u, v);
+
+	if (f > 0 && i + 1 < tex->levels) {
+		d = T_Bilinear(tex, tex->level + i + 1, u, v);
+		c = F4_Add(c, F4_Mul(F4_Sub(d, c), F4_Set1(f)));
+	}
+
+	F4_StoreU(out, c);
+}
+
+/* T_Lod : the mip level for a pixel's footprint, given how far u, v move per pixel in x and y */
+f32 T_Lod(struct texture_t *tex, f32 dudx, f32 dvdx, f32 dudy, f32 dvdy)
+{
+	f32 x, y;
+
+	// in texels of the full size, which is what every level halves
+	dudx *= tex->w;
+	dudy *= tex->w;
+	dvdx *= tex->h;
+	dvdy *= tex->h;
+
+	x = dudx * dudx + dvdx * dvdx;
+	y = dudy * dudy + dvdy * dvdy;
+
+	// log2 of the square root, T_Sample clamps what's out of range, NaN included
+	return 0.5f * log2f(MAX(x, y));
+}
+
+/* T_Free : frees the texture's texels and name, and closes its pre-tiled file */
+void T_Free(struct texture_t *tex)
+{
+	if (tex) {
+		if (tex->fp) {
+			fclose(tex->fp);
+			omp_destroy_lock(&tex->lock);
+		}
+		C_AlignedFree(tex->texels);
+		free(tex->name);
+		memset(tex, 0, sizeof(*tex));
+	}
+}
+
+/* T_Table : fills in the sRGB to linear table, the first time it's called */
+static void T_Table(void)
+{
+	s32 i;
+
+	// textures might be built on several threads at once
+#pragma omp critical (t_table)
+	{
+		if (!t_ready) {
+			for (i = 0; i < 256; i++) {
+				t_linear[i] = T_ToLinear(i / 255.0f);
+			}
+			t_ready = 1;
+		}
+	}
+}
+
+/* T_Reduce : box filters the level in src down to the next one, into dst */
+static void T_Reduce(f32 *src, struct texlevel_t *l, f32 *dst, struct texlevel_t *n)
+{
+	f32 sx, sy, x0, x1, y0, y1, wx, wy, sum[4];
+	f32 *c;
+	s32 x, y, i, j, k;
+
+	sx = (f32)l->w / n->w;
+	sy = (f32)l->h / n->h;
+
+	for (y = 0; y < n->h; y++) {
+		y0 = y * sy;
+		y1 = y0 + sy;
+
+		for (x = 0; x < n->w; x++) {
+			x0 = x * sx;
+			x1 = x0 + sx;
+
+			sum[0] = sum[1] = sum[2] = sum[3] = 0;
+
+			// every texel the footprint touches, weighed by how much of it it covers
+			for (j = (s32)y0; j < y1 && j < l->h; j++) {
+				wy = MIN(y1, j + 1) - MAX(y0, j);
+
+				for (i = (s32)x0; i < x1 && i < l->w; i++) {
+					wx = MIN(x1, i + 1) - MAX(x0, i);
+					c = src + (i + j * l->w) * 4;
+
+					for (k = 0; k < 4; k++) {
+						sum[k] += c[k] * wx * wy;
+					}
+				}
+			}
+
+			c = dst + (x + y * n->w) * 4;
+			for (k = 0; k < 4; k++) {
+				c[k] = sum[k] / (sx * sy);
+			}
+		}
+	}
+}
+
+/* T_ToLinear : an sRGB value in [0, 1] into linear */
+static inline f32 T_ToLinear(f32 x)
+{
+	return x <= 0.04045f ? x / 12.92f : powf((x + 0.055f) / 1.055f, 2.4f);
+}
+
+/* T_ToSRGB : a linear value into an sRGB byte */
+static inline u32 T_ToSRGB(f32 x)
+{
+	x = CLAMP(x, 0, 1);
+	x = x <= 0.0031308f ? x * 12.92f : 1.055f * powf(x, 1 / 2.4f) - 0.055f;
+	return (u32)(x * 255 + 0.5f);
+}
+
+/* T_Morton : interleaves the bits of x and y, x in the lowest */
+static inline u32 T_Morton(u32 x, u32 y)
+{
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+
+	y = (y | (y << 4)) & 0x0f0f0f0f;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+
+	return x | (y << 1);
+}
+
+/* T_Tile : which of the level's tiles texel x, y is in */
+static inline size_t T_Tile(struct texlevel_t *level, s32 x, s32 y)
+{
+	return (size_t)(x / T_TILE) + (size_t)(y / T_TILE) * level->tw;
+}
+
+/* T_Index : where texel x, y of the level lives in texture_t::texels */
+static inline size_t T_Index(struct texlevel_t *level, s32 x, s32 y)
+{
+	return level->offset + T_Tile(level, x, y) * T_TILE * T_TILE + T_Morton(x & (T_TILE - 1), y & (T_TILE - 1));
+}
+
+/* T_Texels : the texels at four x, y of the level, from memory or through the cache */
+static inline void T_Texels(struct texture_t *tex, struct texlevel_t *level, s32 *x, s32 *y, u32 *out)
+{
+	size_t tile[4];
+	u32 morton[4], mask, done;
+	s32 i, j;
+
+	if (tex->texels) {
+		for (i = 0; i < 4; i++) {
+			out[i] = tex->texels[T_Index(level, x[i], y[i])];
+		}
+		return;
+	}
+
+	for (i = 0; i < 4; i++) {
+		tile[i] = T_Tile(level, x[i], y[i]);
+		morton[i] = T_Morton(x[i] & (T_TILE - 1), y[i] & (T_TILE - 1));
+	}
+
+	// a footprint mostly lies inside one tile, which is then just one lookup
+	for (i = 0, done = 0; i < 4; i++) {
+		if (done & (1u << i)) {
+			continue;
+		}
+
+		for (j = i, mask = 0; j < 4; j++) {
+			if (tile[j] == tile[i]) {
+				mask |= 1u << j;
+			}
+		}
+
+		T_CacheRead(tex, level - tex->level, tile[i], morton, mask, out);
+		done |= mask;
+	}
+}
+
+/* T_Unpack : one texel into linear floats */
+static inline f32x4_t T_Unpack(u32 c)
+{
+	return F4_Set(t_linear[c & 0xff], t_linear[(c >> 8) & 0xff], t_linear[(c >> 16) & 0xff], (c >> 24) * (1.0f / 255));
+}
+
+/* T_Bilinear : the level bilinearly filtered at u, v, both in [0, 1] */
+static inline f32x4_t T_Bilinear(struct texture_t *tex, struct texlevel_t *level, f32 u, f32 v)
+{
+	f32x4_t a, b, c, d, fx, fy;
+	f32 x, y;
+	u32 texels[4];
+	s32 x0, x1, y0, y1, xs[4], ys[4];
+
+	// texel centers are at the halves, so the four around u, v start half a texel back
+	x = u * level->w - 0.5f;
+	y = v * level->h - 0.5f;
+	x0 = (s32)floorf(x);
+	y0 = (s32)floorf(y);
+	fx = F4_Set1(x - x0);
+	fy = F4_Set1(y - y0);
+
+	// which is at most one texel off either edge, wrapping around
+	x0 = x0 < 0 ? level->w - 1 : MIN(x0, level->w - 1);
+	y0 = y0 < 0 ? level->h - 1 : MIN(y0, level->h - 1);
+	x1 = x0 + 1 < level->w ? x0 + 1 : 0;
+	y1 = y0 + 1 < level->h ? y0 + 1 : 0;
+
+	xs[0] = xs[2] = x0;
+	xs[1] = xs[3] = x1;
+	ys[0] = ys[1] = y0;
+	ys[2] = ys[3] = y1;
+	T_Texels(tex, level, xs, ys, texels);
+
+	a = T_Unpack(texels[0]);
+	b = T_Unpack(texels[1]);
+	c = T_Unpack(texels[2]);
+	d = T_Unpack(texels[3]);
+
+	a = F4_Add(a, F4_Mul(F4_Sub(b, a), fx));
+	c = F4_Add(c, F4_Mul(F4_Sub(d, c), fx));
+
+	return F4_Add(a, F4_Mul(F4_Sub(c, a), fy));
+}
+
+/* T_Strdup : a copy of the string, NULL if there's no memory */
+static char *T_Strdup(char *s)
+{
+	char *t;
+
+	t = malloc(strlen(s) + 1);
+	if (t) {
+		strcpy(t, s);
+	}
+
+	return t;
+}
+
+/* T_WriteTiles : writes the texture's header and texels into a pre-tiled file */
+static int T_WriteTiles(struct texture_t *tex, char *path)
+{
+	struct tilefile_t hdr;
+	FILE *fp;
+	int ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = T_MAGIC;
+	hdr.version = T_VERSION;
+	hdr.w = tex->w;
+	hdr.h = tex->h;
+	hdr.levels = tex->levels;
+	hdr.tile = T_TILE;
+	hdr.len = tex->len;
+	memcpy(hdr.level, tex->level, sizeof(hdr.level));
+
+	fp = fopen(path, "wb");
+	if (!fp) {
+		return -1;
+	}
+
+	ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+		fwrite(tex->texels, sizeof(*tex->texels), tex->len, fp) == tex->len;
+	ok = fclose(fp) == 0 && ok;
+
+	// half a file would only get read back as garbage
+	if (!ok) {
+		remove(path);
+	}
+
+	return ok ? 0 : -1;
+}
+
+/* T_ReadTile : reads one tile of the level from the pre-tiled file, returns the bytes read */
+static size_t T_ReadTile(struct texture_t *tex, struct texlevel_t *level, size_t tile, u32 *out)
+{
+	size_t n;
+
+	n = 0;
+
+	omp_set_lock(&tex->lock);
+	if (T_Seek(tex->fp, sizeof(struct tilefile_t) + (level->offset + tile * T_TILE * T_TILE) * sizeof(*out)) == 0) {
+		n = fread(out, sizeof(*out), T_TILE * T_TILE, tex->fp);
+	}
+	omp_unset_lock(&tex->lock);
+
+	// a short read comes out black rather than as whatever the slot held
+	if (n < T_TILE * T_TILE) {
+		memset(out + n, 0, (T_TILE * T_TILE - n) * sizeof(*out));
+	}
+
+	return n * sizeof(*out);
+}
+
+/* T_Seek : seeks to the byte, past 2GB too */
+static int T_Seek(FILE *fp, u64 offset)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, offset, SEEK_SET);
+#else
+	return fseeko(fp, offset, SEEK_SET);
+#endif
+}
+
+/* T_Hash : mixes a cache key's bits */
+static inline u32 T_Hash(u64 key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ull;
+	key ^= key >> 33;
+	return (u32)key;
+}
+
+/* T_CacheRead : copies the texels of the tile that mask picks out of morton into out, through the cache */
+static void T_CacheRead(struct texture_t *tex, s32 level, size_t tile, u32 *morton, u32 mask, u32 *out)
+{
+	struct tileshard_t *s;
+	struct tileentry_t *e;
+	u32 *texels;
+	u64 key;
+	u32 h;
+	s32 i, b, k;
+
+	// the low bits of the hash pick the shard, the rest the bucket in it
+	key = (u64)tex->id << 48 | (u64)level << 40 | tile;
+	h = T_Hash(key);
+	s = tex->cache->shards + (h & (T_SHARDS - 1));
+	b = (h / T_SHARDS) & s->mask;
+
+	omp_set_lock(&s->lock);
+
+	for (i = s->buckets[b]; i >= 0 && s->entries[i].key != key; i = s->entries[i].chain) {
+	}
+
+	if (i >= 0) {
+		s->hits++;
+		T_CacheUnlink(s, i);
+	} else {
+		s->misses++;
+
+		// a free slot while there are any, then the least recently used
+		if (s->len < s->cap) {
+			i = s->len++;
+		} else {
+			i = s->oldest;
+			T_CacheUnlink(s, i);
+			T_CacheUnchain(s, i);
+		}
+
+		e = s->entries + i;
+		e->key = key;
+		e->chain = s->buckets[b];
+		s->buckets[b] = i;
+
+		s->bytes += T_ReadTile(tex, tex->level + level, tile, s->tiles + (size_t)i * T_TILE * T_TILE);
+	}
+
+	T_CacheLink(s, i);
+
+	texels = s->tiles + (size_t)i * T_TILE * T_TILE;
+	for (k = 0; k < 4; k++) {
+		if (mask & (1u << k)) {
+			out[k] = texels[morton[k]];
+		}
+	}
+
+	omp_unset_lock(&s->lock);
+}
+
+/* T_CacheLink : puts the slot at the new end of the shard's LRU list */
+static inline void T_CacheLink(struct tileshard_t *s, s32 i)
+{
+	s->entries[i].older = s->newest;
+	s->entries[i].newer = -1;
+
+	if (s->newest >= 0) {
+		s->entries[s->newest].newer = i;
+	} else {
+		s->oldest = i;
+	}
+
+	s->newest = i;
+}
+
+/* T_CacheUnlink : takes the slot out of the shard's LRU list */
+static inline void T_CacheUnlink(struct tileshard_t *s, s32 i)
+{
+	struct tileentry_t *e;
+
+	e = s->entries + i;
+
+	if (e->older >= 0) {
+		s->entries[e->older].newer = e->newer;
+	} else {
+		s->oldest = e->newer;
+	}
+
+	if (e->newer >= 0) {
+		s->entries[e->newer].older = e->older;
+	} else {
+		s->newest = e->older;
+	}
+}
+
+/* T_CacheUnchain : takes the slot out of its hash chain */
+static inline void T_CacheUnchain(struct tileshard_t *s, s32 i)
+{
+	s32 *p;
+
+	p = s->buckets + ((T_Hash(s->entries[i].key) / T_SHARDS) & s->mask);
+	while (*p != i) {
+		p = &s->entries[*p].chain;
+	}
+
+	*p = s->entries[i].chain;
+}
+
@@ -0,0 +1,125 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Textures
+ *
+ * Images come in through stbi_load as RGBA8, and the whole mip pyramid is
+ * built right then, each level a box filter of the one above, averaged
+ * in linear light so the small mips don't darken.
+ *
+ * A scanline image puts the texels above and below one a whole row apart, so
+ * a bilinear footprint touches two cache lines, and a ray wandering across
+ * the texture in any direction but along a row touches a new one every step.
+ * Instead every level is cut into T_TILE x T_TILE tiles, each one contiguous,
+ * and the texels inside a tile go in Morton order. A tile is 256 bytes, four
+ * cache lines, each one a 4x4 block of texels, so nearby texels in either
+ * direction are almost always in the same line or the one beside it.
+ *
+ * The texels stay 8 bit sRGB to keep them small, and go through a table into
+ * linear floats when they're fetched. Filtering is bilinear within a level,
+ * all four channels at once in an f32x4_t, and trilinear between the two
+ * levels either side of the lod, which T_Lod picks so a texel of it is about
+ * the size of the longer side of the pixel's footprint. Coordinates wrap.
+ *
+ * Tiles are also the unit textures page in by, for scenes with more texels
+ * than memory. T_Open writes a texture's tiles, level by level, to a
+ * pre-tiled file beside the image the first time it's seen (name.tiles), and
+ * afterwards opens that instead, only reading its header, so the image is
+ * never decoded again until it changes. Its texels then stay on disk, and
+ * T_Sample pulls the tiles it touches through a texcache_t: a fixed budget of
+ * tile slots, evicted least recently used first. The cache is cut into
+ * T_SHARDS shards, each with its own lock, hash table and LRU list, and a tile
+ * belongs to the shard its key hashes to, so the threads hardly ever wait on
+ * one another. A lookup copies the texels it needs out while it holds the
+ * lock, so a tile can be evicted the moment it's released. Every shard counts
+ * its hits, misses and the bytes it read, T_CacheCounters sums them.
+ *
+ * The pre-tiled files are only a cache: they're written raw, for the machine
+ * that wrote them, and are rewritten whenever the image is newer.
+ */
+
+#include <stdio.h>
+
+#include "common.h"
+#include "math.h"
+
+#define T_TILE   (8)  // texels on a tile's side, a power of 2
+#define T_LEVELS (16) // mips, enough for a 32k texture
+#define T_SHARDS (16) // of the tile cache, a power of 2
+
+struct texlevel_t {
+	s32 w, h;        // in texels
+	s32 tw;          // tiles across
+	size_t offset;   // of the level's first texel in texture_t::texels
+};
+
+struct texture_t {
+	char *name;      // the file it came from, so models can share it
+	s32 w, h;
+	s32 levels;
+	struct texlevel_t level[T_LEVELS];
+	u32 *texels;     // RGBA8, sRGB, tiled, every level one after another, NULL if they're in fp
+	size_t len;      // texels, padding included
+	u32 id;          // for the tile cache's keys
+	struct texcache_t *cache; // where the tiles go when texels is NULL
+	FILE *fp;        // the pre-tiled file, read a tile at a time
+	omp_lock_t lock; // for fp
+};
+
+struct tileentry_t { // a slot of a tile cache shard
+	u64 key;         // texture, level and tile
+	s32 chain;       // the next slot in the same hash bucket, -1 at the end
+	s32 older;       // LRU list, -1 at either end
+	s32 newer;
+};
+
+struct tileshard_t {
+	omp_lock_t lock;
+	struct tileentry_t *entries;
+	u32 *tiles;      // T_TILE * T_TILE texels per slot
+	s32 *buckets;    // the first slot of each hash chain, -1 if empty
+	s32 len, cap;    // slots in use, and in all
+	s32 mask;        // buckets - 1, a power of 2 less one
+	s32 oldest, newest;
+	u64 hits, misses, bytes;
+	u8 pad[64];      // keeps the counters of neighboring shards off each other's cache lines
+};
+
+struct texcache_t {
+	size_t budget;   // bytes of tiles, over every shard, 0 when there's no cache
+	struct tileshard_t shards[T_SHARDS];
+};
+
+/* T_Load : reads the image and builds the texture from it, returns -1 if it couldn't */
+int T_Load(struct texture_t *tex, char *name);
+
+/* T_Build : builds the tiled mip pyramid from w x h RGBA8 pixels */
+int T_Build(struct texture_t *tex, u8 *pixels, s32 w, s32 h);
+
+/* T_Sample : the linear color at u, v, trilinearly filtered at the lod (0 is the full size) */
+void T_Sample(struct texture_t *tex, f32 u, f32 v, f32 lod, vecf4_t out);
+
+/* T_Lod : the mip level for a pixel's footprint, given how far u, v move per pixel in x and y */
+f32 T_Lod(struct texture_t *tex, f32 dudx, f32 dvdx, f32 dudy, f32 dvdy);
+
+/* T_Free : frees the texture's texels and name, and closes its pre-tiled file */
+void T_Free(struct texture_t *tex);
+
+/* T_Open : opens the image's pre-tiled file, writing it first if need be, its tiles paged in through the cache */
+int T_Open(struct texture_t *tex, char *name, struct texcache_t *cache, u32 id);
+
+/* T_CacheInit : sets up the tile cache, budget bytes of tiles split over the shards */
+int T_CacheInit(struct texcache_t *cache, size_t budget);
+
+/* T_CacheCounters : the hits, misses and bytes read, summed over every shard */
+void T_CacheCounters(struct texcache_t *cache, u64 *hits, u64 *misses, u64 *bytes);
+
+/* T_CacheFree : frees the tile cache */
+void T_CacheFree(struct texcache_t *cache);
+
+#endif // TEXTURE_H
+
@@ -0,0 +1,758 @@
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Wavefront path tracing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "common.h"
+#include "math.h"
+#include "bvh.h"
+#include "camera.h"
+#include "bray.h"
+#include "wave.h"
+
+#define W_OFFSET (0.0001f) // how far new rays start off the surface
+
+enum { // sampler dimensions, the camera's, then W_DIMS more for every bounce
+	W_DIM_PIXELX,
+	W_DIM_PIXELY,
+	W_DIM_CAMERA
+};
+
+enum { // within a bounce
+	W_DIM_LIGHT,  // which light
+	W_DIM_LIGHTU, // where on it
+	W_DIM_LIGHTV,
+	W_DIM_DIRU,   // the bounce's direction
+	W_DIM_DIRV,
+	W_DIM_RR,     // russian roulette
+	W_DIMS
+};
+
+/* W_Random : the path's sample for the dimension, in [0, 1) */
+static inline f32 W_Random(struct world_t *world, struct path_t *p, u32 dim)
+{
+	return S_Get(&world->sampler, p->pixel % world->camera.w, p->pixel / world->camera.w, p->sample, dim);
+}
+
+/* W_Cosine : a cosine weighted direction around unit n, from two samples */
+static inline void W_Cosine(vecf3_t out, vecf3_t n, f32 u1, f32 u2)
+{
+	vecf3_t t, b;
+	f32 r, phi, x, y, z;
+	s32 k;
+
+	Vec3Basis(t, b, n);
+
+	r = sqrtf(u1);
+	phi = 2 * M_PI * u2;
+	x = r * cosf(phi);
+	y = r * sinf(phi);
+	z = sqrtf(MAX(0, 1 - x * x - y * y));
+
+	for (k = 0; k < 3; k++) {
+		out[k] = x * t[k] + y * b[k] + z * n[k];
+	}
+}
+
+/* W_TriangleArea : the area of the triangle */
+static inline f32 W_TriangleArea(struct triangle_t *tri)
+{
+	vecf3_t e1, e2, c;
+
+	Vec3Sub(e1, tri->b, tri->a);
+	Vec3Sub(e2, tri->c, tri->a);
+	Vec3Cross(c, e1, e2);
+
+	return 0.5f * sqrtf(Vec3Dot(c, c));
+}
+
+/* W_LightCos : cosine at the light toward dir's origin, 0 behind it unless its mesh is double-sided */
+static inline f32 W_LightCos(struct world_t *world, u32 prim, vecf3_t dir)
+{
+	f32 c;
+
+	// the traversal may be double-sided for every mesh because one is, but
+	// a light only shines from both faces if its own mesh is
+	c = -Vec3Dot(world->t[prim].n, dir);
+
+	return world->meshes[world->mesh[prim]].flags & MESH_TWOSIDED ? fabsf(c) : MAX(c, 0);
+}
+
+/* W_PowerHeuristic : MIS weight of the strategy with pdf a, against pdf b */
+static inline f32 W_PowerHeuristic(f32 a, f32 b)
+{
+	return a * a / (a * a + b * b);
+}
+
+/* W_Splat : adds c into the sample's radiance, only its own path and shadow ray touch it */
+static inline void W_Splat(vecf3_t *radiance, u32 slot, vecf3_t c)
+{
+	Vec3Add(radiance[slot], radiance[slot], c);
+}
+
+/* W_Luminance : the luminance of a color */
+static inline f32 W_Luminance(vecf3_t c)
+{
+	return 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+}
+
+/* W_Normals : the hit's face and shading normals, turned back toward the ray so both sides shade alike */
+static inline void W_Normals(struct world_t *world, struct path_t *p, vecf3_t n, vecf3_t ns)
+{
+	Vec3Copy(n, world->t[p->hit].n);
+	R_ShadingNormal(world, p->hit, p->tuv[1], p->tuv[2], ns);
+	if (Vec3Dot(n, p->dir) > 0) {
+		Vec3Scale(n, n, -1);
+		Vec3Scale(ns, ns, -1);
+	}
+}
+
+/* W_FirstHit : keeps the camera ray's hit for the AOVs */
+static inline void W_FirstHit(struct wave_t *wave, struct path_t *p, vecf3_t n, vecf3_t ns, vecf3_t albedo)
+{
+	Vec3Copy(wave->aov.normal[p->slot], n);
+	Vec3Copy(wave->aov.shading[p->slot], ns);
+	Vec3Copy(wave->aov.albedo[p->slot], albedo);
+	wave->aov.depth[p->slot] = p->tuv[0];
+	wave->aov.prim[p->slot] = p->hit;
+	wave->aov.bary[p->slot][0] = p->tuv[1];
+	wave->aov.bary[p->slot][1] = p->tuv[2];
+}
+
+/* W_Emission : the hit's emission, if the bounce found a light, which next event estimation might have too */
+static inline void W_Emission(struct world_t *world, struct wave_t *wave, struct path_t *p, s32 bounce)
+{
+	struct material_t *m;
+	struct triangle_t *tri;
+	vecf3_t c;
+	f32 cos_l, pick, wt;
+	s32 j;
+
+	m = world->materials + world->mat[p->hit];
+	if (m->emission[0] <= 0 && m->emission[1] <= 0 && m->emission[2] <= 0) {
+		return;
+	}
+
+	tri = world->t + p->hit;
+
+	// the back of a one-sided light, which next event estimation never picks
+	cos_l = W_LightCos(world, p->hit, p->dir);
+	if (cos_l <= 0) {
+		return;
+	}
+
+	wt = 1;
+	if (bounce > 0) {
+		pick = L_Pdf(&world->lights, p->origin, p->normal, p->hit);
+		wt = W_PowerHeuristic(p->pdf, W_LightPdf(pick, tri, p->tuv[0], cos_l));
+	}
+
+	for (j = 0; j < 3; j++) {
+		c[j] = p->weight[j] * m->emission[j] * wt;
+	}
+	W_Splat(wave->radiance, p->slot, c);
+}
+
+/* W_ShadeMiss : the sky, which nothing samples directly, so all of it comes through here */
+static inline void W_ShadeMiss(struct wave_t *wave, struct path_t *p)
+{
+	vecf3_t c;
+	s32 j;
+
+	W_Sky(c, p->dir);
+	for (j = 0; j < 3; j++) {
+		c[j] *= p->weight[j];
+	}
+	W_Splat(wave->radiance, p->slot, c);
+}
+
+/* W_ShadeEmit : a hit on a material that reflects nothing, so all that's left is its emission */
+static inline void W_ShadeEmit(struct world_t *world, struct wave_t *wave, struct path_t *p, s32 bounce)
+{
+	vecf3_t n, ns;
+
+	if (bounce == 0 && wave->aov.normal) {
+		W_Normals(world, p, n, ns);
+		W_FirstHit(wave, p, n, ns, world->materials[world->mat[p->hit]].albedo);
+	}
+
+	W_Emission(world, wave, p, bounce);
+}
+
+/* W_ShadeDiffuse : a hit on a diffuse material, queueing its shadow ray and bounce, returns 1 if roulette ended it */
+static inline s32 W_ShadeDiffuse(struct world_t *world, struct wave_t *wave, struct path_t *p, s32 bounce, s32 textured)
+{
+	struct path_t *q;
+	struct shadow_t *s;
+	struct material_t *lm;
+	struct footprint_t fp;
+	vecf3_t n, ns, albedo, pos, off, to, dir, t, b;
+	f32 cos_s, cos_l, dist, pick, pdf_l, pdf_b, wt, r1, r2, survive;
+	size_t k;
+	u32 light, dim;
+	s32 j;
+
+	dim = W_DIM_CAMERA + bounce * W_DIMS;
+
+	W_Normals(world, p, n, ns);
+
+	// the differentials are carried along even without a texture, for the ones further on
+	R_Differentials(world, p->hit, p->tuv[0], p->dir, &p->rd, &fp);
+	if (textured) {
+		R_Albedo(world, p->hit, p->tuv[1], p->tuv[2], &fp, albedo);
+	} else {
+		Vec3Copy(albedo, world->materials[world->mat[p->hit]].albedo);
+	}
+
+	if (bounce == 0 && wave->aov.normal) {
+		W_FirstHit(wave, p, n, ns, albedo);
+	}
+
+	W_Emission(world, wave, p, bounce);
+
+	if (albedo[0] <= 0 && albedo[1] <= 0 && albedo[2] <= 0) {
+		return 0;
+	}
+
+	Vec3Scale(pos, p->dir, p->tuv[0]);
+	Vec3Add(pos, pos, p->origin);
+	Vec3Scale(off, n, W_OFFSET);
+	Vec3Add(pos, pos, off);
+
+	// the last vertex, so there's no bounce for a light sample to be weighed against
+	if (bounce >= world->bounces) {
+		return 0;
+	}
+
+	// next event estimation, toward a uniform point on a light picked for this point
+	if (world->lights.len) {
+		light = L_Sample(&world->lights, pos, ns, W_Random(world, p, dim + W_DIM_LIGHT), &pick);
+		lm = world->materials + world->mat[light];
+
+		r1 = sqrtf(W_Random(world, p, dim + W_DIM_LIGHTU));
+		r2 = W_Random(world, p, dim + W_DIM_LIGHTV);
+		for (j = 0; j < 3; j++) {
+			to[j] = (1 - r1) * world->t[light].a[j] +
+				r1 * (1 - r2) * world->t[light].b[j] +
+				r1 * r2 * world->t[light].c[j] - pos[j];
+		}
+
+		dist = sqrtf(Vec3Dot(to, to));
+		Vec3Scale(to, to, 1.0f / dist);
+
+		// shaded by the smooth normal, but it still can't light the back of the face
+		cos_s = Vec3Dot(ns, to);
+
+		// only from the faces a bounce would get light from too, or the two
+		// strategies wouldn't agree
+		cos_l = W_LightCos(world, light, to);
+
+		if (cos_s > 0 && cos_l > 0 && Vec3Dot(n, to) > 0) {
+			pdf_l = W_LightPdf(pick, world->t + light, dist, cos_l);
+			pdf_b = cos_s / M_PI;
+			wt = W_PowerHeuristic(pdf_l, pdf_b);
+
+#pragma omp atomic capture
+			k = wave->shadows_len++;
+
+			// albedo / pi is the diffuse brdf
+			s = wave->shadows + k;
+			s->slot = p->slot;
+			s->tmax = dist * (1 - W_OFFSET);
+			Vec3Copy(s->origin, pos);
+			Vec3Copy(s->dir, to);
+			for (j = 0; j < 3; j++) {
+				s->radiance[j] = p->weight[j] * albedo[j] * lm->emission[j] *
+					(cos_s / M_PI) / pdf_l * wt;
+			}
+		}
+	}
+
+	// for a cosine weighted bounce the brdf, cosine and pdf leave just the albedo
+	for (j = 0; j < 3; j++) {
+		p->weight[j] *= albedo[j];
+	}
+
+	// russian roulette, capped per bounce so the short paths can be spared
+	survive = MIN(world->rr[bounce], MAX(p->weight[0], MAX(p->weight[1], p->weight[2])));
+	if (world->rr[bounce] < 1) {
+		if (W_Random(world, p, dim + W_DIM_RR) >= survive) {
+			return 1;
+		}
+		Vec3Scale(p->weight, p->weight, 1.0f / survive);
+	}
+
+	// the shading normal can tip the bounce under the face, where it's absorbed
+	W_Cosine(dir, ns, W_Random(world, p, dim + W_DIM_DIRU), W_Random(world, p, dim + W_DIM_DIRV));
+	if (Vec3Dot(dir, n) <= 0) {
+		return 0;
+	}
+
+#pragma omp atomic capture
+	k = wave->next_len++;
+
+	q = wave->next + k;
+	*q = *p;
+	Vec3Copy(q->origin, pos);
+	Vec3Copy(q->normal, ns);
+	Vec3Copy(q->dir, dir);
+	q->pdf = Vec3Dot(ns, q->dir) / M_PI;
+
+	// a diffuse bounce goes anywhere, so it has no differentials of its own,
+	// it keeps spreading as fast as it came in, just turned across dir
+	Vec3Basis(t, b, dir);
+	Vec3Scale(q->rd.dddx, t, sqrtf(Vec3Dot(p->rd.dddx, p->rd.dddx)));
+	Vec3Scale(q->rd.dddy, b, sqrtf(Vec3Dot(p->rd.dddy, p->rd.dddy)));
+
+	return 0;
+}
+
+/* W_Render : path traces the world into the framebuffer, and the AOVs if not NULL, a batch at a time */
+int W_Render(struct world_t *world, vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h)
+{
+	struct wave_t wave;
+	struct material_t *m;
+	size_t first, total, len, i, j;
+	f64 start, stage;
+	f32 l, len2;
+	s32 bounce, spp;
+	int rc;
+
+	memset(&wave, 0, sizeof(wave));
+
+	spp = MAX(1, world->spp);
+	total = (size_t)w * h * spp;
+	rc = 0;
+
+	wave.paths = malloc(W_BATCH * sizeof(*wave.paths));
+	wave.next = malloc(W_BATCH * sizeof(*wave.next));
+	wave.shadows = malloc(W_BATCH * sizeof(*wave.shadows));
+	wave.radiance = malloc(W_BATCH * sizeof(*wave.radiance));
+	wave.buckets = malloc((1 << W_SORTBITS) * sizeof(*wave.buckets));
+	wave.order = malloc(W_BATCH * sizeof(*wave.order));
+	wave.bins = malloc((world->materials_len + 1) * sizeof(*wave.bins));
+	wave.kernels = malloc((world->materials_len + 1) * sizeof(*wave.kernels));
+
+	if (!wave.paths || !wave.next || !wave.shadows || !wave.radiance || !wave.buckets ||
+		!wave.order || !wave.bins || !wave.kernels) {
+		rc = -1;
+		goto done;
+	}
+
+	// every material's kernel is picked once, up front, the misses' bin comes last
+	for (i = 0; i < world->materials_len; i++) {
+		m = world->materials + i;
+		if (m->tex) {
+			wave.kernels[i] = W_KERNEL_TEXTURED;
+		} else if (m->albedo[0] <= 0 && m->albedo[1] <= 0 && m->albedo[2] <= 0) {
+			wave.kernels[i] = W_KERNEL_EMIT;
+		} else {
+			wave.kernels[i] = W_KERNEL_DIFFUSE;
+		}
+	}
+	wave.kernels[world->materials_len] = W_KERNEL_MISS;
+
+	if (aov) {
+		wave.aov.normal = malloc(W_BATCH * sizeof(*wave.aov.normal));
+		wave.aov.albedo = malloc(W_BATCH * sizeof(*wave.aov.albedo));
+		wave.aov.depth = malloc(W_BATCH * sizeof(*wave.aov.depth));
+		wave.aov.shading = malloc(W_BATCH * sizeof(*wave.aov.shading));
+		wave.aov.prim = malloc(W_BATCH * sizeof(*wave.aov.prim));
+		wave.aov.bary = malloc(W_BATCH * sizeof(*wave.aov.bary));
+
+		if (!wave.aov.normal || !wave.aov.albedo || !wave.aov.depth ||
+			!wave.aov.shading || !wave.aov.prim || !wave.aov.bary) {
+			rc = -1;
+			goto done;
+		}
+
+		memset(aov->normal, 0, w * h * sizeof(*aov->normal));
+		memset(aov->shading, 0, w * h * sizeof(*aov->shading));
+		memset(aov->albedo, 0, w * h * sizeof(*aov->albedo));
+		memset(aov->variance, 0, w * h * sizeof(*aov->variance));
+		for (i = 0; i < (size_t)w * h; i++) {
+			aov->depth[i] = FLT_MAX;
+		}
+	}
+
+	if (world->bvh.nodes_len) {
+		Vec3Copy(wave.bounds.min, world->bvh.nodes[0].min);
+		Vec3Copy(wave.bounds.max, world->bvh.nodes[0].max);
+	}
+
+	CAM_Setup(&world->camera, w, h);
+
+	if (S_Init(&world->sampler) < 0) {
+		rc = -1;
+		goto done;
+	}
+
+	memset(framebuffer, 0, w * h * sizeof(*framebuffer));
+
+	start = C_Time();
+
+	for (first = 0; first < total; first += W_BATCH) {
+		len = MIN(W_BATCH, total - first);
+		W_Generate(world, &wave, first, len);
+
+		for (bounce = 0; wave.paths_len; bounce++) {
+			stage = C_Time();
+
+			wave.stats.paths[bounce] += wave.paths_len;
+
+			W_Trace(world, &wave);
+			W_Bin(world, &wave);
+			W_Shade(world, &wave, bounce);
+			W_Shadow(world, &wave);
+			W_Sort(&wave);
+
+			wave.stats.shadows[bounce] += wave.shadows_len;
+			wave.stats.time[bounce] += C_Time() - stage;
+		}
+
+		// in sample order, so the sums come out the same for any thread count
+		for (i = 0; i < len; i++) {
+			j = (first + i) / spp;
+			Vec3Add(framebuffer[j], framebuffer[j], wave.radiance[i]);
+		}
+
+		if (aov) {
+			for (i = 0; i < len; i++) {
+				j = (first + i) / spp;
+				Vec3Add(aov->normal[j], aov->normal[j], wave.aov.normal[i]);
+				Vec3Add(aov->shading[j], aov->shading[j], wave.aov.shading[i]);
+				Vec3Add(aov->albedo[j], aov->albedo[j], wave.aov.albedo[i]);
+				aov->depth[j] = MIN(aov->depth[j], wave.aov.depth[i]);
+				l = W_Luminance(wave.radiance[i]);
+				aov->variance[j] += l * l;
+
+				// ids and barycentrics don't average, so they're the first sample's
+				if ((first + i) % spp == 0) {
+					aov->prim[j] = wave.aov.prim[i];
+					aov->bary[j][0] = wave.aov.bary[i][0];
+					aov->bary[j][1] = wave.aov.bary[i][1];
+				}
+			}
+		}
+	}
+
+	if (world->stats) {
+		W_Stats(&wave.stats, C_Time() - start);
+	}
+
+	for (i = 0; i < (size_t)w * h; i++) {
+		Vec3Scale(framebuffer[i], framebuffer[i], (1.0f / spp));
+	}
+
+	// the sample variance, over spp for the mean's, which one sample can't give
+	for (i = 0; aov && i < (size_t)w * h; i++) {
+		len2 = Vec3Dot(aov->normal[i], aov->normal[i]);
+		if (len2 > 0) {
+			Vec3Scale(aov->normal[i], aov->normal[i], (1.0f / sqrtf(len2)));
+		}
+
+		len2 = Vec3Dot(aov->shading[i], aov->shading[i]);
+		if (len2 > 0) {
+			Vec3Scale(aov->shading[i], aov->shading[i], (1.0f / sqrtf(len2)));
+		}
+
+		Vec3Scale(aov->albedo[i], aov->albedo[i], (1.0f / spp));
+
+		if (aov->depth[i] == FLT_MAX) {
+			aov->depth[i] = 0;
+		}
+
+		if (spp > 1) {
+			l = W_Luminance(framebuffer[i]);
+			aov->variance[i] = MAX(0, aov->variance[i] / spp - l * l) / (spp - 1);
+		} else {
+			aov->variance[i] = -1;
+		}
+	}
+
+done:
+	free(wave.paths);
+	free(wave.next);
+	free(wave.shadows);
+	free(wave.radiance);
+	free(wave.buckets);
+	free(wave.order);
+	free(wave.bins);
+	free(wave.kernels);
+	free(wave.aov.normal);
+	free(wave.aov.albedo);
+	free(wave.aov.depth);
+	free(wave.aov.shading);
+	free(wave.aov.prim);
+	free(wave.aov.bary);
+
+	return rc;
+}
+
+/* W_Generate : fills the path queue with camera samples first through first + len */
+void W_Generate(struct world_t *world, struct wave_t *wave, size_t first, size_t len)
+{
+	struct camera_t *cam;
+	struct path_t *p;
+	f32 x, y, scale;
+	s32 spp;
+	size_t i, s;
+
+	cam = &world->camera;
+	spp = MAX(1, world->spp);
+	scale = 1 / sqrtf(spp);
+
+#pragma omp parallel for private(p, x, y, s) schedule(static)
+	for (i = 0; i < len; i++) {
+		p = wave->paths + i;
+		s = first + i;
+
+		p->pixel = s / spp;
+		p->sample = s % spp;
+		p->slot = i;
+		p->pdf = 0;
+		Vec3(p->normal, 0, 0, 0);
+		Vec3(p->weight, 1, 1, 1);
+
+		x = p->pixel % cam->w;
+		y = p->pixel / cam->w;
+
+		// one sample goes through the center, more get spread over the pixel
+		if (spp > 1) {
+			x += W_Random(world, p, W_DIM_PIXELX) - 0.5f;
+			y += W_Random(world, p, W_DIM_PIXELY) - 0.5f;
+		}
+
+		CAM_Ray(cam, x, y, p->origin, p->dir);
+
+		// the samples share the pixel, each one covers that much less of it
+		CAM_Differentials(cam, p->dir, scale, &p->rd);
+	}
+
+	memset(wave->radiance, 0, len * sizeof(*wave->radiance));
+
+	// what a miss leaves behind
+	if (wave->aov.normal) {
+		memset(wave->aov.normal, 0, len * sizeof(*wave->aov.normal));
+		memset(wave->aov.shading, 0, len * sizeof(*wave->aov.shading));
+		memset(wave->aov.albedo, 0, len * sizeof(*wave->aov.albedo));
+		memset(wave->aov.bary, 0, len * sizeof(*wave->aov.bary));
+		for (i = 0; i < len; i++) {
+			wave->aov.depth[i] = FLT_MAX;
+			wave->aov.prim[i] = BVH_NONE;
+		}
+	}
+
+	wave->paths_len = len;
+}
+
+/* W_Trace : finds the closest hit for every path in the queue */
+void W_Trace(struct world_t *world, struct wave_t *wave)
+{
+	struct ray_t ray;
+	struct path_t *p;
+	size_t i;
+
+#pragma omp parallel for private(ray, p) schedule(dynamic, 64)
+	for (i = 0; i < wave->paths_len; i++) {
+		p = wave->paths + i;
+
+		R_RayInit(&ray, p->origin, p->dir);
+		p->hit = R_Traverse(world, &ray, p->tuv, FLT_MAX);
+	}
+}
+
+/* W_Bin : groups the path queue by material into the order it's shaded in, the misses last */
+void W_Bin(struct world_t *world, struct wave_t *wave)
+{
+	struct path_t *p;
+	u32 sum, tmp;
+	size_t i, bins;
+
+	bins = world->materials_len + 1;
+
+	memset(wave->bins, 0, bins * sizeof(*wave->bins));
+
+	for (i = 0; i < wave->paths_len; i++) {
+		p = wave->paths + i;
+		p->key = p->hit == BVH_NONE ? world->materials_len : world->mat[p->hit];
+		wave->bins[p->key]++;
+	}
+
+	for (i = 0, sum = 0; i < bins; i++) {
+		tmp = wave->bins[i];
+		wave->bins[i] = sum;
+		sum += tmp;
+	}
+
+	for (i = 0; i < wave->paths_len; i++) {
+		wave->order[wave->bins[wave->paths[i].key]++] = i;
+	}
+}
+
+/* W_Shade : shades every path, queueing shadow rays and the next bounce */
+void W_Shade(struct world_t *world, struct wave_t *wave, s32 bounce)
+{
+	struct path_t *p;
+	size_t i, killed;
+
+	wave->next_len = 0;
+	wave->shadows_len = 0;
+	killed = 0;
+
+	// in material order, so each thread runs one kernel over a long stretch of
+	// paths, reading the same material and texture, before moving to the next
+#pragma omp parallel for private(p) reduction(+:killed) schedule(static)
+	for (i = 0; i < wave->paths_len; i++) {
+		p = wave->paths + wave->order[i];
+
+		switch (wave->kernels[p->key]) {
+		case W_KERNEL_MISS:
+			W_ShadeMiss(wave, p);
+			break;
+		case W_KERNEL_EMIT:
+			W_ShadeEmit(world, wave, p, bounce);
+			break;
+		case W_KERNEL_DIFFUSE:
+			killed += W_ShadeDiffuse(world, wave, p, bounce, 0);
+			break;
+		case W_KERNEL_TEXTURED:
+			killed += W_ShadeDiffuse(world, wave, p, bounce, 1);
+			break;
+		}
+	}
+
+	wave->stats.killed[bounce] += killed;
+}
+
+/* W_Shadow : traces the shadow queue, adding in the unoccluded light */
+void W_Shadow(struct world_t *world, struct wave_t *wave)
+{
+	struct ray_t ray;
+	struct shadow_t *s;
+	size_t i;
+
+#pragma omp parallel for private(ray, s) schedule(dynamic, 64)
+	for (i = 0; i < wave->shadows_len; i++) {
+		s = wave->shadows + i;
+
+		R_RayInit(&ray, s->origin, s->dir);
+		if (!R_Occluded(world, &ray, s->tmax)) {
+			W_Splat(wave->radiance, s->slot, s->radiance);
+		}
+	}
+}
+
+/* W_Sort : moves the next queue into the path queue, sorted by direction and origin */
+void W_Sort(struct wave_t *wave)
+{
+	struct path_t *p;
+	vecf3_t scale;
+	u32 cell[3], octant, code, sum, tmp;
+	size_t i;
+	s32 k, b;
+
+	// 8 cells per axis, the origin half of the key is 3 bits of morton code each
+	for (k = 0; k < 3; k++) {
+		scale[k] = wave->bounds.max[k] - wave->bounds.min[k];
+		scale[k] = scale[k] > 0 ? 8 / scale[k] : 0;
+	}
+
+	memset(wave->buckets, 0, (1 << W_SORTBITS) * sizeof(*wave->buckets));
+
+	for (i = 0; i < wave->next_len; i++) {
+		p = wave->next + i;
+
+		octant = (p->dir[0] < 0) | (p->dir[1] < 0) << 1 | (p->dir[2] < 0) << 2;
+
+		for (k = 0; k < 3; k++) {
+			cell[k] = CLAMP((p->origin[k] - wave->bounds.min[k]) * scale[k], 0, 7);
+		}
+
+		for (b = 0, code = 0; b < 3; b++) {
+			for (k = 0; k < 3; k++) {
+				code |= ((cell[k] >> b) & 1) << (b * 3 + k);
+			}
+		}
+
+		p->key = octant << (W_SORTBITS - 3) | code;
+		wave->buckets[p->key]++;
+	}
+
+	for (i = 0, sum = 0; i < (1 << W_SORTBITS); i++) {
+		tmp = wave->buckets[i];
+		wave->buckets[i] = sum;
+		sum += tmp;
+	}
+
+	for (i = 0; i < wave->next_len; i++) {
+		p = wave->next + i;
+		wave->paths[wave->buckets[p->key]++] = *p;
+	}
+
+	wave->paths_len = wave->next_len;
+	wave->next_len = 0;
+}
+
+/* W_Stats : prints the per bounce counts and times */
+void W_Stats(struct wavestats_t *stats, f64 total)
+{
+	size_t paths, shadows;
+	s32 i;
+
+	paths = 0;
+	shadows = 0;
+
+	printf("stats: bounce %10s %10s %10s %9s %8s\n", "paths", "shadows", "killed", "ms", "Mrays/s");
+
+	for (i = 0; i < DEPTH_MAX && stats->paths[i]; i++) {
+		printf("stats: %6d %10zu %10zu %10zu %9.2f %8.3f\n", i,
+			stats->paths[i], stats->shadows[i], stats->killed[i], stats->time[i] * 1000,
+			stats->time[i] > 0 ? (stats->paths[i] + stats->shadows[i]) / stats->time[i] / 1e6 : 0.0);
+
+		paths += stats->paths[i];
+		shadows += stats->shadows[i];
+	}
+
+	printf("stats: total  %10zu %10zu %10s %9.2f %8.3f\n", paths, shadows, "",
+		total * 1000, total > 0 ? (paths + shadows) / total / 1e6 : 0.0);
+}
+
+/* W_LightPdf : solid angle pdf of next event estimation picking this point on a light */
+f32 W_LightPdf(f32 pick, struct triangle_t *tri, f32 dist, f32 cos_l)
+{
+	if (pick <= 0 || cos_l <= 0) {
+		return 0;
+	}
+
+	// the light's pick, a uniform point on it, then area to solid angle
+	return pick * dist * dist / (cos_l * W_TriangleArea(tri));
+}
+
+/* W_Sky : the sky's radiance along dir */
+void W_Sky(vecf3_t out, vecf3_t dir)
+{
+	vecf3_t horizon, zenith;
+	f32 t;
+
+	// z is up, white at the horizon fading to blue overhead, and a dim ground
+	Vec3(horizon, 1.0f, 1.0f, 1.0f);
+	Vec3(zenith, 0.5f, 0.7f, 1.0f);
+
+	if (dir[2] < 0) {
+		Vec3(out, 0.2f, 0.2f, 0.2f);
+		return;
+	}
+
+	t = dir[2];
+	Vec3Lerp(out, horizon, zenith, t);
+}
+
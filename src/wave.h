@@ -0,0 +1,145 @@
+#ifndef WAVE_H
+#define WAVE_H
+
+/*
+ * Brian Chrzanowski
+ * Mon Oct 19, 2026 08:30
+ *
+ * Wavefront path tracing
+ *
+ * Instead of following each pixel's path to the end before starting the
+ * next, W_Render keeps a batch of paths in flight and moves the whole batch
+ * through one stage at a time:
+ *
+ *   generate - camera samples for a range of pixels, into the path queue
+ *   trace    - closest hit for every path in the queue
+ *   bin      - the queue's order, grouped by the material hit, a counting
+ *              sort with a bin per material and one for the misses
+ *   shade    - misses pick up the sky, hits pick up their emission, queue a
+ *              shadow ray toward a light and a bounce, and the survivors of
+ *              russian roulette go into the next path queue
+ *   shadow   - any-hit tests for the shadow queue, lighting what's visible
+ *   sort     - the next queue, by direction octant and then origin, so the
+ *              next trace walks the same parts of the tree together
+ *
+ * Every stage is a flat loop over a queue, which keeps each one's working
+ * set small, and gives the threads even, independent chunks of work.
+ *
+ * Shading goes through the queue in the bin stage's order, and each material
+ * gets the kernel that fits it, picked once per render: the sky for misses,
+ * just the emission for lights that reflect nothing, diffuse, and diffuse
+ * with a texture. A thread's chunk is then long runs of one kernel on one
+ * material, so its branches stay predicted and a texture's tiles stay in
+ * cache while its hits are shaded, instead of switching at nearly every hit.
+ *
+ * Each sample adds its light into its own slot of the batch, and the slots are
+ * summed into the pixels in order once the batch is done, so with the
+ * sampler's numbers fixed by pixel, sample and dimension, an image comes out
+ * bit for bit the same on any number of threads. The first hit's normals,
+ * albedo, depth, triangle and barycentrics are kept per slot the same way
+ * when W_Render is asked for AOVs, along with each sample's luminance squared
+ * for the pixel's variance.
+ *
+ * Light reaches a path two ways: a shadow ray toward a point sampled on an
+ * emissive triangle picked by L_Sample (next event estimation), or the bounce
+ * itself landing on one. Both are weighted with the power heuristic (Veach
+ * 1995), so whichever sampled the light better dominates. The sky is only
+ * reached by bounces.
+ *
+ * Every path carries its ray differentials from the camera, moved along to
+ * each hit so textures are read at the level that matches the footprint.
+ */
+
+#include "common.h"
+#include "math.h"
+#include "bvh.h"
+#include "bray.h"
+
+#define W_BATCH     (1 << 18) // paths in flight at once
+#define W_SORTBITS  (12)      // 3 bits of direction octant, 9 of origin morton code
+
+enum { // how the shade stage handles a bin
+	W_KERNEL_MISS,     // the sky
+	W_KERNEL_EMIT,     // reflects nothing, just its emission
+	W_KERNEL_DIFFUSE,  // a constant albedo
+	W_KERNEL_TEXTURED, // albedo times a texture
+	W_KERNEL_TOTAL
+};
+
+struct path_t { // one camera sample, partway along its path
+	vecf3_t origin;
+	vecf3_t normal;  // at the origin, for the light pick's pdf if dir finds one
+	vecf3_t dir;
+	vecf3_t weight;  // throughput so far
+	f32 pdf;         // solid angle pdf of the bounce that made dir, for MIS
+	struct raydiff_t rd; // how origin and dir spread from pixel to pixel, for texture footprints
+	vecf3_t tuv;     // from the trace stage
+	u32 hit;         // from the trace stage, BVH_NONE on a miss
+	u32 pixel;
+	u32 sample;      // which of the pixel's samples, for the sampler
+	u32 slot;        // into wave_t::radiance
+	u32 key;         // for the sort stage, and the bin stage before it
+};
+
+struct shadow_t { // a shadow ray, and what it brings if nothing's in the way
+	vecf3_t origin;
+	vecf3_t dir;
+	vecf3_t radiance;
+	f32 tmax;        // stops short of the light
+	u32 slot;
+};
+
+struct wavestats_t { // per bounce, for tuning sample budgets against time
+	size_t paths[DEPTH_MAX];   // traced
+	size_t shadows[DEPTH_MAX]; // traced
+	size_t killed[DEPTH_MAX];  // by russian roulette
+	f64 time[DEPTH_MAX];       // seconds, all stages
+};
+
+struct wave_t {
+	struct path_t *paths;     // the queue being traced
+	struct path_t *next;      // survivors of the shade stage
+	struct shadow_t *shadows;
+	vecf3_t *radiance;        // per sample of the batch, summed into the pixels at the end
+	struct aov_t aov;         // per sample of the batch, if W_Render has somewhere to put them
+	size_t paths_len, next_len, shadows_len;
+	u32 *buckets;             // counting sort, 1 << W_SORTBITS of them
+	u32 *order;               // the path queue, grouped by material for the shade stage
+	u32 *bins;                // counting sort, one per material and one for the misses
+	u8 *kernels;              // per bin, W_KERNEL_*
+	struct aabb_t bounds;     // the scene's, for the origin half of the sort key
+	struct wavestats_t stats;
+};
+
+/* W_Render : path traces the world into the framebuffer, and the AOVs if not NULL, a batch at a time */
+int W_Render(struct world_t *world, vecf3_t *framebuffer, struct aov_t *aov, s32 w, s32 h);
+
+/* W_Generate : fills the path queue with camera samples first through first + len */
+void W_Generate(struct world_t *world, struct wave_t *wave, size_t first, size_t len);
+
+/* W_Trace : finds the closest hit for every path in the queue */
+void W_Trace(struct world_t *world, struct wave_t *wave);
+
+/* W_Bin : groups the path queue by material into the order it's shaded in, the misses last */
+void W_Bin(struct world_t *world, struct wave_t *wave);
+
+/* W_Shade : shades every path, queueing shadow rays and the next bounce */
+void W_Shade(struct world_t *world, struct wave_t *wave, s32 bounce);
+
+/* W_Shadow : traces the shadow queue, adding in the unoccluded light */
+void W_Shadow(struct world_t *world, struct wave_t *wave);
+
+/* W_Sort : moves the next queue into the path queue, sorted by direction and origin */
+void W_Sort(struct wave_t *wave);
+
+/* W_Stats : prints the per bounce counts and times */
+void W_Stats(struct wavestats_t *stats, f64 total);
+
+/* W_LightPdf : solid angle pdf of next event estimation picking this point on a light */
+f32 W_LightPdf(f32 pick, struct triangle_t *tri, f32 dist, f32 cos_l);
+
+/* W_Sky : the sky's radiance along dir */
+void W_Sky(vecf3_t out, vecf3_t dir);
+
+#endif // WAVE_H
+